@@ -9,21 +9,83 @@ CONFIG += c++17
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 SOURCES += \
+    acquisitionconfig.cpp \
+    coilsequence.cpp \
+    commandchannel.cpp \
     dataconsumer.cpp \
+    datagramdecoder.cpp \
+    frameassembler.cpp \
+    framelockengine.cpp \
+    framestreamserver.cpp \
+    frequencyrouter.cpp \
+    frequencytable.cpp \
+    heatmaprenderer.cpp \
+    heatmapview.cpp \
+    impedancestage.cpp \
+    instrumentsession.cpp \
     main.cpp \
     mainwindow.cpp \
+    measurementfile.cpp \
+    metricsserver.cpp \
+    oversamplereduction.cpp \
+    pipelinemetrics.cpp \
+    pipelinetrace.cpp \
     processingdata.cpp \
-    sharedbuffer.cpp
+    reconstructionengine.cpp \
+    referencecalibration.cpp \
+    reorderbuffer.cpp \
+    sequencetracker.cpp \
+    sharedbuffer.cpp \
+    sharedframering.cpp \
+    statestatistics.cpp \
+    statushistory.cpp \
+    sweepcampaign.cpp \
+    threadtuning.cpp \
+    trendpyramid.cpp \
+    trendview.cpp
 
 HEADERS += \
+    acquisitionconfig.h \
+    coilsequence.h \
+    commandchannel.h \
     dataconsumer.h \
+    datagramdecoder.h \
+    emtframering.h \
+    frameassembler.h \
+    framelockengine.h \
+    framestreamserver.h \
+    frequencyrouter.h \
+    frequencytable.h \
+    heatmaprenderer.h \
+    heatmapview.h \
+    impedancestage.h \
+    instrumentsession.h \
     mainwindow.h \
+    measurementfile.h \
+    metricsserver.h \
+    oversamplereduction.h \
+    pipelinemetrics.h \
+    pipelinetrace.h \
     processingdata.h \
-    sharedbuffer.h
+    reconstructionengine.h \
+    referencecalibration.h \
+    reorderbuffer.h \
+    sequencetracker.h \
+    sharedbuffer.h \
+    sharedframering.h \
+    statestatistics.h \
+    statushistory.h \
+    sweepcampaign.h \
+    threadtuning.h \
+    trendpyramid.h \
+    trendview.h
 
 FORMS += \
     mainwindow.ui
 
+# shm_open lives in librt on older glibc
+linux: LIBS += -lrt
+
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
 else: unix:!android: target.path = /opt/$${TARGET}/bin
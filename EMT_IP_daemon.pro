@@ -0,0 +1,78 @@
+QT       += core network
+QT       -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = EMT_IP_daemon
+
+# Headless acquisition daemon, same pipeline as EMT_IP without any widget.
+# Shares its sources with EMT_IP.pro, build it in its own build directory.
+
+SOURCES += \
+    acquisitionconfig.cpp \
+    acquisitiondaemon.cpp \
+    coilsequence.cpp \
+    commandchannel.cpp \
+    daemonmain.cpp \
+    dataconsumer.cpp \
+    datagramdecoder.cpp \
+    frameassembler.cpp \
+    framelockengine.cpp \
+    framestreamserver.cpp \
+    frequencyrouter.cpp \
+    frequencytable.cpp \
+    impedancestage.cpp \
+    instrumentsession.cpp \
+    measurementfile.cpp \
+    metricsserver.cpp \
+    oversamplereduction.cpp \
+    pipelinemetrics.cpp \
+    pipelinetrace.cpp \
+    processingdata.cpp \
+    referencecalibration.cpp \
+    reorderbuffer.cpp \
+    sequencetracker.cpp \
+    sharedbuffer.cpp \
+    sharedframering.cpp \
+    statestatistics.cpp \
+    statushistory.cpp \
+    threadtuning.cpp
+
+HEADERS += \
+    acquisitionconfig.h \
+    acquisitiondaemon.h \
+    coilsequence.h \
+    commandchannel.h \
+    dataconsumer.h \
+    datagramdecoder.h \
+    emtframering.h \
+    frameassembler.h \
+    framelockengine.h \
+    framestreamserver.h \
+    frequencyrouter.h \
+    frequencytable.h \
+    impedancestage.h \
+    instrumentsession.h \
+    measurementfile.h \
+    metricsserver.h \
+    oversamplereduction.h \
+    pipelinemetrics.h \
+    pipelinetrace.h \
+    processingdata.h \
+    referencecalibration.h \
+    reorderbuffer.h \
+    sequencetracker.h \
+    sharedbuffer.h \
+    sharedframering.h \
+    statestatistics.h \
+    statushistory.h \
+    threadtuning.h
+
+# shm_open lives in librt on older glibc
+linux: LIBS += -lrt
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,312 @@
+#include "acquisitionconfig.h"
+#include "frequencytable.h"
+#include "reorderbuffer.h"
+#include "commandchannel.h"
+#include <QSettings>
+#include <QCommandLineParser>
+#include <QThread>
+
+//file key, command line option, help text
+struct ConfigKey {
+    const char *key;
+    const char *option;
+    const char *description;
+};
+
+static const ConfigKey configKeys[] = {
+    {"Network/LocalAddress", "local-address", "Address both sockets bind to."},
+    {"Network/MessagePort", "message-port", "Port of instrument messages and acknowledgements."},
+    {"Network/DataPort", "data-port", "Port of instrument data, commands are sent from it."},
+    {"Network/InstrumentAddress", "instrument-address", "Address of the instrument."},
+    {"Network/InstrumentPort", "instrument-port", "Command port of the instrument."},
+    {"Network/Instruments", "instruments", "Instruments acquired at once, [Instrument<n>] sections of the file give their addresses."},
+    {"Network/CommandAttempts", "command-attempts", "Transmissions of a command the instrument does not echo, 1 is no retransmission."},
+    {"Threads/MainCpu", "main-cpu", "CPU the main thread (sockets, commands, writer) is pinned to, -1 is any."},
+    {"Threads/ProcessingCpus", "processing-cpus", "Comma separated CPUs of the processing threads, one per instrument."},
+    {"Threads/ConsumerCpus", "consumer-cpus", "Comma separated CPUs of the consumer threads, one per instrument."},
+    {"Threads/RealtimePriority", "realtime-priority", "SCHED_FIFO priority of the worker threads (1-99), 0 is off."},
+    {"Threads/LockMemory", "lock-memory", "true to lock the process memory into RAM."},
+    {"Threads/DecodeThreads", "decode-threads", "Threads decoding each datagram batch per instrument, 0 shares the cores."},
+    {"Acquisition/Configuration", "configuration", "Configuration command (D...J...), not sent if empty."},
+    {"Acquisition/SensingSequence", "sensing", "Sensing sequence (S,...), not sent if empty."},
+    {"Acquisition/ExcitationSequence", "excitation", "Excitation sequence (E,...), not sent if empty."},
+    {"Acquisition/Frequencies", "frequencies", "Comma separated frequencies in Hz, not sent if empty."},
+    {"Acquisition/SavePath", "save", "Measurement file, nothing is saved if empty."},
+    {"Acquisition/Frames", "frames", "Frames saved per frequency, 0 saves until stopped."},
+    {"Acquisition/Overwrite", "overwrite", "true to overwrite existing measurement files."},
+    {"Acquisition/DerivedColumns", "derived-columns", "true to save magnitude/phase/normalised columns."},
+    {"Acquisition/MetricsPort", "metrics-port", "Localhost metrics endpoint port, 0 is off."},
+    {"Acquisition/SharedMemory", "shared-memory", "Name of the shared-memory frame ring, off if empty."},
+    {"Acquisition/StreamPort", "stream-port", "Localhost TCP port of the frame stream, 0 is off."},
+    {"Acquisition/StreamSocket", "stream-socket", "Local socket name of the frame stream, off if empty."},
+    {"Acquisition/StatusInterval", "status-interval", "Seconds between status lines."},
+    {"Acquisition/RequireAck", "require-ack", "true to exit instead of saving when a command is not acknowledged."},
+    {"Acquisition/ReorderDepth", "reorder-depth", "Records held to restore out-of-order datagrams, 0 is off."},
+    {"Acquisition/ReorderTimeout", "reorder-timeout", "Milliseconds a held record waits for the records before it."}
+};
+
+//keys of [Network] and [Instrument<n>] that make an InstrumentEndpoint
+static const char *const endpointKeys[] = {"LocalAddress", "MessagePort", "DataPort", "InstrumentAddress", "InstrumentPort"};
+
+static bool toPort(const QString &value, quint16 &port)
+{
+    bool ok = false;
+    const uint number = value.toUInt(&ok);
+    if (ok && number <= 65535)
+        port = static_cast<quint16>(number);
+    return ok && number <= 65535;
+}
+
+//name is one of endpointKeys, endpoint is left unchanged if the value is invalid
+static bool setEndpointValue(InstrumentEndpoint &endpoint, const QString &name, const QString &text)
+{
+    if (name == "LocalAddress" || name == "InstrumentAddress") {
+        QHostAddress address;
+        if (!address.setAddress(text))
+            return false;
+        (name == "LocalAddress" ? endpoint.localAddress : endpoint.instrumentAddress) = address;
+        return true;
+    }
+    if (name == "MessagePort")
+        return toPort(text, endpoint.messagePort);
+    if (name == "DataPort")
+        return toPort(text, endpoint.dataPort);
+    if (name == "InstrumentPort")
+        return toPort(text, endpoint.instrumentPort);
+    return false;
+}
+
+//comma separated CPU numbers, empty clears the list
+static bool toCpuList(const QString &text, QVector<int> &cpus)
+{
+    QVector<int> values;
+    const QStringList parts = text.split(',', Qt::SkipEmptyParts);
+    for (const QString &part : parts) {
+        bool ok = false;
+        values.append(part.trimmed().toInt(&ok));
+        if (!ok || values.last() < 0)
+            return false;
+    }
+    cpus = values;
+    return true;
+}
+
+static bool toBool(const QString &value, bool &flag)
+{
+    const QString lower = value.toLower();
+    if (lower == "true" || lower == "1" || lower == "yes")
+        flag = true;
+    else if (lower == "false" || lower == "0" || lower == "no")
+        flag = false;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief AcquisitionConfig::setValue
+ * Parses one value, the config is left unchanged if it is invalid
+ */
+bool AcquisitionConfig::setValue(const QString &key, const QString &value, QString *error)
+{
+    const QString text = value.trimmed();
+    bool ok = true;
+    if (key == "Network/Instruments") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 1 && number <= maxInstruments;
+        if (ok)
+            instruments = number;
+    } else if (key == "Network/CommandAttempts") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 1 && number <= CommandChannel::maxAttempts;
+        if (ok)
+            commandAttempts = number;
+    } else if (key.startsWith("Network/")) {
+        InstrumentEndpoint network = endpoint(0);
+        ok = setEndpointValue(network, key.section('/', 1), text);
+        if (ok) {
+            localAddress = network.localAddress;
+            messagePort = network.messagePort;
+            dataPort = network.dataPort;
+            instrumentAddress = network.instrumentAddress;
+            instrumentPort = network.instrumentPort;
+        }
+    } else if (key == "Threads/MainCpu") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= -1;
+        if (ok)
+            mainCpu = number;
+    } else if (key == "Threads/ProcessingCpus") {
+        ok = toCpuList(text, processingCpus);
+    } else if (key == "Threads/ConsumerCpus") {
+        ok = toCpuList(text, consumerCpus);
+    } else if (key == "Threads/RealtimePriority") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 0 && number <= 99;
+        if (ok)
+            realtimePriority = number;
+    } else if (key == "Threads/LockMemory") {
+        ok = toBool(text, lockMemory);
+    } else if (key == "Threads/DecodeThreads") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 0;
+        if (ok)
+            decodeThreads = number;
+    } else if (key == "Acquisition/Configuration") {
+        configurationCommand = text;
+    } else if (key == "Acquisition/SensingSequence") {
+        sensingSequence = text;
+    } else if (key == "Acquisition/ExcitationSequence") {
+        excitationSequence = text;
+    } else if (key == "Acquisition/Frequencies") {
+        QVector<double> values;
+        const QStringList parts = text.split(',', Qt::SkipEmptyParts);
+        for (const QString &part : parts) {
+            values.append(part.trimmed().toDouble(&ok));
+            if (!ok)
+                break;
+        }
+        ok = ok && values.size() <= FrequencyTable::maxEntries;
+        if (ok)
+            frequencies = values;
+    } else if (key == "Acquisition/SavePath") {
+        savePath = text;
+    } else if (key == "Acquisition/Frames") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 0;
+        if (ok)
+            frames = number;
+    } else if (key == "Acquisition/Overwrite") {
+        ok = toBool(text, overwrite);
+    } else if (key == "Acquisition/DerivedColumns") {
+        ok = toBool(text, derivedColumns);
+    } else if (key == "Acquisition/MetricsPort") {
+        ok = toPort(text, metricsPort);
+    } else if (key == "Acquisition/SharedMemory") {
+        sharedMemoryName = text;
+    } else if (key == "Acquisition/StreamPort") {
+        ok = toPort(text, streamPort);
+    } else if (key == "Acquisition/StreamSocket") {
+        streamSocketName = text;
+    } else if (key == "Acquisition/StatusInterval") {
+        const int number = text.toInt(&ok);
+        ok = ok && number > 0;
+        if (ok)
+            statusIntervalS = number;
+    } else if (key == "Acquisition/RequireAck") {
+        ok = toBool(text, requireAck);
+    } else if (key == "Acquisition/ReorderDepth") {
+        const int number = text.toInt(&ok);
+        ok = ok && number >= 0 && number <= ReorderBuffer::maxDepth;
+        if (ok)
+            reorderDepth = number;
+    } else if (key == "Acquisition/ReorderTimeout") {
+        const int number = text.toInt(&ok);
+        ok = ok && number > 0;
+        if (ok)
+            reorderTimeoutMs = number;
+    } else {
+        ok = false;
+    }
+
+    if (!ok && error)
+        *error = QString("Invalid value for %1: '%2'").arg(key, text);
+    return ok;
+}
+
+/**
+ * @brief AcquisitionConfig::load
+ * [Network] keys are written with the current values when missing, so the file lists what can be changed.
+ * List values (frequencies, sequences) are read as written, QSettings would split them at the commas.
+ * Every key is read into a copy first, an invalid one leaves the config entirely unchanged
+ */
+bool AcquisitionConfig::load(const QString &path, QString *error)
+{
+    AcquisitionConfig loaded = *this;
+    loaded.filePath = path;
+    QSettings settings(path, QSettings::IniFormat);
+    if (!settings.contains("Network/LocalAddress")) {
+        settings.setValue("Network/LocalAddress", localAddress.toString());
+        settings.setValue("Network/MessagePort", messagePort);
+        settings.setValue("Network/DataPort", dataPort);
+        settings.setValue("Network/InstrumentAddress", instrumentAddress.toString());
+        settings.setValue("Network/InstrumentPort", instrumentPort);
+    }
+
+    for (const ConfigKey &configKey : configKeys) {
+        if (!settings.contains(configKey.key))
+            continue;
+        const QVariant value = settings.value(configKey.key);
+        const QString text = value.userType() == QMetaType::QStringList ? value.toStringList().join(',') : value.toString();
+        if (!loaded.setValue(configKey.key, text, error))
+            return false;
+    }
+
+    loaded.instrumentSections.clear();
+    for (int index = 1; index < maxInstruments; ++index) {
+        const QString section = QString("Instrument%1/").arg(index + 1);
+        InstrumentEndpoint sectionEndpoint = loaded.endpoint(index);
+        bool found = false;
+        for (const char *name : endpointKeys) {
+            if (!settings.contains(section + name))
+                continue;
+            found = true;
+            const QString text = settings.value(section + name).toString().trimmed();
+            if (!setEndpointValue(sectionEndpoint, name, text)) {
+                if (error)
+                    *error = QString("Invalid value for %1: '%2'").arg(section + name, text);
+                return false;
+            }
+        }
+        if (found)
+            loaded.instrumentSections.insert(index, sectionEndpoint);
+    }
+    *this = loaded;
+    return true;
+}
+
+/**
+ * @brief AcquisitionConfig::endpoint
+ * Instruments without a section of their own repeat [Network] on local ports 10 higher per instrument,
+ * enough to bind several sessions on one workstation without editing the file
+ */
+InstrumentEndpoint AcquisitionConfig::endpoint(int index) const
+{
+    if (index > 0 && instrumentSections.contains(index))
+        return instrumentSections.value(index);
+    const quint16 shift = static_cast<quint16>(10 * index);
+    return {localAddress, static_cast<quint16>(messagePort + shift), static_cast<quint16>(dataPort + shift),
+            instrumentAddress, instrumentPort};
+}
+
+/**
+ * @brief AcquisitionConfig::decodeThreadsPerInstrument
+ * Each session has its own decoder pool, by default they split the cores instead of oversubscribing them
+ */
+int AcquisitionConfig::decodeThreadsPerInstrument() const
+{
+    if (decodeThreads > 0)
+        return decodeThreads;
+    return qMax(1, QThread::idealThreadCount() / qMax(1, instruments));
+}
+
+/**
+ * @brief AcquisitionConfig::apply
+ * parser must have been set up with commandLineOptions()
+ */
+bool AcquisitionConfig::apply(const QCommandLineParser &parser, QString *error)
+{
+    for (const ConfigKey &configKey : configKeys) {
+        if (parser.isSet(configKey.option) && !setValue(configKey.key, parser.value(configKey.option), error))
+            return false;
+    }
+    return true;
+}
+
+QList<QCommandLineOption> AcquisitionConfig::commandLineOptions()
+{
+    QList<QCommandLineOption> options;
+    for (const ConfigKey &configKey : configKeys)
+        options << QCommandLineOption(configKey.option, configKey.description, "value");
+    return options;
+}
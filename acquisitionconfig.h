@@ -0,0 +1,124 @@
+#ifndef ACQUISITIONCONFIG_H
+#define ACQUISITIONCONFIG_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QMap>
+#include <QHostAddress>
+#include <QCommandLineOption>
+
+class QCommandLineParser;
+
+//local sockets of one instrument and where its commands go
+struct InstrumentEndpoint {
+    QHostAddress localAddress;
+    quint16 messagePort;
+    quint16 dataPort;
+    QHostAddress instrumentAddress;
+    quint16 instrumentPort;
+};
+
+/**
+ * @brief The AcquisitionConfig class
+ *
+ * Addresses and acquisition session settings, read from the INI configuration file
+ * (EMT_IP.ini next to the executable unless another file is given) and, for the headless daemon,
+ * overridden by command line options (--local-address, --sensing, --save, --frames, ..., see --help).
+ * [Network], [Instrument<n>] and [Threads] are used by the GUI as well, [Network] is written with the
+ * defaults below when missing, [Acquisition] is only used by the daemon:
+ *
+ *      [Network]
+ *      LocalAddress=192.168.1.2        both sockets bind here
+ *      MessagePort=4593                instrument messages and acknowledgements
+ *      DataPort=4592                   instrument data, commands are sent from this port
+ *      InstrumentAddress=192.168.1.10
+ *      InstrumentPort=4590
+ *      Instruments=1                   instruments acquired at once, one InstrumentSession each
+ *      CommandAttempts=1               transmissions of an unacknowledged command, 1 = no retransmission
+ *
+ *      [Instrument2]                   same keys as [Network] for the second instrument, and so on.
+ *      InstrumentAddress=192.168.1.11  Missing keys are taken from [Network], with the local
+ *                                      ports moved up by 10 per instrument (4603/4602 here)
+ *
+ *      [Threads]                       best effort (ThreadTuning), refusals are logged and ignored
+ *      MainCpu=0                       CPU of the main thread (sockets, commands, writer), -1 = any
+ *      ProcessingCpus=2,4              CPU of processingDataThread, one entry per instrument, empty = any
+ *      ConsumerCpus=3,5                CPU of dataConsumerThread, one entry per instrument, empty = any
+ *      RealtimePriority=0              SCHED_FIFO priority of both worker threads (1..99, time critical on Windows), 0 = off
+ *      LockMemory=false                mlock (VirtualLock on Windows) the process memory (frame buffers, queues, ring)
+ *      DecodeThreads=0                 threads decoding each datagram batch, per instrument, 0 = cores / instruments
+ *
+ *      [Acquisition]
+ *      Configuration=D1C64G3H3P10I1S0J10   not sent if empty
+ *      SensingSequence=S,2,3,...,16.       sequences are not sent if empty
+ *      ExcitationSequence=E,1,1,...,15.
+ *      Frequencies=1000,2000               not sent if empty
+ *      SavePath=/data/run.csv              nothing saved if empty
+ *      Frames=100                          frames per frequency, 0 = save until stopped
+ *      Overwrite=false
+ *      DerivedColumns=false                magnitude/phase/normalised columns
+ *      MetricsPort=0                       localhost metrics endpoint, 0 = off
+ *      SharedMemory=emt_frames             shared-memory frame ring (emtframering.h), empty = off
+ *      StreamPort=9200                     localhost TCP frame stream (FrameStreamServer), 0 = off
+ *      StreamSocket=emt_stream             local socket frame stream, empty = off
+ *      StatusInterval=5                    seconds between status lines
+ *      RequireAck=false                    exit with 1 instead of saving when a command is not acknowledged
+ *      ReorderDepth=64                     records held to restore out-of-order datagrams, 0 = off
+ *      ReorderTimeout=5                    ms a held record waits for the records before it
+ */
+
+class AcquisitionConfig
+{
+public:
+    static const int maxInstruments = 8;
+
+    QString filePath;                                           //file given to load(), also holds [FrequencyTable]
+
+    //[Network]
+    QHostAddress localAddress{QStringLiteral("192.168.1.2")};
+    quint16 messagePort = 4593;
+    quint16 dataPort = 4592;
+    QHostAddress instrumentAddress{QStringLiteral("192.168.1.10")};
+    quint16 instrumentPort = 4590;
+    int instruments = 1;
+    int commandAttempts = 1;                                    //CommandChannel::setAttempts of every session
+    QMap<int, InstrumentEndpoint> instrumentSections;          //[Instrument<n>] sections found by load(), by 0-based index
+
+    //[Threads]
+    int mainCpu = -1;
+    QVector<int> processingCpus;                                //by instrument, missing entries are not pinned
+    QVector<int> consumerCpus;
+    int realtimePriority = 0;
+    bool lockMemory = false;
+    int decodeThreads = 0;                                      //0 shares the cores between the instruments
+
+    //[Acquisition]
+    QString configurationCommand;
+    QString sensingSequence;
+    QString excitationSequence;
+    QVector<double> frequencies;
+    QString savePath;
+    int frames = 0;
+    bool overwrite = false;
+    bool derivedColumns = false;
+    quint16 metricsPort = 0;
+    QString sharedMemoryName;
+    quint16 streamPort = 0;
+    QString streamSocketName;
+    int statusIntervalS = 5;
+    bool requireAck = false;
+    int reorderDepth = 64;
+    int reorderTimeoutMs = 5;
+
+    bool load(const QString &path, QString *error = nullptr);          //missing keys keep their values, nothing changes if a key is invalid
+    bool apply(const QCommandLineParser &parser, QString *error = nullptr);   //options that were given override the file
+    bool setValue(const QString &key, const QString &value, QString *error = nullptr);  //key as in the file, e.g. "Network/DataPort"
+
+    InstrumentEndpoint endpoint(int index) const;               //0 = [Network], n = [Instrument<n+1>]
+    int decodeThreadsPerInstrument() const;                     //DecodeThreads, or the cores shared between instruments if 0
+
+    static QList<QCommandLineOption> commandLineOptions();     //--local-address, --frames, ... one per key
+};
+
+#endif // ACQUISITIONCONFIG_H
@@ -0,0 +1,394 @@
+#include "acquisitiondaemon.h"
+#include "instrumentsession.h"
+#include "dataconsumer.h"
+#include "processingdata.h"
+#include "pipelinemetrics.h"
+#include "metricsserver.h"
+#include "commandchannel.h"
+#include "frequencytable.h"
+#include "measurementfile.h"
+#include "coilsequence.h"
+#include "sharedframering.h"
+#include "framestreamserver.h"
+#include "threadtuning.h"
+
+#include <QThread>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTextStream>
+#include <QDateTime>
+#include <QMetaObject>
+
+AcquisitionDaemon::AcquisitionDaemon(const AcquisitionConfig &config, QObject *parent)
+    : QObject{parent}
+    , m_config(config)
+{
+}
+
+/**
+ * @brief AcquisitionDaemon::~AcquisitionDaemon
+ * Same shutdown order as MainWindow: sessions first, then the stages they fed,
+ * the open measurement files are flushed last
+ */
+AcquisitionDaemon::~AcquisitionDaemon()
+{
+    for (InstrumentSession *session : qAsConst(m_sessions))
+        session->stop();
+    if (m_metricsServerThread) {
+        m_metricsServerThread->quit();
+        m_metricsServerThread->wait();
+    }
+    if (m_streamServerThread) {
+        m_streamServerThread->quit();
+        m_streamServerThread->wait();
+    }
+    closeFiles();
+    qDeleteAll(m_sessions);
+}
+
+void AcquisitionDaemon::log(const QString &message)
+{
+    QTextStream out(stdout);
+    out << QDateTime::currentDateTime().toString(Qt::ISODateWithMs) << " " << message << "\n";
+    out.flush();
+}
+
+QString AcquisitionDaemon::prefix(int instrument) const
+{
+    return m_sessions.size() > 1 ? m_sessions.at(instrument)->name() + ": " : QString();
+}
+
+/**
+ * @brief AcquisitionDaemon::start
+ * Returns false, with the reason logged, if the sequences are invalid or a socket cannot be bound
+ */
+bool AcquisitionDaemon::start()
+{
+    if (!m_config.sensingSequence.isEmpty() || !m_config.excitationSequence.isEmpty()) {
+        QString errorString;
+        if (CoilSequence::fromText(m_config.sensingSequence, m_config.excitationSequence, &errorString).isEmpty()) {
+            log("Invalid sequences: " + errorString);
+            return false;
+        }
+    }
+
+    QThread::currentThread()->setObjectName("mainThread");
+    for (int i = 0; i < m_config.instruments; ++i) {
+        InstrumentSession *session = new InstrumentSession(i, m_config.endpoint(i));
+        session->setThreadTuning({m_config.processingCpus.value(i, -1), m_config.realtimePriority},
+                                 {m_config.consumerCpus.value(i, -1), m_config.realtimePriority});
+        session->setDecodeThreads(m_config.decodeThreadsPerInstrument());
+        session->commandChannel()->setAttempts(m_config.commandAttempts);
+        m_sessions.append(session);
+    }
+
+    QVector<PipelineMetrics *> metrics;
+    for (InstrumentSession *session : qAsConst(m_sessions)) {
+        const int instrument = session->index();
+        const InstrumentEndpoint &endpoint = session->endpoint();
+        QString error;
+        if (!session->bind(&error)) {
+            log(prefix(instrument) + error);
+            return false;
+        }
+        log(QString("%1Sockets bound to %2, messages on port %3, data on port %4, instrument %5:%6").arg(prefix(instrument))
+            .arg(endpoint.localAddress.toString()).arg(endpoint.messagePort).arg(endpoint.dataPort)
+            .arg(endpoint.instrumentAddress.toString()).arg(endpoint.instrumentPort));
+        metrics.append(session->metrics());
+
+        connect(session, &InstrumentSession::messageReceived, this, [this](const int &instrument, const QString &message){
+            log(prefix(instrument) + message);
+        });
+        connect(session, &InstrumentSession::threadTuned, this, [this](const int &instrument, const QString &report){
+            log(prefix(instrument) + report);
+        });
+        CommandChannel *commandChannel = session->commandChannel();
+        connect(commandChannel, &CommandChannel::acknowledged, this, [this, instrument](const int &id, const QString &description, const qint64 &rttUs, const int &attempts){
+            Q_UNUSED(id);
+            log(QString("%1Instrument applied %2 (%3 ms, attempt %4)").arg(prefix(instrument), description).arg(rttUs / 1000.0, 0, 'f', 1).arg(attempts));
+        });
+        connect(commandChannel, &CommandChannel::failed, this, [this, instrument](const int &id, const QString &description, const int &attempts){
+            Q_UNUSED(id);
+            log(QString("%1Warning: no acknowledgement for %2 after %3 attempt(s)").arg(prefix(instrument), description).arg(attempts));
+            m_commandFailed = true;
+        });
+        connect(commandChannel, &CommandChannel::idle, this, [this, instrument](const int &commands, const qint64 &elapsedMs){
+            log(QString("%1Setup done: %2 command(s) in %3 ms").arg(prefix(instrument)).arg(commands).arg(elapsedMs));
+            if (++m_sessionsConfigured < m_sessions.size())
+                return;
+            if (m_commandFailed && m_config.requireAck) {
+                log("Not saving: RequireAck is set and a command was not acknowledged");
+                emit finished(1);
+                return;
+            }
+            if (m_commandFailed)
+                log("Saving although a command was not acknowledged, the instrument may not echo commands");
+            startSaving();
+        });
+
+        DataConsumer *dataConsumer = session->dataConsumer();
+        connect(session, &InstrumentSession::frameReady, this, &AcquisitionDaemon::onFrameReady);
+        connect(dataConsumer, &DataConsumer::lockStateUpdated, this, [this, instrument](const int &lockState, const qint64 &lockLosses){
+            static const char *const lockStateNames[] = {"SEARCHING", "VERIFYING", "LOCKED"};
+            log(QString("%1Frame lock %2 (lost %3 times)").arg(prefix(instrument)).arg(lockStateNames[qBound(0, lockState, 2)]).arg(lockLosses));
+        });
+        connect(dataConsumer, &DataConsumer::referenceStatus, this, [this, instrument](const QString &message){
+            log(prefix(instrument) + message);
+        });
+        dataConsumer->m_impedanceEnabled.storeRelease(m_config.derivedColumns);
+        session->processingData()->m_reorderDepth.storeRelaxed(m_config.reorderDepth);
+        session->processingData()->m_reorderTimeoutMs.storeRelaxed(m_config.reorderTimeoutMs);
+    }
+
+    //stages after the sessions are shared, frames of every session are handed over on its own dataConsumerThread
+    if (!m_config.sharedMemoryName.isEmpty()) {
+        QString error;
+        m_sharedFrameRing = new SharedFrameRing(metrics.first(), this);
+        if (!m_sharedFrameRing->open(m_config.sharedMemoryName, SharedFrameRing::defaultSlots, &error)) {
+            log(error);
+            return false;
+        }
+        for (InstrumentSession *session : qAsConst(m_sessions)) {
+            SharedFrameRing *ring = m_sharedFrameRing;
+            const int instrument = session->index();
+            connect(session->dataConsumer(), &DataConsumer::processedChunkResult, ring, [ring, instrument](const QVector<QVector<double>> &frame){
+                ring->publish(frame, instrument);
+            }, Qt::DirectConnection);
+        }
+        log(QString("Publishing frames to shared memory '%1'").arg(m_config.sharedMemoryName));
+    }
+
+    if (m_config.metricsPort > 0) {
+        m_metricsServer = new MetricsServer(metrics);
+        m_metricsServerThread = new QThread(this);
+        m_metricsServerThread->setObjectName("metricsServerThread");
+        m_metricsServer->moveToThread(m_metricsServerThread);
+        connect(m_metricsServerThread, &QThread::finished, m_metricsServer, &QObject::deleteLater);
+        connect(m_metricsServer, &MetricsServer::statusChanged, this, &AcquisitionDaemon::log);
+        m_metricsServerThread->start();
+        MetricsServer *server = m_metricsServer;
+        const quint16 port = m_config.metricsPort;
+        QMetaObject::invokeMethod(m_metricsServer, [server, port](){ server->start(port); }, Qt::QueuedConnection);
+    }
+
+    if (m_config.streamPort > 0 || !m_config.streamSocketName.isEmpty()) {
+        m_frameStreamServer = new FrameStreamServer(metrics.first());
+        m_streamServerThread = new QThread(this);
+        m_streamServerThread->setObjectName("streamServerThread");
+        m_frameStreamServer->moveToThread(m_streamServerThread);
+        connect(m_streamServerThread, &QThread::finished, m_frameStreamServer, &QObject::deleteLater);
+        for (InstrumentSession *session : qAsConst(m_sessions)) {
+            FrameStreamServer *server = m_frameStreamServer;
+            const int instrument = session->index();
+            connect(session->dataConsumer(), &DataConsumer::processedChunkResult, server, [server, instrument](const QVector<QVector<double>> &frame){
+                server->submitFrame(frame, instrument);
+            }, Qt::DirectConnection);
+        }
+        connect(m_frameStreamServer, &FrameStreamServer::statusChanged, this, &AcquisitionDaemon::log);
+        m_streamServerThread->start();
+        FrameStreamServer *server = m_frameStreamServer;
+        const quint16 port = m_config.streamPort;
+        const QString socketName = m_config.streamSocketName;
+        QMetaObject::invokeMethod(m_frameStreamServer, [server, port, socketName](){ server->start(port, socketName); }, Qt::QueuedConnection);
+    }
+
+    //[Threads]: the main thread is tuned here, the worker threads tune themselves as they start
+    if (m_config.mainCpu >= 0)
+        log(ThreadTuning::applyToCurrentThread({m_config.mainCpu, 0}));
+    if (m_config.lockMemory) {
+        bool locked = false;
+        log(ThreadTuning::lockMemory(&locked));
+        for (InstrumentSession *session : qAsConst(m_sessions))
+            session->metrics()->memoryLocked.storeRelaxed(locked ? 1 : 0);
+    }
+    for (InstrumentSession *session : qAsConst(m_sessions))
+        session->start();
+
+    connect(&m_statusTimer, &QTimer::timeout, this, &AcquisitionDaemon::logStatus);
+    m_statusTimer.start(m_config.statusIntervalS * 1000);
+
+    for (InstrumentSession *session : qAsConst(m_sessions))
+        sendCommands(session);
+    return true;
+}
+
+/**
+ * @brief AcquisitionDaemon::sendCommands
+ * Same commands and worker resets as the SEND buttons of the GUI, saving starts once every
+ * instrument acknowledged all of them (at once if there is nothing to send)
+ */
+void AcquisitionDaemon::sendCommands(InstrumentSession *session)
+{
+    CommandChannel *commandChannel = session->commandChannel();
+    int commands = 0;
+    if (!m_config.configurationCommand.isEmpty()) {
+        commandChannel->send(m_config.configurationCommand.toUtf8(), "configuration");
+        ++commands;
+    }
+
+    if (!m_config.sensingSequence.isEmpty() || !m_config.excitationSequence.isEmpty()) {
+        commandChannel->send(m_config.sensingSequence.toUtf8(), "sensing sequence");
+        commandChannel->send(m_config.excitationSequence.toUtf8(), "excitation sequence");
+        commands += 2;
+        session->setCoilSequence(CoilSequence::fromText(m_config.sensingSequence, m_config.excitationSequence));
+    }
+
+    if (!m_config.frequencies.isEmpty()) {
+        QString warning;
+        const QVector<quint16> phaseOffsets = FrequencyTable::loadPhaseOffsets(&warning, m_config.filePath);
+        if (!warning.isEmpty())
+            log(warning);
+        commandChannel->send(FrequencyTable::encode(m_config.frequencies, phaseOffsets), "frequency configuration");
+        ++commands;
+        session->resetFrequencies(m_config.frequencies.size());
+    }
+
+    if (commands == 0 && ++m_sessionsConfigured == m_sessions.size())
+        startSaving();
+}
+
+/**
+ * @brief AcquisitionDaemon::startSaving
+ * With a single frequency the files (one per instrument) are created here, so a refused file stops
+ * the daemon at once. Per-frequency files are created as their first frame arrives
+ */
+void AcquisitionDaemon::startSaving()
+{
+    if (m_saving)
+        return;
+    if (m_config.savePath.isEmpty()) {
+        log("No save path, acquiring without saving");
+        return;
+    }
+
+    QDir dir = QFileInfo(m_config.savePath).absoluteDir();
+    if (!dir.exists() && !dir.mkpath(".")) {
+        log("Could not create directory: " + dir.absolutePath());
+        emit finished(1);
+        return;
+    }
+    if (m_config.frequencies.size() <= 1) {
+        for (int i = 0; i < m_sessions.size(); ++i) {
+            if (!fileFor(i, 0)) {
+                emit finished(1);
+                return;
+            }
+        }
+    }
+
+    m_saving = true;
+    m_framesSaved.clear();
+    if (m_config.frames > 0)
+        log(QString("Saving %1 frame(s) per instrument and frequency to %2").arg(m_config.frames).arg(m_config.savePath));
+    else
+        log(QString("Saving to %1 until stopped").arg(m_config.savePath));
+}
+
+/**
+ * @brief AcquisitionDaemon::filePathFor
+ * SavePath itself for one instrument and frequency, else tagged with _inst<n> and/or _<frequency>Hz
+ */
+QString AcquisitionDaemon::filePathFor(int instrument, qint64 frequency) const
+{
+    QString filePath = m_sessions.size() > 1 ? MeasurementFile::instrumentFilePath(m_config.savePath, instrument) : m_config.savePath;
+    return m_config.frequencies.size() > 1 ? MeasurementFile::frequencyFilePath(filePath, frequency) : filePath;
+}
+
+/**
+ * @brief AcquisitionDaemon::fileFor
+ * Files stay open for the whole session, a refused file is remembered as nullptr
+ */
+QFile *AcquisitionDaemon::fileFor(int instrument, qint64 frequency)
+{
+    const QString filePath = filePathFor(instrument, frequency);
+    if (m_files.contains(filePath))
+        return m_files.value(filePath);
+
+    QFile *file = new QFile(filePath);
+    if (!m_config.overwrite && file->exists()) {
+        log("File already exists and overwrite is not allowed, not saved: " + filePath);
+        delete file;
+        file = nullptr;
+    } else if (!file->open(QIODevice::WriteOnly | QIODevice::Text)) {
+        log("Could not create " + filePath + ": " + file->errorString());
+        delete file;
+        file = nullptr;
+    } else {
+        file->write(MeasurementFile::header(m_config.derivedColumns));
+    }
+    m_files.insert(filePath, file);
+    return file;
+}
+
+void AcquisitionDaemon::closeFiles()
+{
+    for (QFile *file : qAsConst(m_files))
+        delete file;            //flushes and closes
+    m_files.clear();
+}
+
+/**
+ * @brief AcquisitionDaemon::onFrameReady
+ * Common writer: each frame goes to the file of its instrument and frequency,
+ * saving ends when every instrument has Frames frames of every programmed frequency
+ */
+void AcquisitionDaemon::onFrameReady(const int &instrument, const QVector<QVector<double>> &frame)
+{
+    PipelineMetrics *metrics = m_sessions.at(instrument)->metrics();
+    metrics->writerBacklog.fetchAndAddRelaxed(-1);
+    if (!m_saving || frame[RowFrequency].isEmpty())
+        return;
+
+    const qint64 frequency = static_cast<qint64>(frame[RowFrequency].first());
+    int &savedFrames = m_framesSaved[filePathFor(instrument, frequency)];
+    if (m_config.frames > 0 && savedFrames >= m_config.frames)
+        return;
+
+    QFile *file = fileFor(instrument, frequency);
+    if (file) {
+        QTextStream out(file);
+        MeasurementFile::writeFrameRows(out, frame, MeasurementFile::rowCount(m_config.derivedColumns));
+        savedFrames++;
+        metrics->framesSaved.fetchAndAddRelaxed(1);
+    } else if (m_config.frames > 0) {
+        savedFrames = m_config.frames;  //refused file, do not wait for it
+    }
+    if (m_config.frames == 0)
+        return;
+
+    if (m_framesSaved.size() < m_sessions.size() * qMax(1, m_config.frequencies.size()))
+        return;
+    for (int saved : qAsConst(m_framesSaved)) {
+        if (saved < m_config.frames)
+            return;
+    }
+    m_saving = false;
+    closeFiles();
+    quint64 framesSaved = 0;
+    for (InstrumentSession *session : qAsConst(m_sessions))
+        framesSaved += session->metrics()->framesSaved.loadRelaxed();
+    log(QString("Saving done, %1 frame(s) in total").arg(framesSaved));
+    emit finished(0);
+}
+
+void AcquisitionDaemon::logStatus()
+{
+    static const char *const lockStateNames[] = {"SEARCHING", "VERIFYING", "LOCKED"};
+    for (InstrumentSession *session : qAsConst(m_sessions)) {
+        const PipelineMetrics *metrics = session->metrics();
+        log(QString("%1packets %2, records %3, frames %4 (%5 incomplete), saved %6, lost records %7, reordered %8, lock %9, buffer depth %10, reorder restored %11 flushed %12")
+            .arg(prefix(session->index()))
+            .arg(metrics->packetsReceived.loadRelaxed())
+            .arg(metrics->recordsDecoded.loadRelaxed())
+            .arg(metrics->framesProduced.loadRelaxed())
+            .arg(metrics->incompleteFrames.loadRelaxed())
+            .arg(metrics->framesSaved.loadRelaxed())
+            .arg(metrics->lostRecords.loadRelaxed())
+            .arg(metrics->reorderedRecords.loadRelaxed())
+            .arg(lockStateNames[qBound(0, metrics->lockState.loadRelaxed(), 2)])
+            .arg(metrics->sharedBufferDepth.loadRelaxed())
+            .arg(metrics->reorderRestored.loadRelaxed())
+            .arg(metrics->reorderFlushed.loadRelaxed()));
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef ACQUISITIONDAEMON_H
+#define ACQUISITIONDAEMON_H
+
+#include <QObject>
+#include <QVector>
+#include <QHash>
+#include <QTimer>
+#include "acquisitionconfig.h"
+
+class QThread;
+class QFile;
+class MetricsServer;
+class SharedFrameRing;
+class FrameStreamServer;
+class InstrumentSession;
+
+/**
+ * @brief The AcquisitionDaemon class
+ *
+ * Headless counterpart of MainWindow for machines without a display: one InstrumentSession
+ * (sockets, processingDataThread, dataConsumerThread) per configured instrument, with the common
+ * writer on the main thread. Sends the configured commands to every instrument, waits until all
+ * of them are acknowledged or timed out (a warning, fatal only with RequireAck), then saves Frames
+ * frames (per instrument and frequency) to SavePath and finishes, or keeps acquiring if Frames is 0.
+ * Everything is logged to stdout, no widget is created
+ */
+
+class AcquisitionDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit AcquisitionDaemon(const AcquisitionConfig &config, QObject *parent = nullptr);
+    ~AcquisitionDaemon();
+
+    bool start();                                   //binds sockets, starts the sessions and sends the commands
+
+signals:
+    void finished(const int &exitCode);             //saving done (0) or a file failed, or a command with RequireAck (1)
+
+private slots:
+    void onFrameReady(const int &instrument, const QVector<QVector<double>> &frame);
+    void logStatus();                               //one status line per instrument every StatusInterval seconds
+
+private:
+    void log(const QString &message);
+    QString prefix(int instrument) const;           //"instrument n: " with several instruments, else empty
+    void sendCommands(InstrumentSession *session);  //configuration, sequences and frequencies of the config
+    void startSaving();
+    QString filePathFor(int instrument, qint64 frequency) const;
+    QFile *fileFor(int instrument, qint64 frequency);   //open file of a frame, nullptr if it must not be saved
+    void closeFiles();
+
+    AcquisitionConfig m_config;
+
+    QVector<InstrumentSession *> m_sessions;        //one per instrument, index = instrument
+    int m_sessionsConfigured = 0;                   //sessions whose commands were all answered
+    MetricsServer *m_metricsServer = nullptr;
+    QThread *m_metricsServerThread = nullptr;
+    SharedFrameRing *m_sharedFrameRing = nullptr;   //frames for local reader processes, if configured
+    FrameStreamServer *m_frameStreamServer = nullptr;   //frames for local socket subscribers, if configured
+    QThread *m_streamServerThread = nullptr;
+
+    QTimer m_statusTimer;
+    bool m_commandFailed = false;                   //a command was never acknowledged
+    bool m_saving = false;                          //frames are written
+    QHash<QString, QFile *> m_files;                //open measurement files, by path (one per instrument and frequency)
+    QHash<QString, int> m_framesSaved;              //frames written per file
+};
+
+#endif // ACQUISITIONDAEMON_H
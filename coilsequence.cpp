@@ -0,0 +1,95 @@
+#include "coilsequence.h"
+#include <QStringList>
+
+namespace {
+
+//"S,2,3,4." -> {2,3,4}, returns false on any non-numeric or out of range entry
+bool parseCoilList(QString text, QChar prefix, QVector<int> &coils)
+{
+    text = text.trimmed();
+    if (text.startsWith(prefix, Qt::CaseInsensitive))
+        text.remove(0, 1);
+    if (text.endsWith('.'))
+        text.chop(1);
+
+    const QStringList entries = text.split(",", Qt::SkipEmptyParts);
+    for (const QString &entry : entries) {
+        bool ok = false;
+        int coil = entry.trimmed().toInt(&ok);
+        if (!ok || coil < 1 || coil > 16)
+            return false;
+        coils.append(coil);
+    }
+    return true;
+}
+
+} // namespace
+
+CoilSequence::CoilSequence()
+{
+    for (int s = 0; s < 16; ++s)
+        for (int e = 0; e < 16; ++e)
+            m_position[s][e] = -1;
+}
+
+/**
+ * @brief CoilSequence::default16Coils
+ * Every excitation coil E=1..15 paired with sensing coils S=E+1..16
+ */
+CoilSequence CoilSequence::default16Coils()
+{
+    CoilSequence sequence;
+    for (int e = 1; e <= 15; ++e)
+        for (int s = e + 1; s <= 16; ++s)
+            sequence.append(s, e);
+    return sequence;
+}
+
+/**
+ * @brief CoilSequence::default8Coils
+ * Odd coils only, excitation coil E=1..13 paired with sensing coils S=E+2..15
+ */
+CoilSequence CoilSequence::default8Coils()
+{
+    CoilSequence sequence;
+    for (int e = 1; e <= 13; e += 2)
+        for (int s = e + 2; s <= 15; s += 2)
+            sequence.append(s, e);
+    return sequence;
+}
+
+/**
+ * @brief CoilSequence::fromText
+ * Builds the sequence from the sensing/excitation sequence controls.
+ * Returns an empty sequence (and sets errorString) if the two lists cannot be paired up
+ */
+CoilSequence CoilSequence::fromText(const QString &sensingText, const QString &excitationText, QString *errorString)
+{
+    QVector<int> sensing;
+    QVector<int> excitation;
+    if (!parseCoilList(sensingText, 'S', sensing) || !parseCoilList(excitationText, 'E', excitation)) {
+        if (errorString)
+            *errorString = "coil numbers must be between 1 and 16";
+        return CoilSequence();
+    }
+    if (sensing.isEmpty() || sensing.size() != excitation.size()) {
+        if (errorString)
+            *errorString = QString("sensing (%1) and excitation (%2) sequences differ in length")
+                               .arg(sensing.size()).arg(excitation.size());
+        return CoilSequence();
+    }
+
+    CoilSequence sequence;
+    for (int i = 0; i < sensing.size(); ++i)
+        sequence.append(sensing.at(i), excitation.at(i));
+    return sequence;
+}
+
+void CoilSequence::append(int sensingCoil, int excitationCoil)
+{
+    int &position = m_position[sensingCoil & 0xF][excitationCoil & 0xF];   //coil 16 arrives as nibble 0
+    if (position < 0)
+        position = m_sensing.size();
+    m_sensing.append(sensingCoil);
+    m_excitation.append(excitationCoil);
+}
@@ -0,0 +1,43 @@
+#ifndef COILSEQUENCE_H
+#define COILSEQUENCE_H
+
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief The CoilSequence class
+ *
+ * Programmed sensing/excitation sequence of the instrument, as sent with SEND SENSING/SEND EXCITATION
+ * ("S,2,3,...,16." and "E,1,1,...,15.").
+ * Keeps the ordered list of (S,E) pairs and a 16x16 lookup table giving the position of a pair
+ * in the sequence, so the coil fields of a record can be placed in O(1).
+ * Coils are stored as they arrive in records: a single hex digit, where 0 stands for coil 16
+ */
+
+class CoilSequence
+{
+public:
+    CoilSequence();                                         //empty sequence
+
+    static CoilSequence default16Coils();                   //120-step sequence, same as UPDATE with 16 coils
+    static CoilSequence default8Coils();                    //28-step sequence, same as UPDATE with 8 coils
+    static CoilSequence fromText(const QString &sensingText, const QString &excitationText, QString *errorString = nullptr);
+
+    int size() const { return m_sensing.size(); }           //number of steps in the sequence
+    bool isEmpty() const { return m_sensing.isEmpty(); }
+    int sensingAt(int position) const { return m_sensing.at(position); }        //coil number 1-16
+    int excitationAt(int position) const { return m_excitation.at(position); }  //coil number 1-16
+    int positionOf(int sensingNibble, int excitationNibble) const               //-1 if pair is not part of the sequence
+    {
+        return m_position[sensingNibble & 0xF][excitationNibble & 0xF];
+    }
+
+private:
+    void append(int sensingCoil, int excitationCoil);
+
+    QVector<int> m_sensing;                                 //sensing coil of each step
+    QVector<int> m_excitation;                              //excitation coil of each step
+    int m_position[16][16];                                 //[S nibble][E nibble] -> step, or -1
+};
+
+#endif // COILSEQUENCE_H
@@ -0,0 +1,160 @@
+#include "commandchannel.h"
+#include <QUdpSocket>
+#include <QDebug>
+
+CommandChannel::CommandChannel(QUdpSocket *socket, PipelineMetrics *metrics, QObject *parent)
+    : QObject{parent}
+    , m_socket(socket)
+    , m_metrics(metrics)
+{
+    m_clock.start();
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, &QTimer::timeout, this, &CommandChannel::onTimeout);
+}
+
+void CommandChannel::setDestination(const QHostAddress &address, quint16 port)
+{
+    m_address = address;
+    m_port = port;
+}
+
+void CommandChannel::setAttempts(int attempts)
+{
+    m_attempts = qBound(1, attempts, int(maxAttempts));
+}
+
+int CommandChannel::send(const QByteArray &command, const QString &description)
+{
+    if (pending() == 0) {
+        m_burstStartUs = m_clock.nsecsElapsed() / 1000;
+        m_burstCommands = 0;
+    }
+    ++m_burstCommands;
+
+    Command entry;
+    entry.id = m_nextId++;
+    entry.data = command;
+    entry.description = description;
+    m_queued.append(entry);
+    fillWindow();
+    return entry.id;
+}
+
+void CommandChannel::transmit(Command &command)
+{
+    ++command.attempts;
+    command.sentUs = m_clock.nsecsElapsed() / 1000;
+    //each retransmission doubles the timeout of this command
+    command.deadlineUs = command.sentUs + (m_timeoutUs << (command.attempts - 1));
+    if (command.attempts > 1)
+        m_metrics->commandRetries.fetchAndAddRelaxed(1);
+    else
+        m_metrics->commandsSent.fetchAndAddRelaxed(1);
+    if (m_socket->writeDatagram(command.data, m_address, m_port) == -1)
+        qDebug() << "Failed to send" << command.description << "to port" << m_port << ":" << m_socket->errorString();
+}
+
+void CommandChannel::fillWindow()
+{
+    while (m_inFlight.size() < maxInFlight && !m_queued.isEmpty()) {
+        m_inFlight.append(m_queued.takeFirst());
+        transmit(m_inFlight.last());
+    }
+    scheduleTimer();
+}
+
+void CommandChannel::scheduleTimer()
+{
+    if (m_inFlight.isEmpty()) {
+        m_timer.stop();
+        return;
+    }
+    qint64 earliestUs = m_inFlight.first().deadlineUs;
+    for (const Command &command : qAsConst(m_inFlight))
+        earliestUs = qMin(earliestUs, command.deadlineUs);
+    const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+    m_timer.start(int(qMax<qint64>(0, (earliestUs - nowUs + 999) / 1000)));
+}
+
+/**
+ * @brief CommandChannel::echoes
+ * The whole command, then the end of the message or whitespace, "S,1,2" does not echo "S,1,23"
+ */
+bool CommandChannel::echoes(const QByteArray &message, const QByteArray &command)
+{
+    if (command.isEmpty() || !message.startsWith(command))
+        return false;
+    return message.size() == command.size() || QChar::isSpace(uchar(message.at(command.size())));
+}
+
+/**
+ * @brief CommandChannel::onMessage
+ * Surrounding whitespace is ignored, an empty message or one echoing no command in flight
+ * acknowledges nothing
+ */
+bool CommandChannel::onMessage(const QByteArray &message)
+{
+    const QByteArray trimmed = message.trimmed();
+    if (trimmed.isEmpty())
+        return false;
+
+    for (int i = 0; i < m_inFlight.size(); ++i) {
+        if (!echoes(trimmed, m_inFlight.at(i).data.trimmed()))
+            continue;
+
+        const Command done = m_inFlight.takeAt(i);
+        const qint64 rttUs = m_clock.nsecsElapsed() / 1000 - done.sentUs;
+        if (done.attempts == 1)
+            updateRtt(rttUs);
+        emit acknowledged(done.id, done.description, rttUs, done.attempts);
+        fillWindow();
+        finishCommand();
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief CommandChannel::updateRtt
+ * RFC 6298: srtt += (r - srtt)/8, rttvar += (|srtt - r| - rttvar)/4, rto = srtt + 4 rttvar
+ */
+void CommandChannel::updateRtt(qint64 sampleUs)
+{
+    if (m_smoothedRttUs == 0) {
+        m_smoothedRttUs = sampleUs;
+        m_rttVariationUs = sampleUs / 2.0;
+    } else {
+        m_rttVariationUs += (qAbs(m_smoothedRttUs - sampleUs) - m_rttVariationUs) / 4.0;
+        m_smoothedRttUs += (sampleUs - m_smoothedRttUs) / 8.0;
+    }
+    m_timeoutUs = qBound<qint64>(minimumTimeoutMs * 1000, qint64(m_smoothedRttUs + 4 * m_rttVariationUs),
+                                 maximumTimeoutMs * 1000);
+    m_metrics->commandRttUs.storeRelaxed(qint64(m_smoothedRttUs));
+}
+
+void CommandChannel::onTimeout()
+{
+    const qint64 nowUs = m_clock.nsecsElapsed() / 1000;
+    for (int i = 0; i < m_inFlight.size();) {
+        Command &command = m_inFlight[i];
+        if (command.deadlineUs > nowUs) {
+            ++i;
+        } else if (command.attempts < m_attempts) {
+            transmit(command);
+            ++i;
+        } else {
+            const Command lost = m_inFlight.takeAt(i);
+            m_metrics->commandFailures.fetchAndAddRelaxed(1);
+            emit failed(lost.id, lost.description, lost.attempts);
+            finishCommand();
+        }
+    }
+    fillWindow();
+}
+
+void CommandChannel::finishCommand()
+{
+    if (pending() == 0)
+        emit idle(m_burstCommands, (m_clock.nsecsElapsed() / 1000 - m_burstStartUs) / 1000);
+}
@@ -0,0 +1,92 @@
+#ifndef COMMANDCHANNEL_H
+#define COMMANDCHANNEL_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QList>
+#include "pipelinemetrics.h"
+
+class QUdpSocket;
+
+/**
+ * @brief The CommandChannel class
+ *
+ * Sends instrument commands (D..., S,..., E,..., F ...) and tracks their acknowledgement.
+ * A message received on the message socket acknowledges the oldest command in flight it echoes
+ * in full (whitespace trimmed, optionally followed by whitespace and a status text), the reply format
+ * of the instrument is not documented so nothing shorter is taken as an acknowledgement.
+ * Up to maxInFlight commands are outstanding at once, the rest wait in order. A command not
+ * acknowledged within the timeout fails, retransmission is opt-in (setAttempts, CommandAttempts in
+ * EMT_IP.ini) so configuration commands are not replayed to the instrument on a missing echo.
+ * The timeout follows the measured round-trip time (RFC 6298 smoothing, samples of retransmitted
+ * commands are not used).
+ * Lives on the main thread with the sockets
+ */
+
+class CommandChannel : public QObject
+{
+    Q_OBJECT
+public:
+    static const int maxInFlight = 4;
+    static const int maxAttempts = 4;                       //highest setAttempts()
+    static const int initialTimeoutMs = 500;
+    static const int minimumTimeoutMs = 50;
+    static const int maximumTimeoutMs = 4000;
+
+    CommandChannel(QUdpSocket *socket, PipelineMetrics *metrics, QObject *parent = nullptr);
+
+    void setDestination(const QHostAddress &address, quint16 port);
+    void setAttempts(int attempts);                                     //transmissions per command, 1 = no retransmission
+    int attempts() const { return m_attempts; }
+    int send(const QByteArray &command, const QString &description);   //queues the command, returns its id
+    bool onMessage(const QByteArray &message);                          //true if the message acknowledged a command
+    int pending() const { return m_inFlight.size() + m_queued.size(); }
+    double smoothedRttMs() const { return m_smoothedRttUs / 1000.0; }
+
+signals:
+    void acknowledged(const int &id, const QString &description, const qint64 &rttUs, const int &attempts);
+    void failed(const int &id, const QString &description, const int &attempts);
+    void idle(const int &commands, const qint64 &elapsedMs);           //every command of a burst is done
+
+private:
+    struct Command {
+        int id;
+        QByteArray data;
+        QString description;
+        int attempts = 0;
+        qint64 sentUs = 0;                                      //time of the last transmission
+        qint64 deadlineUs = 0;                                  //retransmission due
+    };
+
+    void transmit(Command &command);
+    void fillWindow();                                          //moves queued commands in flight while there is room
+    void onTimeout();                                           //retransmits or fails overdue commands
+    void scheduleTimer();
+    void finishCommand();                                       //emits idle() after the last command of a burst
+    void updateRtt(qint64 sampleUs);
+    static bool echoes(const QByteArray &message, const QByteArray &command);
+
+    QUdpSocket *m_socket;
+    PipelineMetrics *m_metrics;
+    QHostAddress m_address;
+    quint16 m_port = 0;
+    int m_attempts = 1;
+
+    QList<Command> m_inFlight;                                  //in send order
+    QList<Command> m_queued;
+    int m_nextId = 1;
+
+    QElapsedTimer m_clock;
+    QTimer m_timer;                                             //fires at the earliest retransmission deadline
+    double m_smoothedRttUs = 0;                                 //0 until the first sample
+    double m_rttVariationUs = 0;
+    qint64 m_timeoutUs = initialTimeoutMs * 1000;
+
+    qint64 m_burstStartUs = 0;                                  //first command sent into an idle channel
+    int m_burstCommands = 0;
+};
+
+#endif // COMMANDCHANNEL_H
@@ -0,0 +1,68 @@
+#include "acquisitiondaemon.h"
+#include "frequencytable.h"
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTextStream>
+#include <QMetaType>
+#include <QVector>
+#include <QTimer>
+#include <csignal>
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void requestStop(int)
+{
+    stopRequested = 1;
+}
+
+/**
+ * @brief main
+ * Entry point of the headless daemon (EMT_IP_daemon.pro)
+ * Reads the configuration file and command line options, runs AcquisitionDaemon until saving is done
+ * or SIGINT/SIGTERM is received
+ */
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("EMT_IP_daemon");
+
+    //register 2D vector type so it can be used in queued connections for sharing resources between threads
+    qRegisterMetaType<QVector<QVector<double>>>("QVector<QVector<double>>");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless EMT acquisition: configures the instrument, saves frames and logs status to stdout.\n"
+                                     "Options override the keys of the configuration file.");
+    parser.addHelpOption();
+    QCommandLineOption configOption("config", "Configuration file, EMT_IP.ini next to the executable by default.", "file",
+                                    FrequencyTable::settingsFilePath());
+    parser.addOption(configOption);
+    parser.addOptions(AcquisitionConfig::commandLineOptions());
+    parser.process(a);
+
+    AcquisitionConfig config;
+    QString error;
+    if (!config.load(parser.value(configOption), &error) || !config.apply(parser, &error)) {
+        QTextStream(stderr) << error << "\n";
+        return 1;
+    }
+
+    AcquisitionDaemon daemon(config);
+    QObject::connect(&daemon, &AcquisitionDaemon::finished, &a, [](const int &exitCode){
+        QCoreApplication::exit(exitCode);
+    });
+    if (!daemon.start())
+        return 1;
+
+    //signal handlers may only set a flag, the event loop polls it
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    QTimer stopTimer;
+    QObject::connect(&stopTimer, &QTimer::timeout, &a, [](){
+        if (stopRequested)
+            QCoreApplication::exit(0);
+    });
+    stopTimer.start(200);
+
+    return a.exec();
+}
@@ -1,4 +1,5 @@
 #include "dataconsumer.h"
+#include "pipelinetrace.h"
 #include <QMutexLocker>
 #include <QDebug>
 #include <algorithm>
@@ -8,10 +9,14 @@
  * @brief DataConsumer::DataConsumer
  * Or dataConsumerThread in report,
 **/
-DataConsumer::DataConsumer(SharedBuffer *sharedBuffer, QObject *parent)
+DataConsumer::DataConsumer(SharedBuffer *sharedBuffer, PipelineMetrics *metrics, QObject *parent)
     : QObject{parent}
     , m_sharedBuffer(sharedBuffer)
+    , m_metrics(metrics)
     , m_stop(false)
+    , m_assemblers(FrequencyRouter::defaultFrequencies)
+    , m_impedanceStages(FrequencyRouter::defaultFrequencies)
+    , m_calibrations(FrequencyRouter::defaultFrequencies)
 {
 }
 
@@ -28,11 +33,83 @@ void DataConsumer::stop()
     m_sharedBuffer->dataAvailable.wakeAll();
 }
 
+/**
+ * @brief DataConsumer::setCoilSequence
+ * Called from the main thread when a sequence is sent, processBuffers never returns to the
+ * event loop so the sequence is handed over through a mutex and picked up before the next batch
+ */
+void DataConsumer::setCoilSequence(const CoilSequence &sequence)
+{
+    QMutexLocker locker(&m_sequenceMutex);
+    m_pendingSequence = sequence;
+    m_sequenceChanged.storeRelease(true);
+}
+
+/**
+ * @brief DataConsumer::captureReference
+ * Called from the main thread, the next 'frames' complete frames of every frequency are averaged
+ * into its reference, saved to filePath (if not empty) once every frequency is done
+ */
+void DataConsumer::captureReference(int frames, const QString &filePath)
+{
+    QMutexLocker locker(&m_referenceMutex);
+    m_pendingCaptureFrames = frames;
+    m_pendingReferencePath = filePath;
+    m_pendingLoad = false;
+    m_referenceRequested.storeRelease(true);
+}
+
+/**
+ * @brief DataConsumer::loadReference
+ * Called from the main thread, replaces the references of the frequencies stored in the file
+ */
+void DataConsumer::loadReference(const QString &filePath)
+{
+    QMutexLocker locker(&m_referenceMutex);
+    m_pendingCaptureFrames = 0;
+    m_pendingReferencePath = filePath;
+    m_pendingLoad = true;
+    m_referenceRequested.storeRelease(true);
+}
+
+/**
+ * @brief DataConsumer::resetFrequencies
+ * Called from the main thread when frequencies are sent, assemblers are claimed again by the new frequencies
+ */
+void DataConsumer::resetFrequencies(int frequencies)
+{
+    m_frequencyCount.storeRelaxed(frequencies);
+    m_frequenciesChanged.storeRelease(true);
+}
+
+/**
+ * @brief DataConsumer::resizeFrequencies
+ * Never below the default five, new assemblers take the sequence and reduction of the first one
+ */
+void DataConsumer::resizeFrequencies(int frequencies)
+{
+    const int count = qMax(int(FrequencyRouter::defaultFrequencies), frequencies);
+    const int previous = m_assemblers.size();
+    if (count == previous)
+        return;
+    const CoilSequence sequence = m_assemblers.first().sequence();
+    const OversampleReduction::Kernel reduction = m_assemblers.first().reduction();
+    m_assemblers.resize(count);
+    m_impedanceStages.resize(count);
+    m_calibrations.resize(count);
+    for (int i = previous; i < count; ++i) {
+        m_assemblers[i].setSequence(sequence);
+        m_assemblers[i].setReduction(reduction);
+    }
+    m_assemblerRouter.setCapacity(count);
+}
+
 /**
  * @brief DataConsumer::processBuffers
  * Processes data that is sent by the other worked thread (processingDataThread).
- * Builds global2DArray, which holds the final data format which can be saved.
- * Passes global2DArray back to the main thread for saving.
+ * Every sample is placed in its frame by the FrameAssembler lock, so frames start at the true
+ * sequence start without pressing SYNC, and re-lock by themselves after lost datagrams.
+ * Passes each finished frame (global2DArray format) back to the main thread for saving.
  */
 void DataConsumer::processBuffers()
 {
@@ -43,187 +120,265 @@ void DataConsumer::processBuffers()
             break;
         }
 
-        //otherwise resize buffers
+        //new sequence sent by the main thread, frame length follows it
+        if (m_sequenceChanged.fetchAndStoreAcquire(false)) {
+            QMutexLocker locker(&m_sequenceMutex);
+            for (FrameAssembler &assembler : m_assemblers)
+                assembler.setSequence(m_pendingSequence);
+        }
+
+        //SYNC button drops the lock and searches for the frame start again,
+        //so does a new frequency configuration
+        const bool frequenciesChanged = m_frequenciesChanged.fetchAndStoreAcquire(false);
+        if (frequenciesChanged) {
+            resizeFrequencies(m_frequencyCount.loadRelaxed());
+            m_assemblerRouter.reset();
+            for (ImpedanceStage &stage : m_impedanceStages)
+                stage.clearReference();
+            for (ReferenceCalibration &calibration : m_calibrations)
+                calibration.clear();
+            m_referenceCaptureActive = false;
+            m_statistics.reset();
+            //frames up to this one were assembled under the previous table (SweepCampaign ignores them)
+            m_metrics->frequencyResetFrame.storeRelaxed(m_metrics->framesProduced.loadRelaxed());
+            m_metrics->frequencyResets.fetchAndAddRelease(1);
+        }
+        if (m_referenceRequested.fetchAndStoreAcquire(false))
+            applyReferenceRequests();
+
+        //'SNR Packets' changed
+        const int statisticsWindow = m_statisticsWindow.loadRelaxed();
+        if (statisticsWindow != m_statistics.window())
+            m_statistics.setWindow(statisticsWindow);
+
+        //new reduction kernel, frames restart so none mixes two kernels
+        const auto reduction = static_cast<OversampleReduction::Kernel>(m_reductionKernel.loadRelaxed());
+        const bool reductionChanged = reduction != m_assemblers.first().reduction();
+        if (reductionChanged) {
+            for (FrameAssembler &assembler : m_assemblers)
+                assembler.setReduction(reduction);
+        }
+        if (m_syncEnabled.fetchAndStoreAcquire(false) || frequenciesChanged || reductionChanged) {
+            for (FrameAssembler &assembler : m_assemblers)
+                assembler.resync();
+        }
+
+        //wait for samples
         {
             //locks mutex
+            TRACE_SPAN("waitForSamples");
             QMutexLocker locker(&m_sharedBuffer -> mutex);
             if (m_stop)
                 break;
-            //if buffer is not filled to 480 size, do not read yet
-            while (m_sharedBuffer->bufferFinalFrequency.size() < chunkSize ||
-                   m_sharedBuffer->bufferDecimated1.size() < chunkSize ||
-                   m_sharedBuffer->bufferDecimated2.size() < chunkSize ||
-                   m_sharedBuffer->bufferFourthArrayDivided.size() < chunkSize ||
-                   m_sharedBuffer->bufferSixthArrayDivided.size() < chunkSize)
-            //if buffer not full, put thread on waiting for call
+            //if buffer is empty, put thread on waiting for call
+            while (m_sharedBuffer->bufferSampleFlags.isEmpty())
             {
                 m_sharedBuffer->dataAvailable.wait(&m_sharedBuffer->mutex, 100);
-                if (QThread::currentThread()->isInterruptionRequested())
+                if (QThread::currentThread()->isInterruptionRequested() || m_stop)
                     break;
             }
             if (m_stop)
                 break;
         }
 
-        //for data storage from queued containers
-        QList<qint64> freqBuffer;
-        QList<qint32> decimated1Buffer;
-        QList<qint32> decimated2Buffer;
-        QList<double> fourthArrayBuffer;
-        QList<double> sixthArrayBuffer;
+        TRACE_SPAN("processSamples");
 
         //fill in each buffer with corresponding data
         {
             //locks mutex for thread-safe communication
+            TRACE_SPAN("dequeueSamples");
             QMutexLocker locker(&m_sharedBuffer->mutex);
-            for (int i = 0; i < chunkSize; ++i) {
-                if (!m_sharedBuffer->bufferFinalFrequency.isEmpty())
-                    freqBuffer.append(m_sharedBuffer->bufferFinalFrequency.dequeue());              //Actual Frequency
-                if (!m_sharedBuffer->bufferDecimated1.isEmpty())
-                    decimated1Buffer.append(m_sharedBuffer->bufferDecimated1.dequeue());            //Sensing Coil
-                if (!m_sharedBuffer->bufferDecimated2.isEmpty())
-                    decimated2Buffer.append(m_sharedBuffer->bufferDecimated2.dequeue());            //Excitation Coil
-                if (!m_sharedBuffer->bufferFourthArrayDivided.isEmpty())
-                    fourthArrayBuffer.append(m_sharedBuffer->bufferFourthArrayDivided.dequeue());   //Real Data
-                if (!m_sharedBuffer->bufferSixthArrayDivided.isEmpty())
-                    sixthArrayBuffer.append(m_sharedBuffer->bufferSixthArrayDivided.dequeue());     //Imaginary Data
+            int count = qMin(maxBatchSize,
+                        qMin(m_sharedBuffer->bufferFinalFrequency.size(),
+                        qMin(m_sharedBuffer->bufferDecimated1.size(),
+                        qMin(m_sharedBuffer->bufferDecimated2.size(),
+                        qMin(m_sharedBuffer->bufferFourthArrayDivided.size(),
+                        qMin(m_sharedBuffer->bufferSixthArrayDivided.size(),
+                        qMin(m_sharedBuffer->bufferSampleFlags.size(),
+                             m_sharedBuffer->bufferSampleStatus.size())))))));
+
+            m_freqBuffer.clear();
+            m_decimated1Buffer.clear();
+            m_decimated2Buffer.clear();
+            m_fourthArrayBuffer.clear();
+            m_sixthArrayBuffer.clear();
+            m_sampleFlagsBuffer.clear();
+            m_sampleStatusBuffer.clear();
+            for (int i = 0; i < count; ++i) {
+                m_freqBuffer.append(m_sharedBuffer->bufferFinalFrequency.dequeue());               //Actual Frequency
+                m_decimated1Buffer.append(m_sharedBuffer->bufferDecimated1.dequeue());             //Sensing Coil
+                m_decimated2Buffer.append(m_sharedBuffer->bufferDecimated2.dequeue());             //Excitation Coil
+                m_fourthArrayBuffer.append(m_sharedBuffer->bufferFourthArrayDivided.dequeue());    //Real Data
+                m_sixthArrayBuffer.append(m_sharedBuffer->bufferSixthArrayDivided.dequeue());      //Imaginary Data
+                m_sampleFlagsBuffer.append(m_sharedBuffer->bufferSampleFlags.dequeue());           //Lost/Reordered flags
+                m_sampleStatusBuffer.append(m_sharedBuffer->bufferSampleStatus.dequeue());         //ADC/OTR nibbles
             }
+            m_metrics->sharedBufferDepth.storeRelaxed(m_sharedBuffer->bufferFinalFrequency.size());
         }
 
-        //if the sync button was pressed, then run following loop
-        if(m_syncEnabled.loadAcquire()){
-            if (!decimated1Buffer.isEmpty()) {
-                int X = decimated1Buffer.at(0);
-                bool unequalFlag = false;
-                int iterationIndex = 0;
-                int limit = qMin(5, decimated1Buffer.size());
-
-                //check first 5 elements of sensing coils
-                //use to reorder data correctly
-                for (iterationIndex = 0; iterationIndex < limit; iterationIndex++) {
-                    int Y = decimated1Buffer.at(iterationIndex);
-                    if (X != Y) {
-                        unequalFlag = true;
-                        break;
-                    }
-                    X = Y;
-                }
-
-                //autosync must be [0,4];
-                iterationIndex = qBound(0, iterationIndex, 4);
-                if (unequalFlag) {
-                    if (iterationIndex == 4)
-                        autosync = 0;
-                    else
-                        autosync = iterationIndex;
-                }
-            }
-        } m_syncEnabled = false;
+        //place every sample in the frame of its frequency, emit frames as they complete
+        QVector<QVector<double>> frame;
+        int firstOffset = -1;
+        for (int i = 0; i < m_sampleFlagsBuffer.size(); ++i) {
+            const int index = m_assemblerRouter.route(m_freqBuffer.at(i));
+            if (index < 0)
+                continue;   //more frequencies than the instrument can be programmed with, not a valid record
+            FrameAssembler &assembler = m_assemblers[index];
+            if (assembler.addSample(m_freqBuffer.at(i), m_decimated1Buffer.at(i), m_decimated2Buffer.at(i),
+                                    m_fourthArrayBuffer.at(i), m_sixthArrayBuffer.at(i),
+                                    m_sampleFlagsBuffer.at(i), m_sampleStatusBuffer.at(i), frame))
+                finishFrame(index, frame);
+            if (i == 0)
+                firstOffset = assembler.lastOffset();
+        }
 
-        //update 'Auto Sync' display on GUI
+        //'Auto Sync' shows the repetition (0-3) the batch started on, what the SYNC heuristic used to estimate
+        autosync = firstOffset < 0 ? 0 : firstOffset % FrameLockEngine::samplesPerState;
+        m_metrics->autosync.storeRelaxed(autosync);
         emit autoSyncUpdated(autosync);
 
-        //rotate elements of each array by autosync value, pushing the last entries first, and first entries down
-        if (autosync > 0) {
-            if (!freqBuffer.isEmpty()) {
-                int k = autosync % freqBuffer.size();
-                std::rotate(freqBuffer.begin(), freqBuffer.end() - k, freqBuffer.end());
-            }
-            if (!decimated1Buffer.isEmpty()) {
-                int k = autosync % decimated1Buffer.size();
-                std::rotate(decimated1Buffer.begin(), decimated1Buffer.end() - k, decimated1Buffer.end());
-            }
-            if (!decimated2Buffer.isEmpty()) {
-                int k = autosync % decimated2Buffer.size();
-                std::rotate(decimated2Buffer.begin(), decimated2Buffer.end() - k, decimated2Buffer.end());
-            }
-            if (!fourthArrayBuffer.isEmpty()) {
-                int k = autosync % fourthArrayBuffer.size();
-                std::rotate(fourthArrayBuffer.begin(), fourthArrayBuffer.end() - k, fourthArrayBuffer.end());
-            }
-            if (!sixthArrayBuffer.isEmpty()) {
-                int k = autosync % sixthArrayBuffer.size();
-                std::rotate(sixthArrayBuffer.begin(), sixthArrayBuffer.end() - k, sixthArrayBuffer.end());
-            }
+        //with several frequencies the weakest lock is reported
+        int lockState = FrameLockEngine::Searching;
+        qint64 lockLosses = 0;
+        for (int a = 0; a < m_assemblerRouter.count(); ++a) {
+            const int state = m_assemblers.at(a).lockState();
+            lockState = a == 0 ? state : qMin(lockState, state);
+            lockLosses += m_assemblers.at(a).lockLosses();
         }
-
-        //containers to store only the required number of elements for saving
-        QList<qint64> freqBufferDecimated;
-        QList<qint32> decimated1BufferDecimated;
-        QList<qint32> decimated2BufferDecimated;
-        QList<double> fourthArrayBufferDecimated;
-        QList<double> sixthArrayBufferDecimated;
-
-        //start at the 4th element, then save only every 4th element of each array
-        //discard the other elements
-        for (int i = 3; i < freqBuffer.size(); i += 4) {
-            freqBufferDecimated.append(freqBuffer.at(i));
-        }
-        for (int i = 3; i < decimated1Buffer.size(); i += 4) {
-            decimated1BufferDecimated.append(decimated1Buffer.at(i));
-        }
-        for (int i = 3; i < decimated2Buffer.size(); i += 4) {
-            decimated2BufferDecimated.append(decimated2Buffer.at(i));
-        }
-        for (int i = 3; i < fourthArrayBuffer.size(); i += 4) {
-            fourthArrayBufferDecimated.append(fourthArrayBuffer.at(i));
-        }
-        for (int i = 3; i < sixthArrayBuffer.size(); i += 4) {
-            sixthArrayBufferDecimated.append(sixthArrayBuffer.at(i));
+        m_metrics->lockState.storeRelaxed(lockState);
+        m_metrics->lockLosses.storeRelaxed(lockLosses);
+        if (lockState != m_lastLockState) {
+            m_lastLockState = lockState;
+            emit lockStateUpdated(lockState, lockLosses);
         }
+    }
+}
 
-        //to update 'Actual Frequency'
-        if (!freqBufferDecimated.isEmpty()) {
-            actualfrequency = static_cast<double>(freqBufferDecimated.first());
-        } else {
-            //very unlikely
-            //outputStr.append("Actual Frequency: 0\n");
-        }
+/**
+ * @brief DataConsumer::applyReferenceRequests
+ * Capture restarts the accumulators of every frequency slot, load assigns each stored
+ * reference to the slot of its frequency
+ */
+void DataConsumer::applyReferenceRequests()
+{
+    int frames;
+    QString filePath;
+    bool load;
+    {
+        QMutexLocker locker(&m_referenceMutex);
+        frames = m_pendingCaptureFrames;
+        filePath = m_pendingReferencePath;
+        load = m_pendingLoad;
+    }
 
-        //update 'Actual Frequency' GUI display
-        emit actualFrequencyUpdated(actualfrequency);
-
-        //work out states for 16 coils combinations, produces only 120 unique states
-        //MUST IMPLEMENT ONE FOR 8 COILS IF WISHED
-        int cnt = qMin(decimated1BufferDecimated.size(), decimated2BufferDecimated.size());
-        QList<qint32> headerArray;
-        for (int i = 0; i < cnt; ++i) {
-            qint32 S = decimated1BufferDecimated.at(i);
-            qint32 E = decimated2BufferDecimated.at(i);
-            qint32 Y = 0;
-            if (S == 0)
-                S = 16;
-            if (E == 0)
-                E = 16;
-            if (S == E) {
-                Y = 0;
-            } else if (S < E) {
-                Y = (E - 1) + 16 * (S - 1) - (((S * (S + 1)) / 2) - 1);
-            } else {
-                Y = 16 * (E - 1) - ((((E - 1) * E) / 2) - 1) + (S - E - 1);
-            }
-            headerArray.append(Y);
-        }
+    if (!load) {
+        const int states = m_assemblers.first().sequence().size();
+        for (ReferenceCalibration &calibration : m_calibrations)
+            calibration.start(frames, states);
+        m_referenceFilePath = filePath;
+        m_referenceCaptureActive = true;
+        return;
+    }
+
+    QString errorString;
+    const QVector<ReferenceCalibration> references = ReferenceCalibration::loadFile(filePath, &errorString);
+    if (references.isEmpty()) {
+        emit referenceStatus("Could not load reference: " + (errorString.isEmpty() ? QString("no reference in file") : errorString));
+        return;
+    }
+    for (const ReferenceCalibration &reference : references) {
+        const int index = m_assemblerRouter.route(reference.frequency());
+        if (index < 0)
+            continue;
+        m_calibrations[index] = reference;
+        m_impedanceStages[index].setReference(reference.meanReal(), reference.meanImaginary());
+        emit referenceStatus(QString("Reference loaded for %1 Hz (%2 frames)").arg(reference.frequency()).arg(reference.framesAccumulated()));
+    }
+}
 
-        //checs common minimum size of all arrays
-        int minSize = qMin(headerArray.size(),
-                           qMin(decimated2BufferDecimated.size(),
-                                qMin(decimated1BufferDecimated.size(),
-                                     qMin(fourthArrayBufferDecimated.size(),
-                                          qMin(sixthArrayBufferDecimated.size(), freqBufferDecimated.size())))));
-
-        //store data to global2DArray for passing to main thread
-        QVector<QVector<double>> global2DArray(6);
-        for (int i = 0; i < minSize; ++i) {
-            global2DArray[0].append(static_cast<double>(headerArray.at(i)));                    //State
-            global2DArray[1].append(static_cast<double>(decimated2BufferDecimated.at(i)));      //Sensing coil
-            global2DArray[2].append(static_cast<double>(decimated1BufferDecimated.at(i)));      //Excitation coil
-            global2DArray[3].append(fourthArrayBufferDecimated.at(i));                          //Real
-            global2DArray[4].append(sixthArrayBufferDecimated.at(i));                           //Imaginary
-            global2DArray[5].append(static_cast<double>(freqBufferDecimated.at(i)));            //Actual Frequency
+/**
+ * @brief DataConsumer::onReferenceCaptured
+ * The file is written once every frequency seen so far has its reference,
+ * slots of frequencies that never showed up stop capturing
+ */
+void DataConsumer::onReferenceCaptured(int index)
+{
+    const ReferenceCalibration &calibration = m_calibrations.at(index);
+    m_impedanceStages[index].setReference(calibration.meanReal(), calibration.meanImaginary());
+    emit referenceStatus(QString("Reference captured for %1 Hz (%2 frames)").arg(calibration.frequency()).arg(calibration.framesAccumulated()));
+
+    for (int i = 0; i < m_assemblerRouter.count(); ++i) {
+        if (m_calibrations.at(i).isCapturing())
+            return;
+    }
+    for (int i = m_assemblerRouter.count(); i < m_calibrations.size(); ++i)
+        m_calibrations[i].clear();
+    m_referenceCaptureActive = false;
+
+    if (m_referenceFilePath.isEmpty())
+        return;
+    QString errorString;
+    if (ReferenceCalibration::saveFile(m_referenceFilePath, m_calibrations, &errorString))
+        emit referenceStatus("Reference saved to: " + m_referenceFilePath);
+    else
+        emit referenceStatus("Could not save reference: " + errorString);
+}
+
+/**
+ * @brief DataConsumer::finishFrame
+ * Accumulates the frame into the reference while capturing, runs the impedance stage when enabled
+ * (its cost per frame is published as a metric), subtracts the reference if requested and emits the frame.
+ * Normalisation uses the raw values, subtraction happens last
+ */
+void DataConsumer::finishFrame(int index, QVector<QVector<double>> &frame)
+{
+    ReferenceCalibration &calibration = m_calibrations[index];
+    if (m_referenceCaptureActive && calibration.addFrame(frame))
+        onReferenceCaptured(index);
+
+    //statistics of the raw values, the readout shows the first frequency
+    if (index == 0) {
+        TRACE_SPAN("stateStatistics");
+        m_statistics.addFrame(frame);
+        if (!m_statisticsTimer.isValid() || m_statisticsTimer.elapsed() >= statisticsIntervalMs) {
+            m_statisticsTimer.start();
+            m_statistics.snapshot(m_statisticsTable);
+            emit stateStatisticsUpdated(m_statisticsTable);
         }
+    }
 
-        //pass formatted table to main thread
-        emit processedChunkResult(global2DArray);
+    if (m_impedanceEnabled.loadRelaxed()) {
+        TRACE_SPAN("impedanceStage");
+        QElapsedTimer stageTimer;
+        stageTimer.start();
+        m_impedanceStages.at(index).process(frame);
+        m_metrics->impedanceStageNs.storeRelaxed(stageTimer.nsecsElapsed());
     }
+
+    if (m_subtractReference.loadRelaxed())
+        calibration.subtract(frame);
+    emitFrame(frame);
+}
+
+/**
+ * @brief DataConsumer::emitFrame
+ * Updates 'Actual Frequency' from the first row and passes the frame to the main thread
+ */
+void DataConsumer::emitFrame(const QVector<QVector<double>> &frame)
+{
+    //to update 'Actual Frequency'
+    if (!frame[RowFrequency].isEmpty())
+        actualfrequency = frame[RowFrequency].first();
+
+    //update 'Actual Frequency' GUI display
+    m_metrics->actualFrequency.storeRelaxed(static_cast<qint64>(actualfrequency));
+    emit actualFrequencyUpdated(actualfrequency);
+
+    if (!frame[RowComplete].isEmpty() && frame[RowComplete].first() == 0.0)
+        m_metrics->incompleteFrames.fetchAndAddRelaxed(1);
+
+    //pass formatted table to main thread
+    m_metrics->framesProduced.fetchAndAddRelaxed(1);
+    m_metrics->writerBacklog.fetchAndAddRelaxed(1);
+    emit processedChunkResult(frame);
 }
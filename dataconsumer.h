@@ -3,7 +3,15 @@
 
 #include <QObject>
 #include <QVector>
+#include <QMutex>
 #include "sharedbuffer.h"
+#include "pipelinemetrics.h"
+#include "frameassembler.h"
+#include "frequencyrouter.h"
+#include "impedancestage.h"
+#include "referencecalibration.h"
+#include "statestatistics.h"
+#include <QElapsedTimer>
 #include <QAtomicInteger>
 
 /**
@@ -11,8 +19,8 @@
  *
  * This class represents the consumer side in a producer-consumer pattern.
  * It is responsible for retrieving formatted data from a shared buffer,
- * populated by processingDataThread, to then perform some processing (decimating,
- * rotating, computing coil combination states, and formatting data into
+ * populated by processingDataThread, to then perform some processing (locking onto
+ * the frame boundary, decimating, computing coil combination states, and formatting data into
  * final format for saving). Then it passes back data to the MainWindow thread
  * for saving purposes.
  */
@@ -21,10 +29,19 @@ class DataConsumer : public QObject
 {
     Q_OBJECT
 public:
-    explicit DataConsumer(SharedBuffer *sharedBuffer, QObject *parent = nullptr);
+    explicit DataConsumer(SharedBuffer *sharedBuffer, PipelineMetrics *metrics, QObject *parent = nullptr);
 
     void stop();                                //sets m_stop flag to true, to terminate this thread
-    QAtomicInteger<bool> m_syncEnabled{false};  //retrieves autoSync flag from main thread
+    void setCoilSequence(const CoilSequence &sequence);    //thread-safe, applied before the next batch
+    void resetFrequencies(int frequencies);     //thread-safe, new frequency table of this length, applied before the next batch
+    QAtomicInteger<bool> m_syncEnabled{false};  //retrieves SYNC request from main thread, forces a new lock search
+    QAtomicInteger<bool> m_impedanceEnabled{false};     //appends magnitude/phase/normalised rows to each frame
+    QAtomicInteger<bool> m_subtractReference{false};    //subtracts the reference mean from real/imaginary rows
+    QAtomicInteger<int> m_statisticsWindow{25};         //'SNR Packets', frames in the per-state statistics window
+    QAtomicInteger<int> m_reductionKernel{OversampleReduction::PickLast};  //OversampleReduction::Kernel of the frames
+
+    void captureReference(int frames, const QString &filePath);    //thread-safe, averages the next frames of each frequency
+    void loadReference(const QString &filePath);                   //thread-safe, references saved by a previous capture
 
 public slots:
     void processBuffers();                      //main slot of this class
@@ -34,13 +51,59 @@ signals:
     void processedChunkResult(const QVector<QVector<double>> &global2DArray);   //emits final data for saving
     void autoSyncUpdated(const int &autoSyncUpdatedValue);                      //emits 'Auto Sync' value for UI display
     void actualFrequencyUpdated(const double &actualFrequencyValue);            //emits 'Actual Frequency' value for UI display
+    void lockStateUpdated(const int &lockState, const qint64 &lockLosses);      //emits FrameLockEngine state when it changes
+    void referenceStatus(const QString &message);                               //reference captured/saved/loaded, for the message log
+    void stateStatisticsUpdated(const QVector<QVector<double>> &statistics);    //StateStatistics snapshot of the first frequency
 
 private:
+    void finishFrame(int index, QVector<QVector<double>> &frame);   //optional stages of the frame of assembler index
+    void emitFrame(const QVector<QVector<double>> &frame);  //updates displays/metrics and passes frame to main thread
+
     SharedBuffer *m_sharedBuffer;               //pointer to inter-thread shared buffer holding processed data from processingDataThread
-    const int chunkSize = 480;                  //number of data processed from the processingDataThread
-    int autosync = 0;                           //initialises Auto Synch value to zero
+    PipelineMetrics *m_metrics;                 //pointer to counters read by the metrics endpoint
+    const int maxBatchSize = 4096;              //most samples taken from the shared buffer per lock of its mutex
+    const int statisticsIntervalMs = 250;       //shortest time between statistics snapshots sent to the GUI
+    int autosync = 0;                           //repetition within its step of the first sample of the last batch
     double actualfrequency = 0;                 //initialises Actual Frequency value to zero
     bool m_stop;                                //flag used to run/stop this thread
+
+    FrequencyRouter m_assemblerRouter;          //actual frequency of a sample -> its assembler
+    QVector<FrameAssembler> m_assemblers;       //one lock engine and set of frame slots per frequency
+    int m_lastLockState = -1;                   //last lock state sent to GUI
+    QAtomicInteger<bool> m_frequenciesChanged{false};
+    QAtomicInteger<int> m_frequencyCount{FrequencyRouter::defaultFrequencies};  //length of the last frequency table
+    void resizeFrequencies(int frequencies);    //one assembler/impedance stage/reference per table entry
+
+    void applyReferenceRequests();              //starts a capture or loads a file posted by the main thread
+    void onReferenceCaptured(int index);        //capture of assembler index finished, saves file once all are done
+
+    QVector<ImpedanceStage> m_impedanceStages;  //normalisation by the reference of each frequency, same index as m_assemblers
+    QVector<ReferenceCalibration> m_calibrations;   //reference of each frequency, same index as m_assemblers
+
+    QMutex m_referenceMutex;                    //guards the pending reference request
+    int m_pendingCaptureFrames = 0;             //frames to average, 0 if no capture requested
+    QString m_pendingReferencePath;             //file to save the capture to, or to load
+    bool m_pendingLoad = false;
+    QAtomicInteger<bool> m_referenceRequested{false};
+    QString m_referenceFilePath;                //file of the capture in progress, empty if not saved
+    bool m_referenceCaptureActive = false;
+
+    StateStatistics m_statistics;               //rolling per-state statistics/SNR of the first frequency
+    QElapsedTimer m_statisticsTimer;            //limits snapshots sent to the GUI
+    QVector<QVector<double>> m_statisticsTable; //snapshot, rows reused between updates
+
+    QMutex m_sequenceMutex;                     //guards m_pendingSequence
+    CoilSequence m_pendingSequence;             //sequence posted by the main thread
+    QAtomicInteger<bool> m_sequenceChanged{false};
+
+    //samples of the current batch, capacity reused between batches
+    QVector<qint64> m_freqBuffer;
+    QVector<qint32> m_decimated1Buffer;
+    QVector<qint32> m_decimated2Buffer;
+    QVector<double> m_fourthArrayBuffer;
+    QVector<double> m_sixthArrayBuffer;
+    QVector<quint8> m_sampleFlagsBuffer;
+    QVector<quint8> m_sampleStatusBuffer;
 };
 
 #endif // DATACONSUMER_H
@@ -0,0 +1,164 @@
+#include "datagramdecoder.h"
+#include "pipelinetrace.h"
+#include <QAtomicInteger>
+#include <QDebug>
+#include <algorithm>
+
+//value of a single hex digit, -1 if not a hex digit
+static inline int hexNibble(QChar c)
+{
+    const ushort u = c.unicode();
+    if (u >= '0' && u <= '9')
+        return u - '0';
+    if (u >= 'A' && u <= 'F')
+        return u - 'A' + 10;
+    if (u >= 'a' && u <= 'f')
+        return u - 'a' + 10;
+    return -1;
+}
+
+void DatagramDecoder::Slab::clear()
+{
+    records.clear();
+    integers.clear();
+    text.clear();
+    std::fill(adcCounts, adcCounts + StatusHistory::nibbleValues, 0);
+    otrRecords = 0;
+    invalidStatus = false;
+    tokenErrors = 0;
+}
+
+DatagramDecoder::DatagramDecoder(int threads)
+{
+    setThreadCount(threads);
+}
+
+void DatagramDecoder::setThreadCount(int threads)
+{
+    m_threads = qMax(1, threads);
+    m_pool.setMaxThreadCount(qMax(1, m_threads - 1));
+}
+
+/**
+ * @brief DatagramDecoder::setThreadTuning
+ * Applied lazily by each pool thread before its next slab, threads the pool starts later (the pool
+ * keeps its threads, they do not expire) get it too. Generations are unique across decoders
+ */
+void DatagramDecoder::setThreadTuning(const ThreadTuning::Settings &settings)
+{
+    static QAtomicInteger<quint64> generations{0};
+    m_helperTuning.cpu = -1;
+    m_helperTuning.priority = settings.priority;
+    m_tuningGeneration = generations.fetchAndAddRelaxed(1) + 1;
+    m_pool.setExpiryTimeout(-1);
+}
+
+/**
+ * @brief DatagramDecoder::decode
+ * Slab s holds datagrams [s * n / slabs, (s + 1) * n / slabs), threads take the next slab index
+ * from a shared counter until none is left, then the caller waits for the pool
+ */
+void DatagramDecoder::decode(const QList<QByteArray> &datagrams)
+{
+    const int datagramCount = datagrams.size();
+    const bool parallel = m_threads > 1 && datagramCount >= minParallelDatagrams;
+    const int slabCount = parallel ? qMin(datagramCount, m_threads * slabsPerThread) : 1;
+    if (m_slabs.size() < slabCount)
+        m_slabs.resize(slabCount);
+    m_slabCount = slabCount;
+
+    Slab *slabs = m_slabs.data();                               //detached once here, workers only index it
+    QAtomicInteger<int> nextSlab{0};
+    auto work = [&datagrams, slabs, slabCount, datagramCount, &nextSlab](){
+        for (int s = nextSlab.fetchAndAddRelaxed(1); s < slabCount; s = nextSlab.fetchAndAddRelaxed(1))
+            decodeSlab(datagrams, int(qint64(s) * datagramCount / slabCount), int(qint64(s + 1) * datagramCount / slabCount), slabs[s]);
+    };
+    const ThreadTuning::Settings tuning = m_helperTuning;
+    const quint64 generation = m_tuningGeneration;
+    auto helper = [&work, tuning, generation](){
+        static thread_local quint64 tunedGeneration = 0;
+        if (tunedGeneration != generation) {
+            tunedGeneration = generation;
+            if (tuning.isRequested())
+                ThreadTuning::applyToCurrentThread(tuning);     //best effort, the helper decodes either way
+        }
+        work();
+    };
+    const int helpers = qMin(m_threads, slabCount) - 1;
+    for (int i = 0; i < helpers; ++i)
+        m_pool.start(helper);
+    work();
+    m_pool.waitForDone();
+}
+
+/**
+ * @brief DatagramDecoder::decodeSlab
+ * Same steps as the serial decoder on the slab alone: the formatted chunks are joined and reversed,
+ * split at ',' and ';', each token read as hex, and the integers reversed back into record order.
+ * Every slab ends with ';', so no token spans two slabs and the slabs concatenate to the serial result
+ */
+void DatagramDecoder::decodeSlab(const QList<QByteArray> &datagrams, int first, int last, Slab &slab)
+{
+    TRACE_SPAN("decodeSlab");
+    slab.clear();
+
+    // For each datagram, process in 32-character segments.
+    for (int d = first; d < last; ++d) {
+        QString binaryString = QString(datagrams.at(d));
+        for (int i = 0; i + 32 <= binaryString.length(); i += 32) {
+            QString chunk = binaryString.mid(i, 32);
+            QString FrequencyRas = chunk.mid(0, 4);
+            QString SCoil = chunk.mid(4, 1);
+            QString ECoil = chunk.mid(5, 1);
+            //frequency field as the key of its tracker, records of each frequency follow the sequence on their own
+            qint64 frequencyKey = 0;
+            for (int n = 0; n < 4 && frequencyKey >= 0; ++n) {
+                const int nibble = hexNibble(chunk.at(n));
+                frequencyKey = nibble < 0 ? -1 : (frequencyKey << 4) | nibble;
+            }
+            const int adcNibble = hexNibble(chunk.at(6));
+            const int otrNibble = hexNibble(chunk.at(7));
+            if (adcNibble < 0 || otrNibble < 0) {
+                slab.invalidStatus = true;
+            } else {
+                ++slab.adcCounts[adcNibble];
+                slab.otrRecords += otrNibble != 0;
+            }
+            slab.records.append({frequencyKey, qint8(hexNibble(chunk.at(4))), qint8(hexNibble(chunk.at(5))),
+                                 quint8(qMax(0, adcNibble) << 4 | qMax(0, otrNibble))});
+            QString IData = chunk.mid(8, 8);
+            QString FrequencyStand = chunk.mid(16, 8);
+            QString QData = chunk.mid(24, 8);
+            QString formattedChunk = QString("%1,%2,%3,%4;%5,%6;")
+                                         .arg(FrequencyRas)
+                                         .arg(SCoil)
+                                         .arg(ECoil)
+                                         .arg(IData)
+                                         .arg(FrequencyStand)
+                                         .arg(QData);
+            slab.text.append(formattedChunk);
+        }
+    }
+
+    // Reverse the slab string and tokenize, as split("[,;]", SkipEmptyParts) without the regular expression
+    std::reverse(slab.text.begin(), slab.text.end());
+    const int length = slab.text.length();
+    int start = 0;
+    for (int i = 0; i <= length; ++i) {
+        if (i < length && slab.text.at(i) != ',' && slab.text.at(i) != ';')
+            continue;
+        if (i > start) {
+            const QStringRef token(&slab.text, start, i - start);
+            bool ok = false;
+            quint32 uValue = token.toUInt(&ok, 16);
+            if (ok) {
+                slab.integers.append(static_cast<qint32>(uValue));
+            } else {
+                ++slab.tokenErrors;
+                qDebug() << "Error converting token to int:" << token;
+            }
+        }
+        start = i + 1;
+    }
+    std::reverse(slab.integers.begin(), slab.integers.end());
+}
@@ -0,0 +1,75 @@
+#ifndef DATAGRAMDECODER_H
+#define DATAGRAMDECODER_H
+
+#include <QVector>
+#include <QList>
+#include <QByteArray>
+#include <QString>
+#include <QThreadPool>
+#include "statushistory.h"
+#include "threadtuning.h"
+
+/**
+ * @brief The DatagramDecoder class
+ *
+ * Text decoding of a batch of instrument datagrams (32-character records -> formatted chunks ->
+ * hex tokens -> integers) spread over a private thread pool. The batch is cut into slabs of
+ * consecutive datagrams, more slabs than threads, idle threads claim the next undecoded slab so a
+ * slow slab does not hold the others back, and the calling thread decodes slabs too.
+ * Each slab is decoded into its own buffers, reused from batch to batch, nothing is shared while decoding.
+ * Slabs keep arrival order: concatenated in index order they give exactly the records, integers and
+ * raw text of the serial decoder, the stateful stages (sequence trackers, decimation) run afterwards
+ * on the calling thread.
+ * Pool threads take the SCHED_FIFO priority of the calling thread (setThreadTuning) so a realtime
+ * caller does not wait on normal-priority helpers, they are not pinned: pinned to the caller's CPU
+ * they would decode one slab at a time, affinity is left to the scheduler
+ */
+
+class DatagramDecoder
+{
+public:
+    static const int slabsPerThread = 4;                        //finer slabs balance uneven datagrams
+    static const int minParallelDatagrams = 8;                  //smaller batches are decoded on the calling thread
+
+    //fields of one record needed after decoding
+    struct Record {
+        qint64 frequencyKey;                                    //first 4 hex digits, -1 if not hexadecimal
+        qint8 sensing;                                          //sensing coil nibble, -1 if not hexadecimal
+        qint8 excitation;                                       //excitation coil nibble, same
+        quint8 status;                                          //ADC << 4 | OTR nibbles
+    };
+
+    struct Slab {
+        QVector<Record> records;
+        QVector<qint32> integers;                               //converted tokens in record order, 6 per record unless a token failed
+        QString text;                                           //formatted chunks of the slab, reversed (raw data display)
+        int adcCounts[StatusHistory::nibbleValues];             //ADC nibble histogram
+        int otrRecords;                                         //records with a non-zero OTR nibble
+        bool invalidStatus;                                     //an ADC/OTR digit was not hexadecimal
+        int tokenErrors;                                        //tokens that failed toUInt
+
+        void clear();                                           //keeps the capacity
+    };
+
+    explicit DatagramDecoder(int threads = 1);
+
+    void setThreadCount(int threads);                           //1 decodes everything on the calling thread
+    void setThreadTuning(const ThreadTuning::Settings &settings);   //priority for the pool threads, the CPU is ignored
+    int threadCount() const { return m_threads; }
+
+    void decode(const QList<QByteArray> &datagrams);            //fills the first slabCount() slabs, returns once all are decoded
+    int slabCount() const { return m_slabCount; }
+    const Slab &slab(int index) const { return m_slabs.at(index); }
+
+    static void decodeSlab(const QList<QByteArray> &datagrams, int first, int last, Slab &slab);    //datagrams [first, last)
+
+private:
+    QThreadPool m_pool;                                         //threads 2.. of a batch, the caller is the first
+    QVector<Slab> m_slabs;                                      //grows to the largest slab count seen
+    int m_slabCount = 0;
+    int m_threads = 1;
+    ThreadTuning::Settings m_helperTuning;                      //cpu always -1
+    quint64 m_tuningGeneration = 0;                             //pool threads apply m_helperTuning once per generation
+};
+
+#endif // DATAGRAMDECODER_H
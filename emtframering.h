@@ -0,0 +1,87 @@
+/*
+ * emtframering.h
+ * ------------------------------------------
+ * Layout of the shared-memory frame ring published by EMT_IP and EMT_IP_daemon (SharedFrameRing),
+ * for local readers written in C or any language that can map shared memory. No Qt needed.
+ *
+ * Opening (name "emt_frames" unless configured otherwise):
+ *      POSIX:   fd = shm_open("/emt_frames", O_RDONLY, 0); mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0)
+ *      Windows: OpenFileMappingW(FILE_MAP_READ, FALSE, L"Local\\emt_frames"); MapViewOfFile(...)
+ *      size = sizeof(emt_ring_header) + slot_count * slot_size, read the header first
+ *
+ * Frame n (0-based, in publication order) is in slot n % slot_count. Each slot is guarded by a
+ * seqlock: sequence is odd while the publisher writes the slot. A reader never blocks the publisher,
+ * it reads the slot (in place or copied), then checks sequence did not change and is even.
+ * A reader that falls more than slot_count frames behind finds newer frame numbers and skips ahead.
+ * On POSIX the segment outlives the publisher (remove /dev/shm/emt_frames to free it), frame numbers
+ * continue when it is published to again.
+ *
+ * All fields are little endian, naturally aligned, header and slots are multiples of 64 bytes.
+ */
+
+#ifndef EMTFRAMERING_H
+#define EMTFRAMERING_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define EMT_RING_MAGIC      0x52544D45u     /* "EMTR" */
+#define EMT_RING_VERSION    1u
+#define EMT_RING_MAX_ROWS   12              /* FrameRow order: state, excitation, sensing, real, imaginary, frequency,
+                                               complete, status, magnitude, phase, normalized real, normalized imaginary */
+#define EMT_RING_MAX_STATES 256             /* columns, one per sequence step (120 for 16 coils) */
+
+typedef struct emt_ring_header {
+    uint32_t magic;                 /* EMT_RING_MAGIC once initialised */
+    uint32_t version;               /* EMT_RING_VERSION */
+    uint32_t slot_count;            /* frames kept */
+    uint32_t slot_size;             /* bytes per slot, sizeof(emt_ring_slot) */
+    uint32_t max_rows;              /* EMT_RING_MAX_ROWS */
+    uint32_t max_states;            /* EMT_RING_MAX_STATES */
+    uint64_t published;             /* frames published so far, the newest is published - 1 */
+    uint8_t  reserved[32];
+} emt_ring_header;
+
+typedef struct emt_ring_slot {
+    uint64_t sequence;              /* seqlock, odd while the slot is written */
+    uint64_t frame_number;          /* n of the frame held */
+    int64_t  publish_time_ns;       /* publication time, ns since the Unix epoch */
+    double   frequency;             /* actual frequency of the frame (Hz) */
+    uint32_t states;                /* columns used in data */
+    uint32_t rows;                  /* rows used in data, 8 or 12 with the impedance rows */
+    uint32_t complete;              /* 1 if every record of the frame arrived in order while locked */
+    uint32_t instrument;            /* 0-based instrument session that produced the frame */
+    uint32_t reserved[4];
+    double   data[EMT_RING_MAX_ROWS][EMT_RING_MAX_STATES];     /* data[row][state], unused entries undefined */
+} emt_ring_slot;
+
+static inline const emt_ring_slot *emt_ring_slot_at(const emt_ring_header *header, uint64_t frame_number)
+{
+    return (const emt_ring_slot *)((const uint8_t *)header + sizeof(emt_ring_header)
+                                   + (frame_number % header->slot_count) * header->slot_size);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+/*
+ * Copies frame frame_number to out.
+ * Returns 1 if copied, 0 if not published yet, -1 if already overwritten (reader too slow)
+ */
+static inline int emt_ring_read(const emt_ring_header *header, uint64_t frame_number, emt_ring_slot *out)
+{
+    const emt_ring_slot *slot = emt_ring_slot_at(header, frame_number);
+    for (;;) {
+        const uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1u)
+            continue;                               /* being written, takes microseconds */
+        memcpy(out, slot, sizeof(emt_ring_slot));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != before)
+            continue;                               /* written meanwhile, copy again */
+        if (before == 0 || out->frame_number < frame_number)
+            return 0;
+        return out->frame_number == frame_number ? 1 : -1;
+    }
+}
+#endif
+
+#endif /* EMTFRAMERING_H */
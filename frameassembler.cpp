@@ -0,0 +1,201 @@
+#include "frameassembler.h"
+#include <QtNumeric>
+
+//work out states for 16 coils combinations, produces only 120 unique states
+//MUST IMPLEMENT ONE FOR 8 COILS IF WISHED
+static qint32 stateIndex(qint32 S, qint32 E)
+{
+    if (S == 0)
+        S = 16;
+    if (E == 0)
+        E = 16;
+    if (S == E)
+        return 0;
+    if (S < E)
+        return (E - 1) + 16 * (S - 1) - (((S * (S + 1)) / 2) - 1);
+    return 16 * (E - 1) - ((((E - 1) * E) / 2) - 1) + (S - E - 1);
+}
+
+FrameAssembler::FrameAssembler()
+    : m_reduce(OversampleReduction::function(OversampleReduction::PickLast))
+{
+    setSequence(m_lock.sequence());
+}
+
+/**
+ * @brief FrameAssembler::setReduction
+ * The kernel is looked up once here, buildFrame only calls it
+ */
+void FrameAssembler::setReduction(OversampleReduction::Kernel kernel)
+{
+    m_reduction = kernel;
+    m_reduce = OversampleReduction::function(kernel);
+}
+
+/**
+ * @brief FrameAssembler::setSequence
+ * Frame length follows the programmed sequence (480 samples for 16 coils, 112 for 8 coils),
+ * slots are only reallocated here, never per sample
+ */
+void FrameAssembler::setSequence(const CoilSequence &sequence)
+{
+    m_lock.setSequence(sequence);
+    const int length = m_lock.frameLength();
+    m_frequency.resize(length);
+    m_sensing.resize(length);
+    m_excitation.resize(length);
+    m_real.resize(length);
+    m_imaginary.resize(length);
+    m_status.resize(length);
+    m_filled.resize(length);
+    m_reducedReal.resize(sequence.size());
+    m_reducedImaginary.resize(sequence.size());
+    resync();
+}
+
+/**
+ * @brief FrameAssembler::resync
+ * Drops the frame being collected, collection restarts at the next boundary once locked again
+ */
+void FrameAssembler::resync()
+{
+    m_lock.reset();
+    clearSlots();
+    m_collecting = false;
+    m_lastOffset = -1;
+}
+
+void FrameAssembler::clearSlots()
+{
+    m_filled.fill(0);
+    m_filledCount = 0;
+    m_frameClean = true;
+}
+
+/**
+ * @brief FrameAssembler::addSample
+ * Places one sample at its lock offset. A frame is finished when:
+ *      the last slot is written
+ *      the offset wraps back (last slots of the frame were lost)
+ *      the lock is lost while collecting (partial frame, incomplete)
+ */
+bool FrameAssembler::addSample(qint64 frequency, qint32 sensing, qint32 excitation, double real, double imaginary,
+                               quint8 sampleFlags, quint8 sampleStatus, QVector<QVector<double>> &frame)
+{
+    const int offset = m_lock.onSample(sensing & 0xF, excitation & 0xF, sampleFlags);
+    if (offset < 0) {
+        m_frameClean = false;
+        if (!m_collecting || m_lock.state() != FrameLockEngine::Searching)
+            return false;
+
+        bool finished = false;
+        if (m_filledCount > 0) {
+            buildFrame(frame);
+            finished = true;
+        }
+        clearSlots();
+        m_collecting = false;
+        m_lastOffset = -1;
+        return finished;
+    }
+
+    bool finished = false;
+    const bool boundary = offset == 0 || (m_lastOffset >= 0 && offset <= m_lastOffset);
+    if (boundary) {
+        if (m_collecting && m_filledCount > 0) {
+            buildFrame(frame);
+            finished = true;
+        }
+        clearSlots();
+        m_collecting = true;
+    }
+    m_lastOffset = offset;
+    if (!m_collecting)
+        return finished;
+
+    m_frequency[offset] = frequency;
+    m_sensing[offset] = sensing;
+    m_excitation[offset] = excitation;
+    m_real[offset] = real;
+    m_imaginary[offset] = imaginary;
+    m_status[offset] = sampleStatus;
+    if (!m_filled[offset]) {
+        m_filled[offset] = 1;
+        ++m_filledCount;
+    }
+    if (sampleFlags != 0 || m_lock.state() != FrameLockEngine::Locked)
+        m_frameClean = false;
+
+    if (offset == m_lock.frameLength() - 1) {
+        buildFrame(frame);
+        finished = true;
+        clearSlots();
+    }
+    return finished;
+}
+
+/**
+ * @brief FrameAssembler::buildFrame
+ * One row per step of the sequence. Real/imaginary of steps with all repetitions come from the
+ * reduction kernel (run over every step, stale slots of partial steps are simply not used),
+ * partial steps take their last repetition.
+ * Steps with no sample at all keep their coils from the sequence and NaN data
+ */
+void FrameAssembler::buildFrame(QVector<QVector<double>> &frame)
+{
+    const CoilSequence &sequence = m_lock.sequence();
+    const int steps = sequence.size();
+    const int samplesPerState = FrameLockEngine::samplesPerState;
+    const bool complete = m_frameClean && m_filledCount == m_lock.frameLength();
+
+    m_reduce(m_real.constData(), steps, m_reducedReal.data());
+    m_reduce(m_imaginary.constData(), steps, m_reducedImaginary.data());
+
+    frame = QVector<QVector<double>>(FrameRowCount);
+    for (QVector<double> &row : frame)
+        row.reserve(steps);
+
+    qint64 lastFrequency = 0;
+    for (int step = 0; step < steps; ++step) {
+        int slot = -1;
+        int repetitions = 0;
+        int status = 0;
+        for (int repetition = 0; repetition < samplesPerState; ++repetition) {
+            const int index = step * samplesPerState + repetition;
+            repetitions += m_filled[index];
+            const int otr = m_filled[index] ? m_status[index] & 0xF : 0;
+            status |= (otr != 0) << repetition | otr << StatusOtrShift;
+        }
+        for (int repetition = samplesPerState - 1; repetition >= 0; --repetition) {
+            if (m_filled[step * samplesPerState + repetition]) {
+                slot = step * samplesPerState + repetition;
+                break;
+            }
+        }
+
+        qint32 S, E;
+        double real, imaginary;
+        if (slot >= 0) {
+            S = m_sensing[slot];
+            E = m_excitation[slot];
+            real = repetitions == samplesPerState ? m_reducedReal[step] : m_real[slot];
+            imaginary = repetitions == samplesPerState ? m_reducedImaginary[step] : m_imaginary[slot];
+            lastFrequency = m_frequency[slot];
+            status |= (m_status[slot] >> 4) << StatusAdcShift;
+        } else {
+            S = sequence.sensingAt(step) & 0xF;
+            E = sequence.excitationAt(step) & 0xF;
+            real = qQNaN();
+            imaginary = qQNaN();
+        }
+
+        frame[RowState].append(static_cast<double>(stateIndex(S, E)));     //State
+        frame[RowExcitation].append(static_cast<double>(E));               //Excitation coil
+        frame[RowSensing].append(static_cast<double>(S));                  //Sensing coil
+        frame[RowReal].append(real);                                       //Real
+        frame[RowImaginary].append(imaginary);                             //Imaginary
+        frame[RowFrequency].append(static_cast<double>(lastFrequency));    //Actual Frequency
+        frame[RowComplete].append(complete ? 1.0 : 0.0);                   //Complete
+        frame[RowStatus].append(static_cast<double>(status));              //OTR/ADC bits
+    }
+}
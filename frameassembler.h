@@ -0,0 +1,97 @@
+#ifndef FRAMEASSEMBLER_H
+#define FRAMEASSEMBLER_H
+
+#include <QVector>
+#include "framelockengine.h"
+#include "oversamplereduction.h"
+
+//rows of the frame table emitted by processedChunkResult, same order as the columns of the saved file
+enum FrameRow {
+    RowState = 0,           //state index 1-120
+    RowExcitation,          //excitation coil
+    RowSensing,             //sensing coil
+    RowReal,                //real (I)
+    RowImaginary,           //imaginary (Q)
+    RowFrequency,           //actual frequency
+    RowComplete,            //1 if every record of the frame arrived in order while locked, else 0
+    RowStatus,              //StepStatus bits, OTR/ADC nibbles of the step
+    FrameRowCount,
+    //optional rows appended by ImpedanceStage
+    RowMagnitude = FrameRowCount,   //sqrt(I^2 + Q^2)
+    RowPhase,               //atan2(Q, I), radians
+    RowNormalizedReal,      //real part of (I + jQ)/reference
+    RowNormalizedImaginary, //imaginary part of (I + jQ)/reference
+    DerivedFrameRowCount
+};
+
+//bits of RowStatus, packed in one column so they add a single small integer per state
+enum StepStatus {
+    StatusClippedMask = 0x00F,  //bit r set if repetition r had a non-zero OTR nibble
+    StatusOtrShift = 4,         //bits 4-7: OTR nibbles of the repetitions OR'd together
+    StatusAdcShift = 8          //bits 8-11: ADC nibble of the last repetition
+};
+
+//true if any repetition of the state clipped, such states are left out of statistics, references and images
+inline bool isClipped(double status)
+{
+    return (static_cast<int>(status) & StatusClippedMask) != 0;
+}
+
+/**
+ * @brief The FrameAssembler class
+ *
+ * Builds frames from the sample stream using FrameLockEngine offsets instead of fixed 480-sample chunks.
+ * Each sample is written to its slot of a preallocated frame (one slot per step repetition),
+ * a frame is finished when its last slot is written or when the stream wraps to the next frame.
+ * Steps with all 4 repetitions are reduced to one value by the selected OversampleReduction kernel.
+ * Collection starts at the first frame boundary after lock, partial frames are only produced when
+ * the lock is lost mid-frame, and are then marked incomplete
+ */
+
+class FrameAssembler
+{
+public:
+    FrameAssembler();
+
+    void setSequence(const CoilSequence &sequence);         //resizes the frame slots to the new sequence
+    void resync();                                          //drops the current frame and lock
+    void setReduction(OversampleReduction::Kernel kernel);  //how the 4 repetitions of a step become one value
+
+    //returns true if this sample finished a frame, which is then written to frame
+    //sampleStatus is the ADC nibble << 4 | OTR nibble of the record
+    bool addSample(qint64 frequency, qint32 sensing, qint32 excitation, double real, double imaginary,
+                   quint8 sampleFlags, quint8 sampleStatus, QVector<QVector<double>> &frame);
+
+    const CoilSequence &sequence() const { return m_lock.sequence(); }
+    OversampleReduction::Kernel reduction() const { return m_reduction; }
+    FrameLockEngine::LockState lockState() const { return m_lock.state(); }
+    qint64 lockLosses() const { return m_lock.lockLosses(); }
+    int lastOffset() const { return m_lastOffset; }         //offset of the last placed sample, -1 if none
+
+private:
+    void buildFrame(QVector<QVector<double>> &frame);
+    void clearSlots();
+
+    FrameLockEngine m_lock;                                 //gives the frame offset of each sample
+
+    //one entry per slot (step * samplesPerState + repetition)
+    QVector<qint64> m_frequency;
+    QVector<qint32> m_sensing;
+    QVector<qint32> m_excitation;
+    QVector<double> m_real;
+    QVector<double> m_imaginary;
+    QVector<quint8> m_status;                               //ADC << 4 | OTR
+    QVector<quint8> m_filled;
+
+    int m_filledCount = 0;                                  //slots written in the current frame
+    int m_lastOffset = -1;                                  //offset of the previous placed sample
+    bool m_collecting = false;                              //true once a frame boundary has been seen
+    bool m_frameClean = true;                               //false if the frame saw a flag or was not locked
+
+    OversampleReduction::Kernel m_reduction = OversampleReduction::PickLast;
+    OversampleReduction::Function m_reduce;                 //kernel of m_reduction
+    QVector<double> m_reducedReal;                          //one value per step, reused between frames
+    QVector<double> m_reducedImaginary;
+};
+
+#endif // FRAMEASSEMBLER_H
@@ -0,0 +1,91 @@
+#include "framelockengine.h"
+#include "sequencetracker.h"
+
+FrameLockEngine::FrameLockEngine()
+    : m_sequence(CoilSequence::default16Coils())
+{
+}
+
+/**
+ * @brief FrameLockEngine::setSequence
+ * Called when a new sensing/excitation sequence is sent, the frame length follows the sequence
+ */
+void FrameLockEngine::setSequence(const CoilSequence &sequence)
+{
+    m_sequence = sequence;
+    reset();
+}
+
+/**
+ * @brief FrameLockEngine::reset
+ * Forgets the current position, the next clean transition starts a new lock
+ */
+void FrameLockEngine::reset()
+{
+    m_state = Searching;
+    m_position = -1;
+    m_repetition = 0;
+    m_confirmations = 0;
+}
+
+void FrameLockEngine::dropTo(LockState state)
+{
+    if (m_state == Locked)
+        ++m_lockLosses;
+    m_state = state;
+    m_confirmations = 0;
+}
+
+/**
+ * @brief FrameLockEngine::onSample
+ * Places one sample in the frame. Samples flagged as reordered or with an unknown coil pair
+ * are not placed (-1) and do not move the lock.
+ * A transition is clean if it follows a full step and no records were lost right before it
+ */
+int FrameLockEngine::onSample(int sensingNibble, int excitationNibble, quint8 sampleFlags)
+{
+    const int size = m_sequence.size();
+    if (size == 0 || (sampleFlags & (SequenceTracker::SampleReordered | SequenceTracker::SampleUnknownState)))
+        return -1;
+
+    const int position = m_sequence.positionOf(sensingNibble, excitationNibble);
+    if (position < 0)
+        return -1;
+
+    const bool gapBefore = sampleFlags & SequenceTracker::SampleGapBefore;
+
+    if (m_state == Searching) {
+        const bool transition = m_position >= 0 && position != m_position;
+        m_position = position;
+        if (!transition || gapBefore)
+            return -1;
+        m_repetition = 0;
+        m_state = Verifying;
+        m_confirmations = 0;
+        return position * samplesPerState;
+    }
+
+    if (position == m_position) {
+        if (m_repetition + 1 < samplesPerState) {
+            ++m_repetition;
+            return position * samplesPerState + m_repetition;
+        }
+        //step runs longer than it should, the repetition phase was wrong
+        dropTo(Searching);
+        return -1;
+    }
+
+    const bool predicted = position == (m_position + 1) % size
+                           && m_repetition == samplesPerState - 1
+                           && !gapBefore;
+    m_position = position;
+    m_repetition = 0;
+
+    if (predicted) {
+        if (m_state == Verifying && ++m_confirmations >= confirmSteps)
+            m_state = Locked;
+    } else {
+        dropTo(Verifying);
+    }
+    return position * samplesPerState;
+}
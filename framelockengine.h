@@ -0,0 +1,57 @@
+#ifndef FRAMELOCKENGINE_H
+#define FRAMELOCKENGINE_H
+
+#include <QtGlobal>
+#include "coilsequence.h"
+
+/**
+ * @brief The FrameLockEngine class
+ *
+ * Always-on frame boundary lock, replaces the manual SYNC heuristic.
+ * Every (S,E) pair appears once in the programmed sequence, so a single sample gives its step,
+ * only its repetition (0-3 within the step) is unknown. The repetition is resolved at each
+ * clean step transition, which makes the position of every following sample in the frame known.
+ *      Searching   - waiting for a clean step transition
+ *      Verifying   - position assumed, waiting for confirmSteps predicted transitions in a row
+ *      Locked      - every transition so far matched the sequence
+ * An unexpected transition (e.g. after lost datagrams) drops back to Verifying and re-anchors on the
+ * new step straight away, a step running longer than samplesPerState restarts the search.
+ * O(1) per sample, nothing is buffered
+ */
+
+class FrameLockEngine
+{
+public:
+    enum LockState {
+        Searching = 0,
+        Verifying,
+        Locked
+    };
+
+    static const int samplesPerState = 4;                   //each step is reported 4 times in a row
+    static const int confirmSteps = 3;                      //predicted transitions needed to declare lock
+
+    FrameLockEngine();
+
+    void setSequence(const CoilSequence &sequence);         //new programmed sequence, restarts the search
+    void reset();                                           //drops the lock and searches again (SYNC button)
+
+    int onSample(int sensingNibble, int excitationNibble, quint8 sampleFlags);   //offset of this sample in the frame, -1 if unknown
+
+    const CoilSequence &sequence() const { return m_sequence; }
+    int frameLength() const { return m_sequence.size() * samplesPerState; }
+    LockState state() const { return m_state; }
+    qint64 lockLosses() const { return m_lockLosses; }      //times a held lock was lost
+
+private:
+    void dropTo(LockState state);
+
+    CoilSequence m_sequence;                                //programmed sequence to lock onto
+    LockState m_state = Searching;
+    int m_position = -1;                                    //step of the last sample, -1 if none yet
+    int m_repetition = 0;                                   //repetition of the last sample within its step
+    int m_confirmations = 0;                                //predicted transitions seen while verifying
+    qint64 m_lockLosses = 0;
+};
+
+#endif // FRAMELOCKENGINE_H
@@ -0,0 +1,286 @@
+#include "framestreamserver.h"
+#include "frameassembler.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QHostAddress>
+#include <QMutexLocker>
+#include <QMetaObject>
+#include <QDateTime>
+#include <QtEndian>
+#include <cstring>
+
+static const int recordHeaderSize = 48;
+static const double frequencyTolerance = 8.0;       //reported frequencies are within one F step of the programmed one
+
+FrameStreamServer::FrameStreamServer(PipelineMetrics *metrics, QObject *parent)
+    : QObject{parent}
+    , m_metrics(metrics)
+{
+}
+
+/**
+ * @brief FrameStreamServer::encode
+ * One record, see the class description for the layout
+ */
+QByteArray FrameStreamServer::encode(const QVector<QVector<double>> &frame, quint64 frameNumber, int instrument)
+{
+    const int rows = frame.size();
+    const int states = rows > 0 ? frame.first().size() : 0;
+    QByteArray record(recordHeaderSize + rows * states * int(sizeof(double)), Qt::Uninitialized);
+    uchar *out = reinterpret_cast<uchar *>(record.data());
+
+    const double frequency = rows > RowFrequency && states > 0 ? frame[RowFrequency].first() : 0.0;
+    const bool complete = rows > RowComplete && states > 0 && frame[RowComplete].first() != 0.0;
+    quint64 frequencyBits;
+    memcpy(&frequencyBits, &frequency, sizeof(double));
+
+    qToLittleEndian<quint32>(quint32(record.size() - 4), out);
+    memcpy(out + 4, "EMTF", 4);
+    qToLittleEndian<quint64>(frameNumber, out + 8);
+    qToLittleEndian<qint64>(QDateTime::currentMSecsSinceEpoch() * 1000000, out + 16);
+    qToLittleEndian<quint64>(frequencyBits, out + 24);
+    qToLittleEndian<quint32>(quint32(rows), out + 32);
+    qToLittleEndian<quint32>(quint32(states), out + 36);
+    qToLittleEndian<quint32>(complete ? 1u : 0u, out + 40);
+    qToLittleEndian<quint32>(quint32(instrument), out + 44);
+
+    out += recordHeaderSize;
+    for (const QVector<double> &row : frame) {
+        for (int state = 0; state < states; ++state) {
+            const double value = state < row.size() ? row.at(state) : 0.0;
+            quint64 bits;
+            memcpy(&bits, &value, sizeof(double));
+            qToLittleEndian<quint64>(bits, out);
+            out += sizeof(double);
+        }
+    }
+    return record;
+}
+
+/**
+ * @brief FrameStreamServer::submitFrame
+ * Encodes on dataConsumerThread (once, whatever the number of clients) and posts a single
+ * distributeFrames() per batch of frames. Nothing is done while there is no client
+ */
+void FrameStreamServer::submitFrame(const QVector<QVector<double>> &frame, int instrument)
+{
+    const quint64 frameNumber = m_frameNumber.fetchAndAddRelaxed(1);
+    if (m_clientCount.loadRelaxed() == 0 || frame.isEmpty())
+        return;
+
+    EncodedFrame encoded;
+    encoded.frequency = frame.size() > RowFrequency && !frame[RowFrequency].isEmpty()
+                        ? static_cast<qint64>(frame[RowFrequency].first()) : 0;
+    encoded.data = encode(frame, frameNumber, instrument);
+
+    QMutexLocker locker(&m_pendingMutex);
+    if (m_pending.size() >= maxPendingFrames) {
+        m_pending.removeFirst();                    //this thread is stalled, not a client
+        m_metrics->streamFramesDropped.fetchAndAddRelaxed(1);
+    }
+    m_pending.append(encoded);
+    if (!m_distributePosted) {
+        m_distributePosted = true;
+        QMetaObject::invokeMethod(this, [this](){ distributeFrames(); }, Qt::QueuedConnection);
+    }
+}
+
+/**
+ * @brief FrameStreamServer::start
+ * Localhost only, like the metrics endpoint. A stale Unix socket file of a previous run is removed
+ */
+void FrameStreamServer::start(quint16 port, const QString &socketName)
+{
+    stop();
+    if (!m_tcpServer) {
+        m_tcpServer = new QTcpServer(this);
+        connect(m_tcpServer, &QTcpServer::newConnection, this, &FrameStreamServer::onNewTcpConnection);
+        m_localServer = new QLocalServer(this);
+        connect(m_localServer, &QLocalServer::newConnection, this, &FrameStreamServer::onNewLocalConnection);
+    }
+
+    if (port != 0) {
+        if (m_tcpServer->listen(QHostAddress::LocalHost, port))
+            emit statusChanged("Frame stream on tcp://127.0.0.1:" + QString::number(port));
+        else
+            emit statusChanged("Frame stream failed on port " + QString::number(port) + ": " + m_tcpServer->errorString());
+    }
+    if (!socketName.isEmpty()) {
+        QLocalServer::removeServer(socketName);
+        if (m_localServer->listen(socketName))
+            emit statusChanged("Frame stream on local socket " + m_localServer->fullServerName());
+        else
+            emit statusChanged("Frame stream failed on local socket " + socketName + ": " + m_localServer->errorString());
+    }
+}
+
+void FrameStreamServer::stop()
+{
+    const bool listening = (m_tcpServer && m_tcpServer->isListening()) || (m_localServer && m_localServer->isListening());
+    if (m_tcpServer)
+        m_tcpServer->close();
+    if (m_localServer)
+        m_localServer->close();
+
+    const QList<QIODevice *> devices = m_clients.keys();
+    for (QIODevice *device : devices) {
+        removeClient(device);
+        device->close();
+    }
+    if (listening)
+        emit statusChanged("Frame stream stopped");
+}
+
+void FrameStreamServer::onNewTcpConnection()
+{
+    while (QTcpSocket *socket = m_tcpServer->nextPendingConnection()) {
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);   //writes are batched already
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket](){ removeClient(socket); });
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        addClient(socket);
+    }
+}
+
+void FrameStreamServer::onNewLocalConnection()
+{
+    while (QLocalSocket *socket = m_localServer->nextPendingConnection()) {
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket](){ removeClient(socket); });
+        connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        addClient(socket);
+    }
+}
+
+void FrameStreamServer::addClient(QIODevice *device)
+{
+    m_clients.insert(device, Client());
+    connect(device, &QIODevice::readyRead, this, [this, device](){ readSubscription(device); });
+    connect(device, &QIODevice::bytesWritten, this, [this, device](){
+        auto client = m_clients.find(device);
+        if (client != m_clients.end())
+            flush(device, client.value());
+    });
+    m_clientCount.storeRelaxed(m_clients.size());
+    m_metrics->streamClients.storeRelaxed(m_clients.size());
+}
+
+void FrameStreamServer::removeClient(QIODevice *device)
+{
+    if (m_clients.remove(device) == 0)
+        return;
+    disconnect(device, nullptr, this, nullptr);
+    m_clientCount.storeRelaxed(m_clients.size());
+    m_metrics->streamClients.storeRelaxed(m_clients.size());
+}
+
+/**
+ * @brief FrameStreamServer::readSubscription
+ * "SUBSCRIBE <frequency> <decimation>", other lines are ignored
+ */
+void FrameStreamServer::readSubscription(QIODevice *device)
+{
+    auto client = m_clients.find(device);
+    if (client == m_clients.end())
+        return;
+    client->request += device->readAll();
+
+    int end;
+    while ((end = client->request.indexOf('\n')) >= 0) {
+        const QList<QByteArray> words = client->request.left(end).simplified().split(' ');
+        client->request.remove(0, end + 1);
+        bool frequencyOk = false, decimationOk = false;
+        if (words.size() == 3 && words.at(0) == "SUBSCRIBE") {
+            const qint64 frequency = words.at(1).toLongLong(&frequencyOk);
+            const int decimation = words.at(2).toInt(&decimationOk);
+            if (frequencyOk && decimationOk && frequency >= 0 && decimation >= 1) {
+                client->frequency = frequency;
+                client->decimation = decimation;
+                client->matched = 0;
+            }
+        }
+    }
+    if (client->request.size() > maxRequestSize) {
+        removeClient(device);
+        device->close();
+    }
+}
+
+/**
+ * @brief FrameStreamServer::distributeFrames
+ * Queues the frames of each client's subscription. A full queue halves to make room and doubles the
+ * client's downsampling, a client already downsampled maxAdaptiveDecimation times is disconnected
+ */
+void FrameStreamServer::distributeFrames()
+{
+    QList<EncodedFrame> frames;
+    {
+        QMutexLocker locker(&m_pendingMutex);
+        frames.swap(m_pending);
+        m_distributePosted = false;
+    }
+
+    QList<QIODevice *> slowClients;
+    for (auto client = m_clients.begin(); client != m_clients.end(); ++client) {
+        for (const EncodedFrame &frame : qAsConst(frames)) {
+            if (client->frequency != 0 && qAbs(frame.frequency - client->frequency) > frequencyTolerance)
+                continue;
+            if (client->matched++ % quint64(client->decimation * client->adaptiveDecimation) != 0)
+                continue;
+
+            if (client->queue.size() >= maxQueuedFrames) {
+                if (client->adaptiveDecimation >= maxAdaptiveDecimation) {
+                    slowClients.append(client.key());
+                    break;
+                }
+                client->adaptiveDecimation *= 2;
+                const int dropped = client->queue.size() / 2;
+                client->queue.erase(client->queue.begin(), client->queue.begin() + dropped);
+                m_metrics->streamFramesDropped.fetchAndAddRelaxed(dropped);
+            }
+            client->queue.append(frame.data);
+        }
+        flush(client.key(), client.value());
+    }
+
+    for (QIODevice *device : qAsConst(slowClients)) {
+        removeClient(device);
+        device->close();
+        m_metrics->streamClientsDropped.fetchAndAddRelaxed(1);
+    }
+}
+
+/**
+ * @brief FrameStreamServer::flush
+ * Hands queued frames to the socket in one write, up to maxSocketBacklog bytes in flight.
+ * Also called when the socket has written data, a client that caught up is downsampled less
+ */
+void FrameStreamServer::flush(QIODevice *device, Client &client)
+{
+    qint64 room = maxSocketBacklog - device->bytesToWrite();
+    if (client.queue.isEmpty() || room <= 0)
+        return;
+
+    QByteArray batch;
+    int frames = 0;
+    while (frames < client.queue.size() && room > 0) {
+        room -= client.queue.at(frames).size();
+        ++frames;
+    }
+    if (frames == 1) {
+        batch = client.queue.first();               //no copy for a single frame
+    } else {
+        int size = 0;
+        for (int i = 0; i < frames; ++i)
+            size += client.queue.at(i).size();
+        batch.reserve(size);
+        for (int i = 0; i < frames; ++i)
+            batch += client.queue.at(i);
+    }
+    client.queue.erase(client.queue.begin(), client.queue.begin() + frames);
+    device->write(batch);
+    m_metrics->streamFramesSent.fetchAndAddRelaxed(frames);
+
+    if (client.adaptiveDecimation > 1 && client.queue.size() < maxQueuedFrames / 4)
+        client.adaptiveDecimation /= 2;
+}
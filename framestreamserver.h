@@ -0,0 +1,95 @@
+#ifndef FRAMESTREAMSERVER_H
+#define FRAMESTREAMSERVER_H
+
+#include <QObject>
+#include <QVector>
+#include <QList>
+#include <QHash>
+#include <QByteArray>
+#include <QMutex>
+#include <QAtomicInteger>
+#include "pipelinemetrics.h"
+
+class QTcpServer;
+class QLocalServer;
+class QIODevice;
+
+/**
+ * @brief The FrameStreamServer class
+ *
+ * Streams frames as length-prefixed binary records to local subscribers, on a localhost TCP port
+ * and/or a local socket (Unix domain socket, named pipe on Windows). Runs on its own thread
+ * (streamServerThread), dataConsumerThread only encodes each frame once and queues it.
+ *
+ * A client may send "SUBSCRIBE <frequency> <decimation>\n" at any time: only frames within 8 Hz of
+ * frequency (0 = all) are sent, every decimation-th of them (all frequencies, every frame by default).
+ * Each client has its own bounded queue. A client that cannot keep up is downsampled (its decimation
+ * doubles, frames queued for it are dropped) and disconnected if it still falls behind at
+ * maxAdaptiveDecimation, acquisition never waits for a client. Queued frames are written with one
+ * write per client and wake-up.
+ *
+ * Record (little endian): uint32 length (bytes after this field), char[4] "EMTF", uint64 frame number,
+ * int64 time (ns since the Unix epoch), double frequency, uint32 rows, uint32 states, uint32 complete,
+ * uint32 instrument (0-based session), then rows*states doubles, row-major in FrameRow order.
+ * Frames of all instrument sessions share the stream and its frame numbers
+ */
+
+class FrameStreamServer : public QObject
+{
+    Q_OBJECT
+public:
+    static const int maxPendingFrames = 256;        //frames between dataConsumerThread and this thread, oldest dropped
+    static const int maxQueuedFrames = 64;          //frames waiting for one client before it is downsampled
+    static const int maxAdaptiveDecimation = 16;    //downsampling of a slow client before it is disconnected
+    static const int maxSocketBacklog = 1 << 20;    //bytes written to a socket but not yet sent
+    static const int maxRequestSize = 1024;         //longest subscription line
+
+    explicit FrameStreamServer(PipelineMetrics *metrics, QObject *parent = nullptr);
+
+    void submitFrame(const QVector<QVector<double>> &frame, int instrument = 0);   //thread-safe, called on the dataConsumerThread of each session
+
+public slots:
+    void start(quint16 port, const QString &socketName);        //127.0.0.1:port if port != 0, local socket if name not empty
+    void stop();                                                //closes the servers and all clients
+
+signals:
+    void statusChanged(const QString &status);                  //to log listening state on GUI
+
+private slots:
+    void onNewTcpConnection();
+    void onNewLocalConnection();
+
+private:
+    struct Client {
+        QByteArray request;                         //partial subscription line
+        qint64 frequency = 0;                       //subscribed frequency, 0 = all
+        int decimation = 1;                         //requested, every decimation-th frame
+        int adaptiveDecimation = 1;                 //extra downsampling while the client is slow
+        quint64 matched = 0;                        //frames of the subscription seen
+        QList<QByteArray> queue;                    //encoded frames not yet written to the socket
+    };
+    struct EncodedFrame {
+        qint64 frequency;
+        QByteArray data;                            //shared by every client queue, encoded once
+    };
+
+    void addClient(QIODevice *device);
+    void removeClient(QIODevice *device);
+    void readSubscription(QIODevice *device);
+    void distributeFrames();                        //posted by submitFrame, queues new frames for the clients
+    void flush(QIODevice *device, Client &client);  //writes queued frames while the socket backlog allows
+    static QByteArray encode(const QVector<QVector<double>> &frame, quint64 frameNumber, int instrument);
+
+    PipelineMetrics *m_metrics;
+    QTcpServer *m_tcpServer = nullptr;              //created in start() so they belong to streamServerThread
+    QLocalServer *m_localServer = nullptr;
+    QHash<QIODevice *, Client> m_clients;
+    QAtomicInteger<int> m_clientCount{0};           //frames are not encoded while nobody listens
+    QAtomicInteger<quint64> m_frameNumber{0};       //frames submitted by all sessions
+
+    QMutex m_pendingMutex;                          //guards the two members below
+    QList<EncodedFrame> m_pending;                  //encoded, not yet distributed
+    bool m_distributePosted = false;                //a distributeFrames() call is queued
+};
+
+#endif // FRAMESTREAMSERVER_H
@@ -0,0 +1,51 @@
+#include "frequencyrouter.h"
+
+FrequencyRouter::FrequencyRouter(int capacity)
+    : m_frequencies(qMax(1, capacity), 0)
+{
+}
+
+void FrequencyRouter::setCapacity(int capacity)
+{
+    m_frequencies.fill(0, qMax(1, capacity));
+    reset();
+}
+
+/**
+ * @brief FrequencyRouter::route
+ * Index of the slot for this frequency, no allocation after construction
+ */
+int FrequencyRouter::route(qint64 frequency)
+{
+    if (m_count > 0 && m_frequencies.at(m_lastIndex) == frequency)
+        return m_lastIndex;
+    const int next = m_lastIndex + 1 < m_count ? m_lastIndex + 1 : 0;
+    if (m_count > 0 && m_frequencies.at(next) == frequency) {
+        m_lastIndex = next;
+        return next;
+    }
+
+    for (int i = 0; i < m_count; ++i) {
+        if (m_frequencies.at(i) == frequency) {
+            m_lastIndex = i;
+            return i;
+        }
+    }
+
+    if (m_count == m_frequencies.size())
+        return -1;
+
+    m_frequencies[m_count] = frequency;
+    m_lastIndex = m_count;
+    return m_count++;
+}
+
+/**
+ * @brief FrequencyRouter::reset
+ * Next records claim slots again from index 0
+ */
+void FrequencyRouter::reset()
+{
+    m_count = 0;
+    m_lastIndex = 0;
+}
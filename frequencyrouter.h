@@ -0,0 +1,37 @@
+#ifndef FREQUENCYROUTER_H
+#define FREQUENCYROUTER_H
+
+#include <QVector>
+
+/**
+ * @brief The FrequencyRouter class
+ *
+ * Maps the frequency field of a record to the index of its per-frequency stage
+ * (sequence tracker, frame assembler, ...), so interleaved multi-frequency records are split into
+ * one stream per frequency. Slots are claimed in order of appearance and kept until reset(),
+ * lookup is a linear scan over the claimed keys with the last hit tried first, then its successor
+ * (records of a long frequency table usually step through it in order)
+ */
+
+class FrequencyRouter
+{
+public:
+    static const int defaultFrequencies = 5;                //entries of the original F command
+
+    explicit FrequencyRouter(int capacity = defaultFrequencies);
+
+    void setCapacity(int capacity);                         //slots for a frequency table of this length, resets
+    int capacity() const { return m_frequencies.size(); }
+
+    int route(qint64 frequency);                            //slot of this frequency, claims a free one if new, -1 if all taken
+    void reset();                                           //frees all slots, e.g. after a new frequency configuration
+    int count() const { return m_count; }                   //slots in use
+    qint64 frequencyAt(int index) const { return m_frequencies.at(index); }
+
+private:
+    QVector<qint64> m_frequencies;                          //frequency of each claimed slot
+    int m_count = 0;
+    int m_lastIndex = 0;                                    //most records repeat the previous frequency
+};
+
+#endif // FREQUENCYROUTER_H
@@ -0,0 +1,59 @@
+#include "frequencytable.h"
+#include <QCoreApplication>
+#include <QSettings>
+#include <QStringList>
+#include <QtMath>
+
+QString FrequencyTable::settingsFilePath()
+{
+    return QCoreApplication::applicationDirPath() + "/EMT_IP.ini";
+}
+
+/**
+ * @brief FrequencyTable::encode
+ * Frequencies without a phase offset in the table use offset 0, entries past maxEntries are dropped
+ */
+QByteArray FrequencyTable::encode(const QVector<double> &frequencies, const QVector<quint16> &phaseOffsets)
+{
+    const int entries = qMin(frequencies.size(), int(maxEntries));
+    QByteArray command("F 0 0");
+    for (int i = 0; i < qMax(entries, int(defaultEntries)); ++i) {
+        quint32 joined = 0;
+        if (i < entries) {
+            const quint16 lo = static_cast<quint16>(qRound(frequencies.at(i) / 8.0));
+            const quint16 hi = i < phaseOffsets.size() ? phaseOffsets.at(i) : 0;
+            joined = (quint32(hi) << 16) | lo;
+        }
+        command += ' ';
+        command += QByteArray::number(joined);
+    }
+    return command;
+}
+
+/**
+ * @brief FrequencyTable::loadPhaseOffsets
+ * Missing key: the defaults 10,20,30,40,50 are written so the file can be edited.
+ * Values that are not 0-65535 are skipped with a warning
+ */
+QVector<quint16> FrequencyTable::loadPhaseOffsets(QString *warning, const QString &filePath)
+{
+    const QString path = filePath.isEmpty() ? settingsFilePath() : filePath;
+    QSettings settings(path, QSettings::IniFormat);
+    if (!settings.contains("FrequencyTable/PhaseOffsets"))
+        settings.setValue("FrequencyTable/PhaseOffsets", "10,20,30,40,50");
+
+    QVector<quint16> offsets;
+    //an unquoted list is read back as a QStringList, a quoted one as a single string
+    const QVariant setting = settings.value("FrequencyTable/PhaseOffsets");
+    const QStringList values = setting.userType() == QMetaType::QStringList
+            ? setting.toStringList() : setting.toString().split(',', Qt::SkipEmptyParts);
+    for (const QString &value : values) {
+        bool ok = false;
+        const uint offset = value.trimmed().toUInt(&ok);
+        if (ok && offset <= 0xFFFF)
+            offsets.append(static_cast<quint16>(offset));
+        else if (warning)
+            *warning = QString("Invalid phase offset '%1' in %2").arg(value.trimmed(), path);
+    }
+    return offsets;
+}
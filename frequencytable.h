@@ -0,0 +1,30 @@
+#ifndef FREQUENCYTABLE_H
+#define FREQUENCYTABLE_H
+
+#include <QVector>
+#include <QByteArray>
+#include <QString>
+
+/**
+ * @brief The FrequencyTable class
+ *
+ * Encodes the F command for any number of frequencies: "F 0 0 v1 v2 ... vN", each value being
+ * phase offset << 16 | round(frequency / 8). Tables shorter than defaultEntries are padded with 0
+ * so the usual five-entry command is unchanged. Phase offsets come from the configuration file
+ * (EMT_IP.ini next to the executable, [FrequencyTable] PhaseOffsets=10,20,...), written with the
+ * previous built-in defaults on first use
+ */
+
+class FrequencyTable
+{
+public:
+    static const int defaultEntries = 5;                    //entries of the original F command
+    static const int maxEntries = 256;                      //keeps the command well within one datagram
+
+    static QByteArray encode(const QVector<double> &frequencies, const QVector<quint16> &phaseOffsets);
+    //from filePath, EMT_IP.ini if empty
+    static QVector<quint16> loadPhaseOffsets(QString *warning = nullptr, const QString &filePath = QString());
+    static QString settingsFilePath();
+};
+
+#endif // FREQUENCYTABLE_H
@@ -0,0 +1,131 @@
+#include "heatmaprenderer.h"
+#include "frameassembler.h"
+#include "pipelinetrace.h"
+#include <QMutexLocker>
+#include <QtNumeric>
+#include <QtMath>
+
+/**
+ * @brief HeatMapRenderer::HeatMapRenderer
+ * Jet colormap (blue-cyan-yellow-red), computed once
+ */
+HeatMapRenderer::HeatMapRenderer(QObject *parent)
+    : QObject{parent}
+    , m_colormap(256)
+{
+    for (int i = 0; i < 256; ++i) {
+        const double t = 4.0 * i / 255.0;
+        const auto channel = [t](double centre) {
+            return qBound(0, qRound(255 * (1.5 - qAbs(t - centre))), 255);
+        };
+        m_colormap[i] = qRgb(channel(3.0), channel(2.0), channel(1.0));
+    }
+}
+
+void HeatMapRenderer::submitImage(const QVector<double> &values)
+{
+    const int side = qRound(qSqrt(values.size()));
+    if (side * side == values.size())
+        submit(values, side, side);
+    else
+        submit(values, values.size(), 1);
+}
+
+/**
+ * @brief HeatMapRenderer::submitFrame
+ * Row = sensing coil, column = excitation coil (coil 16 reported as 0), pairs not in the
+ * sequence stay NaN
+ */
+void HeatMapRenderer::submitFrame(const QVector<QVector<double>> &frame)
+{
+    QVector<double> matrix(16 * 16, qQNaN());
+    const int states = frame[RowState].size();
+    for (int i = 0; i < states; ++i) {
+        int S = static_cast<int>(frame[RowSensing][i]) & 0xF;
+        int E = static_cast<int>(frame[RowExcitation][i]) & 0xF;
+        S = S == 0 ? 15 : S - 1;
+        E = E == 0 ? 15 : E - 1;
+        const double real = frame[RowReal][i];
+        const double imaginary = frame[RowImaginary][i];
+        matrix[S * 16 + E] = qSqrt(real * real + imaginary * imaginary);
+    }
+    submit(matrix, 16, 16);
+}
+
+void HeatMapRenderer::submit(const QVector<double> &values, int width, int height)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_values = values;
+        m_width = width;
+        m_height = height;
+        m_valuesWaiting = true;
+    }
+    if (!m_scheduled.fetchAndStoreAcquire(true))
+        QMetaObject::invokeMethod(this, [this](){ renderLatest(); }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief HeatMapRenderer::renderLatest
+ * Maps each value to the colormap straight into the scanlines of the back buffer,
+ * then swaps it with the ready buffer
+ */
+void HeatMapRenderer::renderLatest()
+{
+    TRACE_SPAN("renderHeatMap");
+    int width, height;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_scheduled.storeRelease(false);
+        if (!m_valuesWaiting)
+            return;
+        m_valuesWaiting = false;
+        m_renderValues.swap(m_values);
+        width = m_width;
+        height = m_height;
+    }
+    if (width <= 0 || height <= 0 || m_renderValues.size() < width * height)
+        return;
+
+    double minimum = qInf();
+    double maximum = -qInf();
+    for (double value : qAsConst(m_renderValues)) {
+        if (qIsNaN(value))
+            continue;
+        minimum = qMin(minimum, value);
+        maximum = qMax(maximum, value);
+    }
+    const double scale = maximum > minimum ? 255.0 / (maximum - minimum) : 0.0;
+
+    if (m_backImage.width() != width || m_backImage.height() != height)
+        m_backImage = QImage(width, height, QImage::Format_RGB32);
+
+    const QRgb nanColour = qRgb(128, 128, 128);
+    const double *values = m_renderValues.constData();
+    for (int y = 0; y < height; ++y) {
+        QRgb *line = reinterpret_cast<QRgb *>(m_backImage.scanLine(y));
+        const double *row = values + y * width;
+        for (int x = 0; x < width; ++x) {
+            const double value = row[x];
+            line[x] = qIsNaN(value) ? nanColour : m_colormap[qBound(0, int((value - minimum) * scale), 255)];
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_backImage.swap(m_readyImage);
+    m_imageWaiting = true;
+}
+
+/**
+ * @brief HeatMapRenderer::takeImage
+ * Called by the view on the GUI thread, its previous image becomes the next back buffer
+ */
+bool HeatMapRenderer::takeImage(QImage &image)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_imageWaiting)
+        return false;
+    image.swap(m_readyImage);
+    m_imageWaiting = false;
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef HEATMAPRENDERER_H
+#define HEATMAPRENDERER_H
+
+#include <QObject>
+#include <QImage>
+#include <QVector>
+#include <QMutex>
+#include <QAtomicInteger>
+
+/**
+ * @brief The HeatMapRenderer class
+ *
+ * Colormaps a grid of values into a QImage on its own thread (renderThread), the GUI thread only
+ * swaps the finished image out with takeImage() and blits it (HeatMapView).
+ * Values come in through submitImage()/submitFrame() from the producing thread, only the latest
+ * submission is kept. Three QImage buffers rotate between renderer and view, so steady-state
+ * rendering writes scanlines in place without allocating.
+ * Colour scale is the min/max of each grid, NaN is drawn grey
+ */
+
+class HeatMapRenderer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit HeatMapRenderer(QObject *parent = nullptr);
+
+    //thread-safe, called on the producing thread
+    void submitImage(const QVector<double> &values);            //reconstructed image, square grid if P is a square
+    void submitFrame(const QVector<QVector<double>> &frame);    //16 x 16 sensing/excitation matrix of |I + jQ|
+
+    bool takeImage(QImage &image);                              //thread-safe, swaps in the newest image, false if none
+
+private:
+    void submit(const QVector<double> &values, int width, int height);
+    void renderLatest();                                        //runs on renderThread
+
+    QVector<QRgb> m_colormap;                                   //256 entries
+
+    QMutex m_mutex;                                             //guards submission and m_readyImage
+    QVector<double> m_values;                                   //latest submission
+    int m_width = 0;
+    int m_height = 0;
+    bool m_valuesWaiting = false;
+    QAtomicInteger<bool> m_scheduled{false};
+
+    QVector<double> m_renderValues;                             //submission being rendered, renderThread only
+    QImage m_backImage;                                         //being written, renderThread only
+    QImage m_readyImage;                                        //finished, waiting for the view
+    bool m_imageWaiting = false;
+};
+
+#endif // HEATMAPRENDERER_H
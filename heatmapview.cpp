@@ -0,0 +1,44 @@
+#include "heatmapview.h"
+#include "heatmaprenderer.h"
+#include <QPainter>
+
+HeatMapView::HeatMapView(QWidget *parent)
+    : QWidget{parent}
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &HeatMapView::onRefreshTimeout);
+    setMaximumRefreshRate(60);
+}
+
+void HeatMapView::setRenderer(HeatMapRenderer *renderer)
+{
+    m_renderer = renderer;
+    if (m_renderer)
+        m_refreshTimer.start();
+    else
+        m_refreshTimer.stop();
+}
+
+void HeatMapView::setMaximumRefreshRate(int framesPerSecond)
+{
+    m_refreshTimer.setTimerType(Qt::PreciseTimer);
+    m_refreshTimer.setInterval(1000 / qMax(1, framesPerSecond));
+}
+
+void HeatMapView::onRefreshTimeout()
+{
+    if (isVisible() && m_renderer && m_renderer->takeImage(m_image))
+        update();
+}
+
+void HeatMapView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    if (m_image.isNull()) {
+        painter.fillRect(rect(), Qt::black);
+        return;
+    }
+    painter.setRenderHint(QPainter::SmoothPixmapTransform, false);
+    painter.drawImage(rect(), m_image);
+}
@@ -0,0 +1,38 @@
+#ifndef HEATMAPVIEW_H
+#define HEATMAPVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <QTimer>
+
+class HeatMapRenderer;
+
+/**
+ * @brief The HeatMapView class
+ *
+ * Shows the images of a HeatMapRenderer. A timer capped at the refresh rate swaps in the newest
+ * image and repaints, the paint event only blits (nearest-neighbour scaling), colormapping
+ * happens on the renderer thread
+ */
+
+class HeatMapView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit HeatMapView(QWidget *parent = nullptr);
+
+    void setRenderer(HeatMapRenderer *renderer);
+    void setMaximumRefreshRate(int framesPerSecond);            //default 60
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+
+private:
+    void onRefreshTimeout();                                    //takes a new image if one is ready
+
+    HeatMapRenderer *m_renderer = nullptr;
+    QImage m_image;                                             //image on screen, handed back to the renderer on swap
+    QTimer m_refreshTimer;
+};
+
+#endif // HEATMAPVIEW_H
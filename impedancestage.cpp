@@ -0,0 +1,93 @@
+#include "impedancestage.h"
+#include "frameassembler.h"
+#include <QtNumeric>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMPEDANCESTAGE_SSE2
+#endif
+
+/**
+ * @brief ImpedanceStage::setReference
+ * Reference states with zero magnitude give NaN normalised values instead of infinities
+ */
+void ImpedanceStage::setReference(const QVector<double> &real, const QVector<double> &imaginary)
+{
+    m_referenceReal = real;
+    m_referenceImaginary = imaginary;
+    const int states = m_referenceReal.size();
+    m_referenceInverseNorm.resize(states);
+    for (int i = 0; i < states; ++i) {
+        const double norm = m_referenceReal[i] * m_referenceReal[i] + m_referenceImaginary[i] * m_referenceImaginary[i];
+        m_referenceInverseNorm[i] = norm > 0 ? 1.0 / norm : qQNaN();
+    }
+}
+
+void ImpedanceStage::clearReference()
+{
+    m_referenceReal.clear();
+    m_referenceImaginary.clear();
+    m_referenceInverseNorm.clear();
+}
+
+/**
+ * @brief ImpedanceStage::process
+ * magnitude = sqrt(I^2 + Q^2), phase = atan2(Q, I) in radians,
+ * normalised = (I + jQ)/(Ir + jQr) = ((I*Ir + Q*Qr) + j(Q*Ir - I*Qr)) / (Ir^2 + Qr^2).
+ * Missing states (NaN) stay NaN in every derived row
+ */
+void ImpedanceStage::process(QVector<QVector<double>> &frame) const
+{
+    const QVector<double> &realRow = frame[RowReal];
+    const QVector<double> &imaginaryRow = frame[RowImaginary];
+    const int states = realRow.size();
+    const bool normalise = m_referenceReal.size() == states;    //reference from another sequence is not used
+
+    QVector<double> magnitude(states);
+    QVector<double> phase(states);
+    QVector<double> normalizedReal(states, qQNaN());
+    QVector<double> normalizedImaginary(states, qQNaN());
+
+    const double *I = realRow.constData();
+    const double *Q = imaginaryRow.constData();
+    const double *Ir = m_referenceReal.constData();
+    const double *Qr = m_referenceImaginary.constData();
+    const double *inverseNorm = m_referenceInverseNorm.constData();
+    double *mag = magnitude.data();
+    double *nr = normalizedReal.data();
+    double *ni = normalizedImaginary.data();
+
+    int i = 0;
+#ifdef IMPEDANCESTAGE_SSE2
+    for (; i + 2 <= states; i += 2) {
+        const __m128d vi = _mm_loadu_pd(I + i);
+        const __m128d vq = _mm_loadu_pd(Q + i);
+        _mm_storeu_pd(mag + i, _mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(vi, vi), _mm_mul_pd(vq, vq))));
+        if (normalise) {
+            const __m128d vir = _mm_loadu_pd(Ir + i);
+            const __m128d vqr = _mm_loadu_pd(Qr + i);
+            const __m128d vinv = _mm_loadu_pd(inverseNorm + i);
+            const __m128d re = _mm_add_pd(_mm_mul_pd(vi, vir), _mm_mul_pd(vq, vqr));
+            const __m128d im = _mm_sub_pd(_mm_mul_pd(vq, vir), _mm_mul_pd(vi, vqr));
+            _mm_storeu_pd(nr + i, _mm_mul_pd(re, vinv));
+            _mm_storeu_pd(ni + i, _mm_mul_pd(im, vinv));
+        }
+    }
+#endif
+    //remainder, or every state without SSE2
+    for (; i < states; ++i) {
+        mag[i] = std::sqrt(I[i] * I[i] + Q[i] * Q[i]);
+        if (normalise) {
+            nr[i] = (I[i] * Ir[i] + Q[i] * Qr[i]) * inverseNorm[i];
+            ni[i] = (Q[i] * Ir[i] - I[i] * Qr[i]) * inverseNorm[i];
+        }
+    }
+    for (i = 0; i < states; ++i)
+        phase[i] = std::atan2(Q[i], I[i]);
+
+    frame.resize(DerivedFrameRowCount);
+    frame[RowMagnitude] = magnitude;
+    frame[RowPhase] = phase;
+    frame[RowNormalizedReal] = normalizedReal;
+    frame[RowNormalizedImaginary] = normalizedImaginary;
+}
@@ -0,0 +1,31 @@
+#ifndef IMPEDANCESTAGE_H
+#define IMPEDANCESTAGE_H
+
+#include <QVector>
+
+/**
+ * @brief The ImpedanceStage class
+ *
+ * Optional stage run on dataConsumerThread after a frame is built. Appends magnitude, phase and
+ * reference-normalised real/imaginary rows (RowMagnitude ... RowNormalizedImaginary) to the frame,
+ * so the saved file no longer needs post-processing. Normalisation is the complex division of each
+ * state by the same state of the reference (ReferenceCalibration mean), NaN until a reference is set.
+ * Magnitude and normalisation run two states per SSE2 instruction, phase uses std::atan2
+ */
+
+class ImpedanceStage
+{
+public:
+    void setReference(const QVector<double> &real, const QVector<double> &imaginary);     //one value per state
+    void clearReference();
+    bool hasReference() const { return !m_referenceReal.isEmpty(); }
+
+    void process(QVector<QVector<double>> &frame) const;            //appends the derived rows
+
+private:
+    QVector<double> m_referenceReal;
+    QVector<double> m_referenceImaginary;
+    QVector<double> m_referenceInverseNorm;                         //1/(Ir^2 + Qr^2), computed once per reference
+};
+
+#endif // IMPEDANCESTAGE_H
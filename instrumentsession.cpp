@@ -0,0 +1,227 @@
+#include "instrumentsession.h"
+#include "processingdata.h"
+#include "dataconsumer.h"
+#include "sharedbuffer.h"
+#include "pipelinemetrics.h"
+#include "pipelinetrace.h"
+#include "commandchannel.h"
+#include "coilsequence.h"
+
+#include <QUdpSocket>
+#include <QThread>
+#include <QMetaObject>
+
+/**
+ * @brief InstrumentSession::InstrumentSession
+ * Workers are created here so their signals can be connected before start(),
+ * the first instrument keeps the historical thread names, the others get their number appended
+ */
+InstrumentSession::InstrumentSession(int index, const InstrumentEndpoint &endpoint, QObject *parent)
+    : QObject{parent}
+    , m_index(index)
+    , m_endpoint(endpoint)
+    , m_messageSocket(new QUdpSocket(this))
+    , m_dataSocket(new QUdpSocket(this))
+    , m_sharedBuffer(new SharedBuffer())
+    , m_metrics(new PipelineMetrics())
+{
+    const QString suffix = index > 0 ? QString::number(index + 1) : QString();
+
+    //commands go out on the data socket, replies on the message socket acknowledge them
+    m_commandChannel = new CommandChannel(m_dataSocket, m_metrics, this);
+    m_commandChannel->setDestination(endpoint.instrumentAddress, endpoint.instrumentPort);
+
+    m_processingData = new ProcessingData(m_sharedBuffer, m_metrics);
+    m_processingDataThread = new QThread(this);
+    m_processingDataThread->setObjectName("processingDataThread" + suffix);
+    m_processingData->moveToThread(m_processingDataThread);
+    connect(m_processingDataThread, &QThread::finished, m_processingData, &QObject::deleteLater);
+    connect(m_processingDataThread, &QThread::started, this, [this](){
+        tuneCurrentThread(m_processingTuning, &m_metrics->processingCpu);
+        m_processingData->setDecodeTuning(m_processingTuning);     //decoder helpers share the priority, not the CPU
+    }, Qt::DirectConnection);
+
+    m_dataConsumer = new DataConsumer(m_sharedBuffer, m_metrics);
+    m_dataConsumerThread = new QThread(this);
+    m_dataConsumerThread->setObjectName("dataConsumerThread" + suffix);
+    m_dataConsumer->moveToThread(m_dataConsumerThread);
+    connect(m_dataConsumerThread, &QThread::finished, m_dataConsumer, &QObject::deleteLater);
+    connect(m_dataConsumerThread, &QThread::started, this, [this](){
+        tuneCurrentThread(m_consumerTuning, &m_metrics->consumerCpu);
+    }, Qt::DirectConnection);
+    connect(m_dataConsumer, &DataConsumer::processedChunkResult, this, [this](const QVector<QVector<double>> &frame){
+        emit frameReady(m_index, frame);
+    });
+
+    connect(m_messageSocket, &QUdpSocket::readyRead, this, &InstrumentSession::handleIncomingMessage);
+    connect(m_dataSocket, &QUdpSocket::readyRead, this, &InstrumentSession::handleDatagram);
+}
+
+/**
+ * @brief InstrumentSession::~InstrumentSession
+ * Owners stop every session before the stages fed from dataConsumerThread, the buffer and
+ * metrics go last
+ */
+InstrumentSession::~InstrumentSession()
+{
+    stop();
+    if (!m_started) {
+        delete m_processingData;
+        delete m_dataConsumer;
+    }
+    delete m_sharedBuffer;
+    delete m_metrics;
+}
+
+QString InstrumentSession::name() const
+{
+    return QString("instrument %1").arg(m_index + 1);
+}
+
+bool InstrumentSession::bind(QString *error)
+{
+    QUdpSocket *sockets[] = {m_messageSocket, m_dataSocket};
+    const quint16 ports[] = {m_endpoint.messagePort, m_endpoint.dataPort};
+    for (int i = 0; i < 2; ++i) {
+        if (sockets[i]->state() == QAbstractSocket::BoundState)
+            continue;
+        if (!sockets[i]->bind(m_endpoint.localAddress, ports[i])) {
+            if (error)
+                *error = QString("Binding failed to %1:%2 because: %3").arg(m_endpoint.localAddress.toString()).arg(ports[i]).arg(sockets[i]->errorString());
+            return false;
+        }
+    }
+    return true;
+}
+
+bool InstrumentSession::rebindMessages(quint16 port, QString *error)
+{
+    m_messageSocket->close();
+    m_endpoint.messagePort = port;
+    if (m_messageSocket->bind(m_endpoint.localAddress, port))
+        return true;
+    if (error)
+        *error = m_messageSocket->errorString();
+    return false;
+}
+
+void InstrumentSession::setThreadTuning(const ThreadTuning::Settings &processing, const ThreadTuning::Settings &consumer)
+{
+    m_processingTuning = processing;
+    m_consumerTuning = consumer;
+}
+
+/**
+ * @brief InstrumentSession::tuneCurrentThread
+ * Runs on the worker thread itself as it starts, before its first event (QThread has no native
+ * handle to tune it from outside), refusals leave the thread running with default scheduling
+ */
+void InstrumentSession::tuneCurrentThread(const ThreadTuning::Settings &settings, QAtomicInteger<int> *cpuGauge)
+{
+    if (!settings.isRequested())
+        return;
+    ThreadTuning::Applied applied;
+    const QString report = ThreadTuning::applyToCurrentThread(settings, &applied);
+    cpuGauge->storeRelaxed(applied.cpu);
+    if (applied.realtime)
+        m_metrics->realtimeThreads.fetchAndAddRelaxed(1);
+    emit threadTuned(m_index, report);
+}
+
+void InstrumentSession::start()
+{
+    if (m_started)
+        return;
+    m_started = true;
+    m_processingDataThread->start();
+    m_arrivalClock.start();
+    QMetaObject::invokeMethod(m_dataConsumer, "processBuffers", Qt::QueuedConnection);     //blocking loop of dataConsumerThread
+    m_dataConsumerThread->start();
+}
+
+/**
+ * @brief InstrumentSession::stop
+ * Same order as before sessions: the consumer loop is told to stop, then both threads are joined
+ */
+void InstrumentSession::stop()
+{
+    if (!m_started || m_dataConsumerThread->isFinished())
+        return;
+    m_dataConsumer->stop();
+    m_processingDataThread->requestInterruption();
+    m_processingDataThread->quit();
+    m_processingDataThread->wait();
+    m_dataConsumerThread->requestInterruption();
+    m_dataConsumerThread->quit();
+    m_dataConsumerThread->wait();
+}
+
+/**
+ * @brief InstrumentSession::setCoilSequence
+ * The trackers of processingDataThread and the frame lock of dataConsumerThread follow the same sequence
+ */
+void InstrumentSession::setCoilSequence(const CoilSequence &sequence)
+{
+    ProcessingData *processor = m_processingData;
+    QMetaObject::invokeMethod(m_processingData, [processor, sequence](){
+        processor->setCoilSequence(sequence);
+    }, Qt::QueuedConnection);
+    m_dataConsumer->setCoilSequence(sequence);
+}
+
+/**
+ * @brief InstrumentSession::resetFrequencies
+ * Records are split per frequency, the new frequencies claim the trackers and frame assemblers,
+ * one per table entry
+ */
+void InstrumentSession::resetFrequencies(int frequencies)
+{
+    ProcessingData *processor = m_processingData;
+    QMetaObject::invokeMethod(m_processingData, [processor, frequencies](){ processor->resetFrequencies(frequencies); }, Qt::QueuedConnection);
+    m_dataConsumer->resetFrequencies(frequencies);
+}
+
+void InstrumentSession::setDecodeThreads(int threads)
+{
+    ProcessingData *processor = m_processingData;
+    QMetaObject::invokeMethod(m_processingData, [processor, threads](){ processor->setDecodeThreads(threads); }, Qt::QueuedConnection);
+}
+
+void InstrumentSession::handleIncomingMessage()
+{
+    while (m_messageSocket->hasPendingDatagrams()) {
+        QByteArray buffer;
+        buffer.resize(int(m_messageSocket->pendingDatagramSize()));
+        QHostAddress sender;
+        quint16 senderPort;
+        m_messageSocket->readDatagram(buffer.data(), buffer.size(), &sender, &senderPort);
+        m_commandChannel->onMessage(buffer);            //acknowledges the matching command in flight
+        emit messageReceived(m_index, "Received from " + sender.toString() + ":" + QString::number(senderPort) + "->" + QString(buffer));
+    }
+}
+
+/**
+ * @brief InstrumentSession::handleDatagram
+ * Reads every pending datagram and posts the whole batch to processingDataThread once
+ */
+void InstrumentSession::handleDatagram()
+{
+    TRACE_SPAN("handleDatagram");
+    QList<QByteArray> datagramList;
+    QVector<qint64> arrivalNs;      //receive time of each datagram, for jitter statistics
+    while (m_dataSocket->hasPendingDatagrams()) {
+        qint64 pendingSize = m_dataSocket->pendingDatagramSize();
+        QByteArray buffer;
+        buffer.resize(pendingSize > 8192 ? 8192 : int(pendingSize));
+        m_dataSocket->readDatagram(buffer.data(), buffer.size());
+        arrivalNs.append(m_arrivalClock.nsecsElapsed());
+        datagramList.append(buffer);
+    }
+    if (datagramList.isEmpty())
+        return;
+
+    ProcessingData *processor = m_processingData;
+    QMetaObject::invokeMethod(m_processingData, [processor, datagramList, arrivalNs](){
+        processor->processDatagrams(datagramList, arrivalNs);
+    }, Qt::QueuedConnection);
+}
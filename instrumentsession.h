@@ -0,0 +1,87 @@
+#ifndef INSTRUMENTSESSION_H
+#define INSTRUMENTSESSION_H
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include "acquisitionconfig.h"
+#include "threadtuning.h"
+
+class QUdpSocket;
+class QThread;
+class SharedBuffer;
+class PipelineMetrics;
+class ProcessingData;
+class DataConsumer;
+class CommandChannel;
+class CoilSequence;
+
+/**
+ * @brief The InstrumentSession class
+ *
+ * The acquisition pipeline of one instrument: its message and data sockets, CommandChannel,
+ * SharedBuffer, PipelineMetrics, and its own processingDataThread and dataConsumerThread.
+ * MainWindow and AcquisitionDaemon run one session per configured instrument, sessions share
+ * nothing on the acquisition path, so each instrument adds its own pair of threads.
+ * Frames of every session reach the common writer through frameReady on the owner's thread,
+ * workers can be reached directly for displays and the frame hand-overs of dataConsumerThread
+ */
+
+class InstrumentSession : public QObject
+{
+    Q_OBJECT
+public:
+    InstrumentSession(int index, const InstrumentEndpoint &endpoint, QObject *parent = nullptr);
+    ~InstrumentSession();
+
+    bool bind(QString *error = nullptr);                    //binds both sockets, error says which one failed
+    bool rebindMessages(quint16 port, QString *error = nullptr);    //moves the message socket to another port
+    void setThreadTuning(const ThreadTuning::Settings &processing, const ThreadTuning::Settings &consumer);  //before start()
+    void start();                                           //starts the worker threads
+    void stop();                                            //stops and joins the worker threads, metrics stay readable
+
+    void setCoilSequence(const CoilSequence &sequence);     //both workers, after a sensing/excitation sequence command
+    void resetFrequencies(int frequencies);                 //both workers, after a frequency command
+    void setDecodeThreads(int threads);                     //threads of the processingDataThread decoder
+
+    int index() const { return m_index; }                   //0-based, shown as instrument index + 1
+    QString name() const;                                   //"instrument 2", for logs
+    const InstrumentEndpoint &endpoint() const { return m_endpoint; }
+    PipelineMetrics *metrics() const { return m_metrics; }
+    CommandChannel *commandChannel() const { return m_commandChannel; }
+    ProcessingData *processingData() const { return m_processingData; }
+    DataConsumer *dataConsumer() const { return m_dataConsumer; }
+
+signals:
+    void messageReceived(const int &instrument, const QString &message);   //instrument messages, for the log
+    void frameReady(const int &instrument, const QVector<QVector<double>> &frame);  //processedChunkResult, queued to the owner
+    void threadTuned(const int &instrument, const QString &report);         //affinity/priority outcome of a worker thread, for the log
+
+private slots:
+    void handleIncomingMessage();                           //instrument messages, acknowledge commands
+    void handleDatagram();                                  //instrument data, posted to processingDataThread
+
+private:
+    void tuneCurrentThread(const ThreadTuning::Settings &settings, QAtomicInteger<int> *cpuGauge);
+
+    int m_index;
+    InstrumentEndpoint m_endpoint;
+
+    QUdpSocket *m_messageSocket;                            //instrument messages
+    QUdpSocket *m_dataSocket;                               //instrument data, commands go out from here
+    CommandChannel *m_commandChannel;
+    QElapsedTimer m_arrivalClock;                           //receive timestamps of instrument datagrams
+
+    SharedBuffer *m_sharedBuffer;
+    PipelineMetrics *m_metrics;
+    ProcessingData *m_processingData;
+    QThread *m_processingDataThread;
+    DataConsumer *m_dataConsumer;
+    QThread *m_dataConsumerThread;
+    ThreadTuning::Settings m_processingTuning;              //applied by each thread as it starts
+    ThreadTuning::Settings m_consumerTuning;
+    bool m_started = false;                                 //workers are deleted with their threads once started
+};
+
+#endif // INSTRUMENTSESSION_H
@@ -2,7 +2,20 @@
 #include "ui_mainwindow.h"
 #include "processingdata.h"
 #include "dataconsumer.h"
-#include "sharedbuffer.h"
+#include "instrumentsession.h"
+#include "pipelinetrace.h"
+#include "pipelinemetrics.h"
+#include "metricsserver.h"
+#include "reconstructionengine.h"
+#include "heatmaprenderer.h"
+#include "sweepcampaign.h"
+#include "commandchannel.h"
+#include "frequencytable.h"
+#include "measurementfile.h"
+#include "sharedframering.h"
+#include "framestreamserver.h"
+#include "threadtuning.h"
+#include "coilsequence.h"
 
 #include <QDebug>
 #include <QByteArray>
@@ -16,6 +29,7 @@
 #include <QTimer>
 #include <QStringList>
 #include <QtMath>
+#include <QtNumeric>
 #include <QRegularExpression>
 #include <QtGlobal>
 #include <algorithm>
@@ -37,8 +51,6 @@
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)                    //allocate UI from Designer
-    , udpSocket(new QUdpSocket(this))           //create primary UDP socket
-    , udpSocketOut(new QUdpSocket(this))        //create secondary UDP socket
     , messageReceivedFlag(false)                //initiliases message flag to false
     , storedFrequencyConfiguration(0.0)         //default frequency configuration value
 {
@@ -48,41 +60,51 @@ MainWindow::MainWindow(QWidget *parent)
     //Clear any previous data in processing containers
     formattedChunks.clear();
     convertedIntegers.clear();
-    joinedValueArray.clear();
     global2DArray.clear();
     global2DArray.resize(6);
 
-    phaseOffsetArray << 10 << 20 << 30 << 40 << 50;                 //set up phase offset array
+    phaseOffsetArray = FrequencyTable::loadPhaseOffsets();          //phase offsets from EMT_IP.ini, defaults written on first run
+
+    //addresses and ports come from [Network] of EMT_IP.ini (192.168.1.2, instrument 192.168.1.10 by default),
+    //use 127.0.0.1 there for offline testing. Network/Instruments > 1 adds a session per instrument, [Instrument<n>]
+    QString configError;
+    if (!networkConfig.load(FrequencyTable::settingsFilePath(), &configError))
+        ui->outputMessageLog->append(configError + ", file ignored, defaults used");
+    ui->inputLocalPort->setValue(networkConfig.messagePort);
 
     localPort = static_cast<quint16>(ui->inputLocalPort->value());  //retrieve and store local port from UI control
 
     QTimer *processTimer = new QTimer(this);                        //redundant, may delete
 
-    //bind primary UDP socket for incoming message
-    //replace LocalHost below with ("192.168.1.2"), local port should be 4593 by default
-    //or use QHostAddress::LocalHost instead for offline testing
-    if (udpSocket -> bind(QHostAddress("192.168.1.2"), localPort)){
-        ui->outputMessageLog->append("Socket bound successfully to port: " + QString::number(localPort));
-    } else {
-        ui->outputMessageLog->append("Binding failed to port: " + QString::number(localPort) + "Because: " + udpSocket->errorString());
+    //one session (message socket, data socket, worker threads) per instrument, messages on 4593 and data on 4592 by default,
+    //commands go out from the data socket to the instrument port (4590)
+    for (int i = 0; i < networkConfig.instruments; ++i) {
+        InstrumentSession *session = new InstrumentSession(i, networkConfig.endpoint(i), this);
+        session->setThreadTuning({networkConfig.processingCpus.value(i, -1), networkConfig.realtimePriority},
+                                 {networkConfig.consumerCpus.value(i, -1), networkConfig.realtimePriority});     //[Threads] of EMT_IP.ini
+        session->setDecodeThreads(networkConfig.decodeThreadsPerInstrument());
+        session->commandChannel()->setAttempts(networkConfig.commandAttempts);
+        QString error;
+        if (session->bind(&error)) {
+            ui->outputMessageLog->append(QString("Sockets of %1 bound successfully to ports: %2, %3")
+                                         .arg(session->name()).arg(session->endpoint().messagePort).arg(session->endpoint().dataPort));
+        } else {
+            ui->outputMessageLog->append(session->name() + ": " + error);
+        }
+        connect(session, &InstrumentSession::messageReceived, this, [this](const int &instrument, const QString &message){
+            messageReceivedFlag = true;
+            ui->outputMessageLog->append(sessions.size() > 1 ? sessions.at(instrument)->name() + ": " + message : message);    //Log received message
+        });
+        connect(session, &InstrumentSession::frameReady, this, &MainWindow::onProcessedChunkResult);
+        connect(session, &InstrumentSession::threadTuned, this, [this](const int &instrument, const QString &report){
+            ui->outputMessageLog->append(sessions.size() > 1 ? sessions.at(instrument)->name() + ": " + report : report);
+        });
+        sessions.append(session);
     }
-
-    connect(udpSocket, &QUdpSocket::readyRead, this, &MainWindow::handleIncomingMessage);           //upate 'message when received
     connect(ui->buttonLog, &QPushButton::clicked, this, &MainWindow::onLogButtonClicked);           //logs message when LOG button clicked
     connect(ui->inputLocalPort, SIGNAL(valueChanged(int)), this, SLOT(updateLocalPort(int)));       //read 'Local Port' control when changed
 
-    //bind secondary UDP to port 4592, used to send EMT settings to port 4590
-    //replace LocalHost by "192.168.1.2", port should be 4592
-    //or use QHostAddress::LocalHost instead for offline testing
-    if (udpSocketOut -> bind(QHostAddress("192.168.1.2"), 4592)){
-        ui->outputMessageLog->append("Socket bound successfully to port: 4592");
-    } else {
-        ui->outputMessageLog->append("Binding failed: " + udpSocketOut->errorString());
-    }
-
-    connect(udpSocketOut, &QUdpSocket::readyRead, this, &MainWindow::handleDatagram);                                               //pass data to processingDataThread
-
-    //connect the four buttons that make use of the secondary UDP socket
+    //connect the four buttons that send commands to the instruments
     connect(ui->buttonSendConfiguration, &QPushButton::clicked, this, &MainWindow::onbuttonSendConfigurationclicked);               //send configuration settings when SEND CONFIGURATION clicked
     connect(ui->buttonSendFrequency, &QPushButton::clicked, this, &MainWindow::onbuttonSendFrequencyclicked);                       //send frequency settings when SEND FREQUENCY CONFIGURATION clicked
     connect(ui->buttonSendSendingSequence, &QPushButton::clicked, this, &MainWindow::onbuttonSendSensingSequenceclicked);           //send sensing sequence when SEND SENSING clicked
@@ -96,14 +118,38 @@ MainWindow::MainWindow(QWidget *parent)
     connect(ui->buttonStartFinalData, &QPushButton::clicked, this, &MainWindow::onbuttonStartFinalDataclicked);         //redundant
     connect(ui->buttonClearFinalData, &QPushButton::clicked, this, &MainWindow::onbuttonClearFinalDataclicked);         //redundant
     connect(ui->buttonSave, &QPushButton::clicked, this, &MainWindow::onbuttonSaveclicked);                             //prepares save file when SAVE clickd
-    connect(ui->buttonSync, &QPushButton::clicked, this, &MainWindow::onbuttonSyncclicked);                             //reorders data when SYNC clicked
-
-    sharedBuffer = new SharedBuffer();                                                                                  //to pass data between the two worker threads
+    connect(ui->buttonSync, &QPushButton::clicked, this, &MainWindow::onbuttonSyncclicked);                             //restarts frame lock search when SYNC clicked
+    connect(ui->checkBoxTrace, &QCheckBox::toggled, this, &MainWindow::oncheckBoxTracetoggled);                         //starts/stops recording pipeline spans
+    connect(ui->buttonSaveTrace, &QPushButton::clicked, this, &MainWindow::onbuttonSaveTraceclicked);                   //writes trace file when SAVE TRACE clicked
+    connect(ui->checkBoxMetrics, &QCheckBox::toggled, this, &MainWindow::oncheckBoxMetricstoggled);                     //starts/stops metrics endpoint
+    connect(ui->checkBoxImpedance, &QCheckBox::toggled, this, &MainWindow::oncheckBoxImpedancetoggled);                 //magnitude/phase columns on/off
+    connect(ui->buttonCaptureReference, &QPushButton::clicked, this, &MainWindow::onbuttonCaptureReferenceclicked);     //averages reference frames
+    connect(ui->buttonLoadReference, &QPushButton::clicked, this, &MainWindow::onbuttonLoadReferenceclicked);           //loads reference file
+    connect(ui->checkBoxSubtractReference, &QCheckBox::toggled, this, &MainWindow::oncheckBoxSubtractReferencetoggled); //differential frames on/off
+    QThread::currentThread()->setObjectName("mainThread");                                                              //thread names show up as tracks in the trace
+
+    //commands go out on the data socket of each session, replies on its message socket acknowledge them
+    for (InstrumentSession *session : qAsConst(sessions)) {
+        const QString prefix = sessions.size() > 1 ? session->name() + ": " : QString();
+        CommandChannel *channel = session->commandChannel();
+        connect(channel, &CommandChannel::acknowledged, this, [this, prefix](const int &id, const QString &description, const qint64 &rttUs, const int &attempts){
+            Q_UNUSED(id);
+            ui->outputMessageLog->append(QString("%1Instrument applied %2 (%3 ms, attempt %4)").arg(prefix, description).arg(rttUs / 1000.0, 0, 'f', 1).arg(attempts));
+        });
+        connect(channel, &CommandChannel::failed, this, [this, prefix](const int &id, const QString &description, const int &attempts){
+            Q_UNUSED(id);
+            ui->outputMessageLog->append(QString("%1No acknowledgement for %2 after %3 attempt(s)").arg(prefix, description).arg(attempts));
+        });
+        connect(channel, &CommandChannel::idle, this, [this, prefix, channel](const int &commands, const qint64 &elapsedMs){
+            ui->outputMessageLog->append(QString("%1Setup done: %2 command(s) in %3 ms, round trip %4 ms")
+                                         .arg(prefix).arg(commands).arg(elapsedMs).arg(channel->smoothedRttMs(), 0, 'f', 1));
+        });
+    }
 
-    processingData = new ProcessingData(sharedBuffer);
-    processingDataThread = new QThread(this);
-    processingData -> moveToThread(processingDataThread);                                                               //creates processingDataThread
-    connect(processingDataThread, &QThread::finished, processingData, &QObject::deleteLater);                           //ensures thread is deleted when terminated
+    //the first instrument drives the displays, reconstruction, heat maps, trends and sweep settling
+    processingData = sessions.first()->processingData();
+    dataConsumer = sessions.first()->dataConsumer();
+    pipelineMetrics = sessions.first()->metrics();          //also counts the stages shared by all sessions
 
     //various tasks carried out when different signals are emitted from the processingDataThread
     connect(processingData, &ProcessingData::booleanOTRUpdated, this, [this](const QString &status){
@@ -112,73 +158,249 @@ MainWindow::MainWindow(QWidget *parent)
     connect(processingData, &ProcessingData::numberADCUpdated, this, [this](const QString &modeADC){
         ui->outputADCLevel->setText(modeADC);
     });
+    connect(processingData, &ProcessingData::statusHistoryUpdated, this, [this](const int &adcMode, const double &otrRatePercent){
+        ui->outputADCModeHistory->display(adcMode);
+        ui->outputOTRRate->display(QString::number(otrRatePercent, 'f', 2));
+    });
+    connect(ui->inputStatusHistory, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int seconds){
+        processingData->m_statusHistorySeconds.storeRelaxed(seconds);
+    });
+    processingData->m_statusHistorySeconds.storeRelaxed(ui->inputStatusHistory->value());
+    //reorder jitter buffer of every session: depth bounds the records held, timeout the time they wait
+    connect(ui->inputReorderDepth, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int records){
+        for (InstrumentSession *session : qAsConst(sessions))
+            session->processingData()->m_reorderDepth.storeRelaxed(records);
+    });
+    connect(ui->inputReorderTimeout, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int timeoutMs){
+        for (InstrumentSession *session : qAsConst(sessions))
+            session->processingData()->m_reorderTimeoutMs.storeRelaxed(timeoutMs);
+    });
+    for (InstrumentSession *session : qAsConst(sessions)) {
+        session->processingData()->m_reorderDepth.storeRelaxed(ui->inputReorderDepth->value());
+        session->processingData()->m_reorderTimeoutMs.storeRelaxed(ui->inputReorderTimeout->value());
+    }
     connect(processingData, &ProcessingData::samplesPacketUpdated, this, [this](const int &samplesPerPacket){
         ui->outputSamplesPackets->display(samplesPerPacket);
     });
     connect(processingData, &ProcessingData::rawDataUpdated, this, [this](const QString &rawDataStr){
         ui->outputRawData->append(rawDataStr);
     });
+    connect(processingData, &ProcessingData::sequenceStatsUpdated, this, [this](const qint64 &lostRecords, const qint64 &reorderedRecords, const double &jitterUs){
+        ui->outputLostRecords->display(static_cast<double>(lostRecords));
+        ui->outputReorderedRecords->display(static_cast<double>(reorderedRecords));
+        ui->outputArrivalJitter->display(qRound(jitterUs));
+    });
+    connect(processingData, &ProcessingData::statusChanged, ui->outputMessageLog, &QTextEdit::append);
+    connect(ui->buttonBenchmarkDecoding, &QPushButton::clicked, this, [this](){
+        if (processingData->startDecodeBenchmark())
+            ui->outputMessageLog->append("Running decoding benchmark...");
+        else
+            ui->outputMessageLog->append("Decoding benchmark already running");
+    });
 
-    processingDataThread->start();                                                                                      //strarts thread
-
-    dataConsumer = new DataConsumer(sharedBuffer);
-    dataConsumerThread = new QThread(this);
-    dataConsumer->moveToThread(dataConsumerThread);                                                                     //creates dataConsiderThread
-    connect(dataConsumerThread, &QThread::finished, dataConsumer, &QObject::deleteLater);                               //ensures thread is deleted when terminated
-
-    QMetaObject::invokeMethod(dataConsumer, "processBuffers", Qt::QueuedConnection);                                    //explicitly starts the function by posting the queued event on other thread
-
-    //various tasks carried out when different signals are emitted from the processingDataThread
-    connect(dataConsumer, &DataConsumer::processedChunkResult, this, &MainWindow::onProcessedChunkResult);
+    //various tasks carried out when different signals are emitted from the dataConsumerThread
     connect(dataConsumer, &DataConsumer::autoSyncUpdated, this, [this](const int &autoSyncValue){
         ui->outputAutoSync->display(autoSyncValue);
     });
     connect(dataConsumer, &DataConsumer::actualFrequencyUpdated, this, [this](const double &actualFrequencyVal){
         ui->outpuActualFrequency->display(actualFrequencyVal);
     });
-    dataConsumerThread->start();
+    connect(dataConsumer, &DataConsumer::lockStateUpdated, this, [this](const int &lockState, const qint64 &lockLosses){
+        static const char *const lockStateNames[] = {"SEARCHING", "VERIFYING", "LOCKED"};
+        ui->outputLockState->setText(QString("%1 (lost %2 times)").arg(lockStateNames[qBound(0, lockState, 2)]).arg(lockLosses));
+    });
+    connect(dataConsumer, &DataConsumer::referenceStatus, ui->outputMessageLog, &QTextEdit::append);
+    connect(dataConsumer, &DataConsumer::stateStatisticsUpdated, this, &MainWindow::onStateStatisticsUpdated);
+    connect(ui->inputSNRPackets, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int frames){
+        dataConsumer->m_statisticsWindow.storeRelaxed(qMax(1, frames));
+    });
+    dataConsumer->m_statisticsWindow.storeRelaxed(qMax(1, ui->inputSNRPackets->value()));
+    connect(ui->inputReductionKernel, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index){
+        for (InstrumentSession *session : qAsConst(sessions))
+            session->dataConsumer()->m_reductionKernel.storeRelaxed(index);    //combo order follows OversampleReduction::Kernel
+        ui->outputMessageLog->append(QString("Oversample reduction: %1").arg(OversampleReduction::name(OversampleReduction::Kernel(index))));
+    });
+    ui->outputStateStatistics->setColumnCount(StateStatistics::StatisticsRowCount);
+    ui->outputStateStatistics->setHorizontalHeaderLabels({"Mean I", "Std I", "Min I", "Max I",
+                                                          "Mean Q", "Std Q", "Min Q", "Max Q", "SNR (dB)"});
+    //frames of every session are also published to shared memory straight from its dataConsumerThread, when enabled
+    sharedFrameRing = new SharedFrameRing(pipelineMetrics, this);
+    QVector<PipelineMetrics *> sessionMetrics;
+    for (InstrumentSession *session : qAsConst(sessions)) {
+        SharedFrameRing *ring = sharedFrameRing;
+        const int instrument = session->index();
+        connect(session->dataConsumer(), &DataConsumer::processedChunkResult, ring, [ring, instrument](const QVector<QVector<double>> &frame){
+            ring->publish(frame, instrument);
+        }, Qt::DirectConnection);
+        sessionMetrics.append(session->metrics());
+    }
+    connect(ui->checkBoxSharedMemory, &QCheckBox::toggled, this, &MainWindow::oncheckBoxSharedMemorytoggled);
+
+    metricsServer = new MetricsServer(sessionMetrics);
+    metricsServerThread = new QThread(this);
+    metricsServerThread->setObjectName("metricsServerThread");
+    metricsServer->moveToThread(metricsServerThread);                                                                   //scrapes are served away from acquisition and GUI threads
+    connect(metricsServerThread, &QThread::finished, metricsServer, &QObject::deleteLater);
+    connect(metricsServer, &MetricsServer::statusChanged, this, [this](const QString &status){
+        ui->outputMessageLog->append(status);
+    });
+    metricsServerThread->start();
+
+    frameStreamServer = new FrameStreamServer(pipelineMetrics);
+    streamServerThread = new QThread(this);
+    streamServerThread->setObjectName("streamServerThread");
+    frameStreamServer->moveToThread(streamServerThread);                                                               //subscribers are served away from acquisition and GUI threads
+    connect(streamServerThread, &QThread::finished, frameStreamServer, &QObject::deleteLater);
+    for (InstrumentSession *session : qAsConst(sessions)) {
+        FrameStreamServer *server = frameStreamServer;
+        const int instrument = session->index();
+        connect(session->dataConsumer(), &DataConsumer::processedChunkResult, server, [server, instrument](const QVector<QVector<double>> &frame){
+            server->submitFrame(frame, instrument);
+        }, Qt::DirectConnection);
+    }
+    connect(frameStreamServer, &FrameStreamServer::statusChanged, ui->outputMessageLog, &QTextEdit::append);
+    connect(ui->checkBoxFrameStream, &QCheckBox::toggled, this, &MainWindow::oncheckBoxFrameStreamtoggled);
+    streamServerThread->start();
+
+    reconstructionEngine = new ReconstructionEngine(pipelineMetrics);
+    reconstructionThread = new QThread(this);
+    reconstructionThread->setObjectName("reconstructionThread");
+    reconstructionEngine->moveToThread(reconstructionThread);
+    connect(reconstructionThread, &QThread::finished, reconstructionEngine, &QObject::deleteLater);
+    connect(dataConsumer, &DataConsumer::processedChunkResult, reconstructionEngine, &ReconstructionEngine::submitFrame, Qt::DirectConnection);  //hand-over on dataConsumerThread, latest frame wins
+    connect(reconstructionEngine, &ReconstructionEngine::imageReady, this, &MainWindow::onImageReady);
+    connect(reconstructionEngine, &ReconstructionEngine::statusChanged, ui->outputMessageLog, &QTextEdit::append);
+    connect(ui->buttonLoadSensitivity, &QPushButton::clicked, this, &MainWindow::onbuttonLoadSensitivityclicked);
+    connect(ui->checkBoxReconstruction, &QCheckBox::toggled, this, [this](bool checked){
+        reconstructionEngine->m_enabled.storeRelease(checked);
+    });
+    connect(ui->inputReconstructionInput, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index){
+        reconstructionEngine->m_measurementRow.storeRelaxed(index == 1 ? RowImaginary : RowReal);
+    });
+    connect(ui->inputReconstructionMethod, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this](int index){
+        reconstructionEngine->m_method.storeRelaxed(index);         //combo order follows ReconstructionEngine::Method
+    });
+    connect(ui->inputIterations, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int iterations){
+        reconstructionEngine->m_maxIterations.storeRelaxed(iterations);
+    });
+    connect(ui->inputTimeBudget, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int budgetMs){
+        reconstructionEngine->m_timeBudgetUs.storeRelaxed(budgetMs * 1000);
+    });
+    reconstructionEngine->m_maxIterations.storeRelaxed(ui->inputIterations->value());
+    reconstructionEngine->m_timeBudgetUs.storeRelaxed(ui->inputTimeBudget->value() * 1000);
+    connect(ui->buttonBenchmarkReconstruction, &QPushButton::clicked, this, [this](){
+        ui->outputMessageLog->append("Running reconstruction benchmark...");
+        ReconstructionEngine *engine = reconstructionEngine;
+        QMetaObject::invokeMethod(reconstructionEngine, [engine](){ engine->runBenchmark(); }, Qt::QueuedConnection);
+    });
+    reconstructionThread->start();
+
+    //heat maps are colormapped on renderThread, views only swap and blit
+    imageRenderer = new HeatMapRenderer();
+    matrixRenderer = new HeatMapRenderer();
+    renderThread = new QThread(this);
+    renderThread->setObjectName("renderThread");
+    imageRenderer->moveToThread(renderThread);
+    matrixRenderer->moveToThread(renderThread);
+    connect(renderThread, &QThread::finished, imageRenderer, &QObject::deleteLater);
+    connect(renderThread, &QThread::finished, matrixRenderer, &QObject::deleteLater);
+    connect(reconstructionEngine, &ReconstructionEngine::imageReady, imageRenderer, &HeatMapRenderer::submitImage, Qt::DirectConnection);
+    connect(dataConsumer, &DataConsumer::processedChunkResult, matrixRenderer, &HeatMapRenderer::submitFrame, Qt::DirectConnection);
+    ui->outputImageView->setRenderer(imageRenderer);
+    ui->outputMatrixView->setRenderer(matrixRenderer);
+    renderThread->start();
+
+    //[Threads]: the main thread (sockets, commands, writer) is tuned here, the worker threads tune themselves as they start
+    if (networkConfig.mainCpu >= 0)
+        ui->outputMessageLog->append(ThreadTuning::applyToCurrentThread({networkConfig.mainCpu, 0}));
+    if (networkConfig.lockMemory) {
+        bool locked = false;
+        ui->outputMessageLog->append(ThreadTuning::lockMemory(&locked));
+        for (InstrumentSession *session : qAsConst(sessions))
+            session->metrics()->memoryLocked.storeRelaxed(locked ? 1 : 0);
+    }
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->start();                                   //every hand-over above is connected before the first frame
+
+    connect(ui->buttonApplyTrend, &QPushButton::clicked, this, &MainWindow::onbuttonApplyTrendclicked);
+    onbuttonApplyTrendclicked();
+
+    //frequency sweep: each step sends its frequencies, saves once they settle, then moves on
+    sweepCampaign = new SweepCampaign(pipelineMetrics, this);
+    connect(ui->buttonStartSweep, &QPushButton::clicked, this, &MainWindow::onbuttonStartSweepclicked);
+    connect(ui->buttonStopSweep, &QPushButton::clicked, sweepCampaign, &SweepCampaign::stop);
+    connect(sweepCampaign, &SweepCampaign::statusChanged, ui->outputMessageLog, &QTextEdit::append);
+    connect(sweepCampaign, &SweepCampaign::configureStep, this, [this](const int &step, const QVector<double> &frequencies){
+        Q_UNUSED(step);
+        ui->buttonSave->setEnabled(false);
+        frequencyArray = frequencies;
+        sendFrequencyConfiguration();
+    });
+    connect(sweepCampaign, &SweepCampaign::saveStep, this, [this](const int &step, const int &frames){
+        //step files are <name>_step<n>.<suffix>, several frequencies add _<frequency>Hz as usual
+        QFileInfo fileInfo(ui->inputMeasurementFilePath->toPlainText().trimmed());
+        QString fileName = fileInfo.completeBaseName() + "_step" + QString::number(step + 1);
+        if (!fileInfo.suffix().isEmpty())
+            fileName += "." + fileInfo.suffix();
+        if (!startSaving(fileInfo.absoluteDir().filePath(fileName), frames))
+            sweepCampaign->stop();
+    });
+    connect(sweepCampaign, &SweepCampaign::cancelSaving, this, [this](const int &step){
+        ui->outputMessageLog->append(QString("Saving of sweep step %1 stopped").arg(step + 1));
+        clear2DArray = true;
+        framesSaved = 0;
+        framesSavedPerFile.clear();
+    });
+    connect(sweepCampaign, &SweepCampaign::stepFinished, this, [this](const int &step, const qint64 &deadTimeMs, const qint64 &savingMs){
+        ui->outputSweepSteps->setItem(step, 2, new QTableWidgetItem(QString::number(deadTimeMs)));
+        ui->outputSweepSteps->setItem(step, 3, new QTableWidgetItem(QString::number(savingMs)));
+    });
+    connect(sweepCampaign, &SweepCampaign::finished, this, [this](const bool &completed){
+        Q_UNUSED(completed);
+        ui->buttonStartSweep->setEnabled(true);
+        ui->buttonSendFrequency->setEnabled(true);
+        ui->buttonSave->setEnabled(clear2DArray);
+    });
+    ui->outputSweepSteps->setColumnCount(4);
+    ui->outputSweepSteps->setHorizontalHeaderLabels({"Frequencies (Hz)", "Frames", "Dead Time (ms)", "Saving (ms)"});
+
+    //combined status of all instruments, refreshed from their metrics once per second
+    ui->outputInstrumentStatus->setColumnCount(10);
+    ui->outputInstrumentStatus->setHorizontalHeaderLabels({"Instrument", "Packets/s", "Packets", "Frames", "Incomplete",
+                                                           "Saved", "Lost Records", "Reordered", "Lock", "Buffer Depth"});
+    ui->outputInstrumentStatus->setRowCount(sessions.size());
+    lastInstrumentPackets.fill(0, sessions.size());
+    QTimer *instrumentStatusTimer = new QTimer(this);
+    connect(instrumentStatusTimer, &QTimer::timeout, this, &MainWindow::updateInstrumentStatus);
+    instrumentStatusTimer->start(1000);
+    updateInstrumentStatus();
 }
 
 //Destructor: clean up allocated resources and terminate all threds to prevent crashes and dangling threads
 MainWindow::~MainWindow()
 {
-    if(dataConsumer){
-        dataConsumer->stop();
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->stop();                        //no more frames for the stages below, metrics stay until the sessions are deleted
+    if (metricsServerThread) {
+        metricsServerThread->quit();
+        metricsServerThread->wait();
     }
-    if(processingDataThread){
-        processingDataThread->requestInterruption();
-        processingDataThread->quit();
-        processingDataThread->wait();
+    if (streamServerThread) {
+        streamServerThread->quit();
+        streamServerThread->wait();
     }
-    if (dataConsumerThread) {
-        dataConsumerThread->requestInterruption();
-        dataConsumerThread->quit();
-        dataConsumerThread->wait();
+    if (reconstructionThread) {
+        reconstructionThread->quit();
+        reconstructionThread->wait();
     }
-    delete sharedBuffer;
-    delete ui;
-}
-
-/*
- * handleIncomingMessage()
- * ------------------------------
- * Called when messages arrives on primary UDP socket
- * Reads all pending messages and logs them to UI
- */
-void MainWindow::handleIncomingMessage()
-{
-    messageReceivedFlag = true;
-
-    while(udpSocket->hasPendingDatagrams()){                                                                                                //While there are pending datagrams, process each
-        QByteArray buffer;
-        buffer.resize(int(udpSocket->pendingDatagramSize()));                                                                               //Resize buffer to size of incoming datagram
-
-        QHostAddress sender;                                                                                                                //Will hold sender's address
-        quint16 senderPort;                                                                                                                 //Will hold sender's port
-
-        udpSocket->readDatagram(buffer.data(),buffer.size(),&sender,&senderPort);                                                           //Read datagram into buffer
-        ui->outputMessageLog->append("Received from " + sender.toString() + ":" + QString::number(senderPort) + "->" + QString(buffer));    //Log received message
+    if (renderThread) {
+        ui->outputImageView->setRenderer(nullptr);
+        ui->outputMatrixView->setRenderer(nullptr);
+        renderThread->quit();
+        renderThread->wait();
     }
+    qDeleteAll(sessions);
+    delete ui;
 }
 
 /*
@@ -234,20 +456,19 @@ void MainWindow::onLogButtonClicked()
  * updateLocalPort()
  * ------------------------------
  * Called when user changes local port via UI
- * Update local port and rebinds primary UDP socket
+ * Update local port and rebinds the message socket of the first instrument
  */
 void MainWindow::updateLocalPort(int newPort)
 {
     //Update local port value
     localPort = static_cast<quint16>(newPort);
 
-    //Rebind primary UDP socket to new port
-    udpSocket->close();                                                     //Close current binding
-    //Replace LocalHost below with ("192.168.1.2"),
-    if (udpSocket -> bind(QHostAddress("192.168.1.2"), localPort)){
+    //Rebind message socket to new port
+    QString error;
+    if (sessions.first()->rebindMessages(localPort, &error)){
         ui->outputMessageLog->append("Socket bound successfully! to port: " + QString::number(localPort));
     } else {
-        ui->outputMessageLog->append("Binding failed: " + udpSocket->errorString());
+        ui->outputMessageLog->append("Binding failed: " + error);
     }
 }
 
@@ -303,12 +524,8 @@ void MainWindow::onbuttonSendConfigurationclicked()
                                     frequencyPeriodStr);
     QByteArray data = configurationDataStr.toUtf8();                                //convert to required UDP type
 
-    //replace IP by ("192.168.1.10")
-    //send configuration command via UDP
-    qint64 bytesSent = udpSocketOut->writeDatagram(data, QHostAddress("192.168.1.10"), 4590);
-    if(bytesSent == -1){
-        qDebug() << "Failed to send config data to port 4590:" << udpSocketOut->errorString();
-    }
+    //send configuration command via UDP, acknowledged/retried by the command channel of each instrument
+    sendCommand(data, "configuration");
 }
 
 /*
@@ -320,12 +537,9 @@ void MainWindow::onbuttonSendSensingSequenceclicked()
 {
     QString sequence = ui->inputSensingSequence->toPlainText();
     QByteArray data = sequence.toUtf8();
-    //Replace IP by ("192.168.1.10")
     //Send sensing sequence data via UDP
-    qint64 bytesSent = udpSocketOut->writeDatagram(data, QHostAddress("192.168.1.10"), 4590);
-    if(bytesSent == -1){
-        qDebug() << "Failed to send sensing data to port 4590:" << udpSocketOut->errorString();
-    }
+    sendCommand(data, "sensing sequence");
+    updateCoilSequence();
 
 }
 
@@ -338,12 +552,9 @@ void MainWindow::onbuttonSendExcitationSequenceclicked()
 {
     QString sequence = ui->inputExcitationSequence->toPlainText();
     QByteArray data = sequence.toUtf8();
-    //Replace IP by ("192.168.1.10")
     //Send excitation sequence data via UDP
-    qint64 bytesSent = udpSocketOut->writeDatagram(data, QHostAddress("192.168.1.10"), 4590);
-    if(bytesSent == -1){
-        qDebug() << "Failed to send excitation data to port 4590:" << udpSocketOut->errorString();
-    }
+    sendCommand(data, "excitation sequence");
+    updateCoilSequence();
 }
 
 /*
@@ -368,57 +579,38 @@ void MainWindow::onbuttonSendFrequencyclicked()
         else
             qDebug() <<"Conversion failed for frequency: " + individualFrequency;
     }
+    sendFrequencyConfiguration();
+}
 
-    //Log input frequencies
-    QStringList frequencyStrList;
-    for (double d : frequencyArray)
-        frequencyStrList << QString::number(d);
-    //ui->outputMessageLog->append("Frequency Array: " + frequencyStrList.join(","));
-
-    //Process each frequency: divide by 8, round, and convert to quint16
-    QVector<quint16>frequencyArrayIntlo;
-    for (double freq : frequencyArray){
-        frequencyArrayIntlo.append(static_cast<quint16>(qRound(freq/8.0)));
-    }
-
-    //Log lo values
-    QStringList loList;
-    for (quint16 v : frequencyArrayIntlo)
-        loList << QString::number(v);
-    //ui->outputMessageLog->append("Processed Frequencies (lo values): " + loList.join(","));
-
-    //Create joinedValueArray by joining each processed frequecy with its corresponding hi value
-    //hi taken from phaseOffsetArray; if there are more frequencies than hi values,
-    //only join as many as available in phaseOffsetArray
-    joinedValueArray.clear();
-    int joinCount = qMin(frequencyArrayIntlo.size(),phaseOffsetArray.size());
-    for (int i = 0; i < joinCount; ++i){
-        quint32 joined = (static_cast<quint16>(phaseOffsetArray.at(i)) << 16) | frequencyArrayIntlo.at(i);
-        joinedValueArray.append(joined);
+/*
+ * sendFrequencyConfiguration()
+ * ----------------------------------
+ * Sends frequencyArray as the F command (FrequencyTable, any number of entries, phase offsets
+ * from the configuration file), used by SEND FREQUENCY and by each step of a frequency sweep
+ */
+void MainWindow::sendFrequencyConfiguration()
+{
+    if (frequencyArray.size() > FrequencyTable::maxEntries) {
+        ui->outputMessageLog->append(QString("Frequency table limited to %1 entries").arg(FrequencyTable::maxEntries));
+        frequencyArray.resize(FrequencyTable::maxEntries);
     }
 
-    //Log joined values
-    QStringList joinedList;
-    for (quint32 j : joinedValueArray)
-        joinedList << QString::number(j);
-    //ui->outputMessageLog->append("Joined Frequency Array: " + joinedList.join(", "));
-
-    //Build final message string in format "F 0 0 A B C D E"
-    //Where A-E are the first five values from joinedValueArray, or "0" if missing
-    QStringList finalValues;
-    for (int i = 0; i < 5; ++i){
-        finalValues << (i < joinedValueArray.size() ? QString::number(joinedValueArray.at(i)) : "0");
-    }
-    QString finalFrequencyMessage = "F 0 0 " + finalValues.join(" ");
-    //ui->outputMessageLog->append("Final Message: " + finalFrequencyMessage);
+    //phase offsets are read again on every send, so edits of the file apply without restarting
+    QString warning;
+    phaseOffsetArray = FrequencyTable::loadPhaseOffsets(&warning);
+    if (!warning.isEmpty())
+        ui->outputMessageLog->append(warning);
+    if (frequencyArray.size() > phaseOffsetArray.size())
+        ui->outputMessageLog->append(QString("%1 frequencies but %2 phase offsets in %3, the rest use offset 0")
+                                     .arg(frequencyArray.size()).arg(phaseOffsetArray.size()).arg(FrequencyTable::settingsFilePath()));
 
-    QByteArray data = finalFrequencyMessage.toUtf8();
-    //Replace IP by ("192.168.1.10")
     //Send frequency config data via UDP
-    qint64 bytesSent = udpSocketOut->writeDatagram(data, QHostAddress("192.168.1.10"), 4590);
-    if(bytesSent == -1){
-        qDebug() << "Failed to send frequency config data to port 4590:" << udpSocketOut->errorString();
-    }
+    sendCommand(FrequencyTable::encode(frequencyArray, phaseOffsetArray), "frequency configuration");
+
+    //records are split per frequency, let the new frequencies claim the trackers and frame assemblers,
+    //one per table entry
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->resetFrequencies(frequencyArray.size());
 }
 
 /*
@@ -453,31 +645,9 @@ void MainWindow::onbuttonUpdateclicked()
 /*
  * handleDatagram()
  * ----------------------------------
- * This function processes incoming datagrams from secondary UDP socket
- * This is essentially the data from the instruemtn waiting to be decoded and processed
- * Currently does the following:
- *      Reads datagrams and splits them into fixed-size chunks
- *      Exctracts individual fields from each chunk
- *      Builds formatted string from fields and accumulates them
- *      Computes OTR and ADC values, decimates data into 6 arrays, and proccesses frequency and other data
- *      Updates various UI elements
+ * Moved to InstrumentSession::handleDatagram, one per instrument, which posts each batch of
+ * datagrams to the processingDataThread of its session. Original body kept below for reference
  */
-void MainWindow::handleDatagram()
-{
-    QList<QByteArray> datagramList;
-    while(udpSocketOut->hasPendingDatagrams()){
-        qint64 pendingSize = udpSocketOut->pendingDatagramSize();
-        int readSize = (pendingSize > 8192) ? 8192 : pendingSize;
-        QByteArray buffer;
-        buffer.resize(readSize);
-        QHostAddress sender;        //Stores sender's address
-        quint16 senderPort;         //Stores sender's port
-        udpSocketOut->readDatagram(buffer.data(),buffer.size(),&sender,&senderPort);
-        datagramList.append(buffer);
-
-        QMetaObject::invokeMethod(processingData, "processDatagrams", Qt::QueuedConnection,Q_ARG(QList<QByteArray>, datagramList));    //Clear all processing containers
-    }
-}
 
     /*formattedChunks.clear();
     convertedIntegers.clear();
@@ -952,16 +1122,34 @@ void MainWindow::onbuttonClearFinalDataclicked()
 
 void MainWindow::onbuttonSaveclicked()
 {
-    csvFilePath = ui->inputMeasurementFilePath -> toPlainText().trimmed();
+    startSaving(ui->inputMeasurementFilePath -> toPlainText().trimmed(), ui->inputFrames->value());
+}
+
+/*
+ * startSaving()
+ * ----------------------------------
+ * Prepares filePath (header, overwrite rules) and saves the next frames frames to it,
+ * returns false if saving could not start
+ */
+bool MainWindow::startSaving(const QString &filePath, int frames)
+{
+    csvFilePath = filePath;
     if (csvFilePath.isEmpty()){
         qDebug() << "Error: CSV file path is empty.";
         ui->buttonSave->setEnabled(true);
         clear2DArray = true;
-        return;
+        return false;
+    }
+
+    //header columns follow the impedance stage, a file keeps the columns it was started with
+    if (saveDerivedColumns != ui->checkBoxImpedance->isChecked()){
+        saveDerivedColumns = ui->checkBoxImpedance->isChecked();
+        lastSavedFilePath = "null";
     }
 
     if (csvFilePath != lastSavedFilePath){
         fileInitialised = false;
+        initialisedFrequencyFiles.clear();
         lastSavedFilePath = csvFilePath;
     }
 
@@ -972,10 +1160,20 @@ void MainWindow::onbuttonSaveclicked()
             qDebug()<<"Error:Could not create directory:"<<dir.absolutePath();
             ui->buttonSave->setEnabled(true);
             clear2DArray = true;
-            return;
+            return false;
         }
     }
 
+    //several frequencies or instruments: their files are created as their first frame arrives
+    if (frequencyArray.size() > 1 || sessions.size() > 1) {
+        framesSavedPerFile.clear();
+        ui->buttonSave->setEnabled(false);
+        clear2DArray = false;
+        setFrames = frames;
+        ui->outputSavedFrames->setText("0");
+        return true;
+    }
+
     bool overwrite = ui->buttonOverwriteFile->isChecked();
     QFile file(csvFilePath);
 
@@ -988,17 +1186,17 @@ void MainWindow::onbuttonSaveclicked()
                 qDebug() << "File already exists and overwrite is not allowed. Aborting save.";
                 ui->buttonSave->setEnabled(true);
                 clear2DArray = true;
-                return;
+                return false;
             }
             // Else, file doesn't exist: initialize it.
             if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
                 qDebug() << "Error: Could not create CSV file." << file.errorString();
                 ui->buttonSave->setEnabled(true);
                 clear2DArray = true;
-                return;
+                return false;
             }
             QTextStream out(&file);
-            out << "State,Excitation Coil,Sensing Coil,Real(I),Imaginary(Q),Frequency\n";
+            out << MeasurementFile::header(saveDerivedColumns);
             file.close();
             fileInitialised = true;
         }
@@ -1012,10 +1210,10 @@ void MainWindow::onbuttonSaveclicked()
                 qDebug() << "Error: Could not open CSV file for writing." << file.errorString();
                 ui->buttonSave->setEnabled(true);
                 clear2DArray = true;
-                return;
+                return false;
             }
             QTextStream out(&file);
-            out << "State,Excitation Coil,Sensing Coil,Real(I),Imaginary(Q),Frequency\n";
+            out << MeasurementFile::header(saveDerivedColumns);
             file.close();
             fileInitialised = true;
         }
@@ -1024,15 +1222,64 @@ void MainWindow::onbuttonSaveclicked()
 
     ui->buttonSave->setEnabled(false);
     clear2DArray = false;
-    setFrames = ui->inputFrames->value();
+    setFrames = frames;
     ui->outputSavedFrames->setText(QString::number(framesSaved));
+    return true;
 }
 
-void MainWindow::onProcessedChunkResult(const QVector<QVector<double> > &global2DArray)
+void MainWindow::onProcessedChunkResult(const int &instrument, const QVector<QVector<double> > &global2DArray)
 {
+    TRACE_SPAN("onProcessedChunkResult");
+    PipelineMetrics *metrics = sessions.at(instrument)->metrics();
+    metrics->writerBacklog.fetchAndAddRelaxed(-1);
+    if (instrument == 0) {
+        ui->outputTrendView->addFrame(global2DArray);
+        sweepCampaign->onFrame(global2DArray);      //may start saving with this frame
+    }
     if (clear2DArray)
         return;
 
+    //several frequencies or instruments: each frame goes to the file of its instrument and frequency,
+    //saving ends when every instrument has setFrames frames of every programmed frequency
+    if (frequencyArray.size() > 1 || sessions.size() > 1) {
+        if (global2DArray[RowFrequency].isEmpty())
+            return;
+        const qint64 frequency = static_cast<qint64>(global2DArray[RowFrequency].first());
+        const QString filePath = splitFilePath(instrument, frequency);
+        int &savedFrames = framesSavedPerFile[filePath];
+        if (savedFrames >= setFrames)
+            return;
+
+        QFile file(filePath);
+        if (!initialiseFrequencyFile(filePath)) {
+            savedFrames = setFrames;        //refused file, do not wait for this frequency
+        } else if (file.open(QIODevice::Append | QIODevice::Text)){
+            QTextStream out(&file);
+            MeasurementFile::writeFrameRows(out, global2DArray, MeasurementFile::rowCount(saveDerivedColumns));
+            file.close();
+        } else {
+            qDebug() << "Error: Could not open CSV file for appending:" << filePath;
+        }
+        if (savedFrames < setFrames) {
+            savedFrames++;
+            metrics->framesSaved.fetchAndAddRelaxed(1);
+        }
+
+        //'Saved Frames' shows the file furthest behind
+        int leastSaved = framesSavedPerFile.size() < sessions.size() * qMax(1, frequencyArray.size()) ? 0 : setFrames;
+        for (int saved : qAsConst(framesSavedPerFile))
+            leastSaved = qMin(leastSaved, saved);
+        ui->outputSavedFrames->setText(QString::number(leastSaved));
+
+        if (leastSaved >= setFrames){
+            clear2DArray = true;
+            framesSavedPerFile.clear();
+            ui->buttonSave->setEnabled(true);
+            sweepCampaign->onStepSaved();
+        }
+        return;
+    }
+
     if (framesSaved >= setFrames)
         return;
 
@@ -1040,34 +1287,404 @@ void MainWindow::onProcessedChunkResult(const QVector<QVector<double> > &global2
         QFile file(csvFilePath);
         if (file.open(QIODevice::Append | QIODevice::Text)){
             QTextStream out(&file);
-            int numElements = global2DArray[0].size();
-            for (int col = 0; col < numElements; ++col){
-                QStringList rowData;
-                for (int row = 0; row < global2DArray.size(); ++row){
-                    rowData << QString::number(global2DArray[row][col]);
-                }
-                out << rowData.join(",") << "\n";
-            }
+            MeasurementFile::writeFrameRows(out, global2DArray, MeasurementFile::rowCount(saveDerivedColumns));
             file.close();
         } else {
             qDebug() << "Error: Could not open CSV file for appending.";
         }
     }
         framesSaved++;
+        pipelineMetrics->framesSaved.fetchAndAddRelaxed(1);
         ui->outputSavedFrames->setText(QString::number(framesSaved));
 
         if (framesSaved >= setFrames){
             clear2DArray = true;
             framesSaved = 0;
             ui->buttonSave->setEnabled(true);
+            sweepCampaign->onStepSaved();
         }
 }
 
 void MainWindow::onbuttonSyncclicked()
 {
     bool flag = true;
-    dataConsumer->m_syncEnabled.storeRelease(flag);
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->dataConsumer()->m_syncEnabled.storeRelease(flag);
     //qDebug() << flag;
     //qDebug() << "AutoSync button clicked";
 }
 
+/*
+ * oncheckBoxTracetoggled()
+ * ----------------------------------
+ * Starts or stops recording of pipeline spans on all threads
+ */
+void MainWindow::oncheckBoxTracetoggled(bool checked)
+{
+    PipelineTrace::setEnabled(checked);
+    ui->outputMessageLog->append(checked ? "Pipeline tracing enabled" : "Pipeline tracing disabled");
+}
+
+/*
+ * onbuttonSaveTraceclicked()
+ * ----------------------------------
+ * Writes the recorded spans to a Chrome trace JSON file, open it in chrome://tracing or Perfetto
+ */
+void MainWindow::onbuttonSaveTraceclicked()
+{
+    QString filePath = ui->inputTraceFilePath->toPlainText().trimmed();
+    if (filePath.isEmpty()){
+        qDebug() << "Error: Trace file path is empty.";
+        return;
+    }
+
+    QString errorString;
+    if (PipelineTrace::writeChromeTrace(filePath, &errorString))
+        ui->outputMessageLog->append("Trace saved to: " + filePath);
+    else
+        ui->outputMessageLog->append("Could not save trace: " + errorString);
+}
+
+/*
+ * oncheckBoxMetricstoggled()
+ * ----------------------------------
+ * Starts or stops the Prometheus metrics endpoint (localhost only) on metricsServerThread
+ */
+void MainWindow::oncheckBoxMetricstoggled(bool checked)
+{
+    if (checked) {
+        quint16 port = static_cast<quint16>(ui->inputMetricsPort->value());
+        QMetaObject::invokeMethod(metricsServer, [this, port](){ metricsServer->start(port); }, Qt::QueuedConnection);
+    } else {
+        QMetaObject::invokeMethod(metricsServer, [this](){ metricsServer->stop(); }, Qt::QueuedConnection);
+    }
+}
+
+/*
+ * oncheckBoxImpedancetoggled()
+ * ----------------------------------
+ * Turns the ImpedanceStage on dataConsumerThread on/off, frames get magnitude, phase and
+ * reference-normalised rows. Takes effect in saved files from the next SAVE
+ */
+void MainWindow::oncheckBoxImpedancetoggled(bool checked)
+{
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->dataConsumer()->m_impedanceEnabled.storeRelease(checked);
+}
+
+/*
+ * onbuttonCaptureReferenceclicked()
+ * ----------------------------------
+ * Averages the next 'Reference Frames' complete frames of every frequency (empty-space reference),
+ * saved to 'Reference File' if a path is given, <name>_inst<n> per instrument with several instruments
+ */
+void MainWindow::onbuttonCaptureReferenceclicked()
+{
+    int frames = ui->inputReferenceFrames->value();
+    QString filePath = ui->inputReferenceFilePath->toPlainText().trimmed();
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->dataConsumer()->captureReference(frames, referenceFilePath(filePath, session->index()));
+    ui->outputMessageLog->append(QString("Capturing reference over %1 frames").arg(frames));
+}
+
+/*
+ * onbuttonLoadReferenceclicked()
+ * ----------------------------------
+ * Loads the references stored in 'Reference File', send the frequency configuration first
+ */
+void MainWindow::onbuttonLoadReferenceclicked()
+{
+    QString filePath = ui->inputReferenceFilePath->toPlainText().trimmed();
+    if (filePath.isEmpty()){
+        qDebug() << "Error: Reference file path is empty.";
+        return;
+    }
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->dataConsumer()->loadReference(referenceFilePath(filePath, session->index()));
+}
+
+/*
+ * oncheckBoxSubtractReferencetoggled()
+ * ----------------------------------
+ * Real/Imaginary of every frame minus the reference of its frequency, frames without reference are unchanged
+ */
+void MainWindow::oncheckBoxSubtractReferencetoggled(bool checked)
+{
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->dataConsumer()->m_subtractReference.storeRelease(checked);
+}
+
+/*
+ * onStateStatisticsUpdated()
+ * ----------------------------------
+ * One table row per state of the first frequency, statistics over the last 'SNR Packets' frames
+ */
+void MainWindow::onStateStatisticsUpdated(const QVector<QVector<double>> &statistics)
+{
+    const int states = statistics.isEmpty() ? 0 : statistics[0].size();
+    QTableWidget *table = ui->outputStateStatistics;
+    if (table->rowCount() != states)
+        table->setRowCount(states);
+
+    for (int column = 0; column < statistics.size(); ++column){
+        for (int state = 0; state < states; ++state){
+            QTableWidgetItem *item = table->item(state, column);
+            if (!item){
+                item = new QTableWidgetItem;
+                table->setItem(state, column, item);
+            }
+            //SNR with one decimal, the rest in the same units as the saved file
+            item->setText(column == StateStatistics::StatSnrDb ? QString::number(statistics[column][state], 'f', 1)
+                                                                : QString::number(statistics[column][state], 'g', 6));
+        }
+    }
+}
+
+/*
+ * onbuttonLoadSensitivityclicked()
+ * ----------------------------------
+ * Loads the sensitivity matrix on reconstructionThread, the regularised inverse is precomputed there once
+ */
+void MainWindow::onbuttonLoadSensitivityclicked()
+{
+    QString filePath = ui->inputSensitivityFilePath->toPlainText().trimmed();
+    if (filePath.isEmpty()){
+        qDebug() << "Error: Sensitivity matrix file path is empty.";
+        return;
+    }
+    double regularisation = ui->inputRegularisation->value();
+    ReconstructionEngine *engine = reconstructionEngine;
+    QMetaObject::invokeMethod(reconstructionEngine, [engine, filePath, regularisation](){
+        engine->loadSensitivity(filePath, regularisation);
+    }, Qt::QueuedConnection);
+}
+
+/*
+ * onImageReady()
+ * ----------------------------------
+ * Latest reconstructed image, shows the reconstruction time
+ */
+void MainWindow::onImageReady(const QVector<double> &image, const double &frequency, const qint64 &elapsedNs)
+{
+    Q_UNUSED(image);
+    Q_UNUSED(frequency);
+    ui->outputReconstructionTime->display(elapsedNs / 1.0e6);
+}
+
+/*
+ * onbuttonApplyTrendclicked()
+ * ----------------------------------
+ * Parses the comma separated state list of the Trends tab and restarts the trend plot,
+ * memory follows the history depth, not the run length
+ */
+void MainWindow::onbuttonApplyTrendclicked()
+{
+    QVector<int> states;
+    const QStringList tokens = ui->inputTrendStates->text().split(',', Qt::SkipEmptyParts);
+    for (const QString &token : tokens) {
+        bool ok = false;
+        const int state = token.trimmed().toInt(&ok);
+        if (ok && !states.contains(state))
+            states.append(state);
+    }
+    ui->outputTrendView->configure(states, ui->inputTrendHistory->value());
+    ui->outputMessageLog->append(QString("Trend: %1 state(s), history %2 frames").arg(states.size()).arg(ui->inputTrendHistory->value()));
+}
+
+/*
+ * splitFilePath()
+ * ----------------------------------
+ * File of one instrument and frequency when several are used, e.g. data.csv -> data_1000Hz.csv,
+ * data_inst2.csv or data_inst2_1000Hz.csv
+ */
+QString MainWindow::splitFilePath(int instrument, qint64 frequency) const
+{
+    QString filePath = sessions.size() > 1 ? MeasurementFile::instrumentFilePath(csvFilePath, instrument) : csvFilePath;
+    return frequencyArray.size() > 1 ? MeasurementFile::frequencyFilePath(filePath, frequency) : filePath;
+}
+
+/*
+ * referenceFilePath()
+ * ----------------------------------
+ * Reference file of one instrument, 'Reference File' itself with a single instrument
+ */
+QString MainWindow::referenceFilePath(const QString &filePath, int instrument) const
+{
+    return filePath.isEmpty() || sessions.size() == 1 ? filePath : MeasurementFile::instrumentFilePath(filePath, instrument);
+}
+
+/*
+ * initialiseFrequencyFile()
+ * ----------------------------------
+ * Writes the header of a per-frequency file on its first frame in this saving session,
+ * with the same overwrite rules as the single file. Returns false if the frame must not be saved
+ */
+bool MainWindow::initialiseFrequencyFile(const QString &filePath)
+{
+    if (initialisedFrequencyFiles.contains(filePath))
+        return true;
+
+    QFile file(filePath);
+    if (!ui->buttonOverwriteFile->isChecked() && file.exists()) {
+        qDebug() << "File already exists and overwrite is not allowed, frequency not saved:" << filePath;
+        return false;
+    }
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qDebug() << "Error: Could not create CSV file." << file.errorString();
+        return false;
+    }
+    QTextStream out(&file);
+    out << MeasurementFile::header(saveDerivedColumns);
+    file.close();
+    initialisedFrequencyFiles.insert(filePath);
+    return true;
+}
+
+/*
+ * updateCoilSequence()
+ * ----------------------------------
+ * Parses the sensing and excitation sequence controls and hands the pairs to the sequence tracker
+ * on processingDataThread, so lost/reordered records are judged against what the instrument runs
+ */
+void MainWindow::updateCoilSequence()
+{
+    QString errorString;
+    CoilSequence sequence = CoilSequence::fromText(ui->inputSensingSequence->toPlainText(),
+                                                   ui->inputExcitationSequence->toPlainText(),
+                                                   &errorString);
+    if (sequence.isEmpty()) {
+        ui->outputMessageLog->append("Sequence tracking not updated: " + errorString);
+        return;
+    }
+
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->setCoilSequence(sequence);         //trackers and frame lock of every instrument
+}
+
+/*
+ * onbuttonStartSweepclicked()
+ * ----------------------------------
+ * Checks the sweep plan and starts it, SEND FREQUENCY and SAVE stay disabled until it ends
+ */
+void MainWindow::onbuttonStartSweepclicked()
+{
+    if (sweepCampaign->isRunning() || !clear2DArray) {
+        ui->outputMessageLog->append("Sweep not started: a sweep or a saving session is already running");
+        return;
+    }
+    QVector<SweepCampaign::Step> steps;
+    QString error;
+    if (!SweepCampaign::parsePlan(ui->inputSweepPlan->toPlainText(), steps, error)) {
+        ui->outputMessageLog->append(error);
+        return;
+    }
+    if (ui->inputMeasurementFilePath->toPlainText().trimmed().isEmpty()) {
+        ui->outputMessageLog->append("Sweep not started: measurement file path is empty");
+        return;
+    }
+
+    ui->outputSweepSteps->setRowCount(steps.size());
+    for (int i = 0; i < steps.size(); ++i) {
+        QStringList frequencies;
+        for (double frequency : qAsConst(steps.at(i).frequencies))
+            frequencies << QString::number(frequency);
+        ui->outputSweepSteps->setItem(i, 0, new QTableWidgetItem(frequencies.join(",")));
+        ui->outputSweepSteps->setItem(i, 1, new QTableWidgetItem(QString::number(steps.at(i).frames)));
+        ui->outputSweepSteps->setItem(i, 2, new QTableWidgetItem(QString()));
+        ui->outputSweepSteps->setItem(i, 3, new QTableWidgetItem(QString()));
+    }
+    ui->buttonStartSweep->setEnabled(false);
+    ui->buttonSendFrequency->setEnabled(false);
+    ui->buttonSave->setEnabled(false);
+    ui->outputMessageLog->append(QString("Sweep started, %1 steps").arg(steps.size()));
+    sweepCampaign->start(steps, ui->inputSettleFrames->value());
+}
+
+/*
+ * oncheckBoxSharedMemorytoggled()
+ * ----------------------------------
+ * Maps the shared-memory ring named in the Diagnostics tab (emtframering.h) and publishes
+ * every frame to it, or stops publishing. The segment is kept for its readers
+ */
+void MainWindow::oncheckBoxSharedMemorytoggled(bool checked)
+{
+    if (!checked) {
+        sharedFrameRing->close();
+        ui->outputMessageLog->append("Shared-memory frame publication stopped");
+        return;
+    }
+    const QString name = ui->inputSharedMemoryName->text().trimmed();
+    QString error;
+    if (name.isEmpty() || !sharedFrameRing->open(name, SharedFrameRing::defaultSlots, &error)) {
+        ui->outputMessageLog->append(name.isEmpty() ? QString("Shared memory name is empty") : error);
+        ui->checkBoxSharedMemory->setChecked(false);
+        return;
+    }
+    ui->outputMessageLog->append(QString("Publishing frames to shared memory '%1' (%2 frames)").arg(name).arg(SharedFrameRing::defaultSlots));
+}
+
+/*
+ * oncheckBoxFrameStreamtoggled()
+ * ----------------------------------
+ * Starts or stops the frame stream server (FrameStreamServer) on streamServerThread,
+ * on the localhost port and/or the local socket name of the Diagnostics tab
+ */
+void MainWindow::oncheckBoxFrameStreamtoggled(bool checked)
+{
+    FrameStreamServer *server = frameStreamServer;
+    if (checked) {
+        const quint16 port = static_cast<quint16>(ui->inputFrameStreamPort->value());
+        const QString socketName = ui->inputFrameStreamSocket->text().trimmed();
+        QMetaObject::invokeMethod(frameStreamServer, [server, port, socketName](){ server->start(port, socketName); }, Qt::QueuedConnection);
+    } else {
+        QMetaObject::invokeMethod(frameStreamServer, [server](){ server->stop(); }, Qt::QueuedConnection);
+    }
+}
+
+/*
+ * sendCommand()
+ * ----------------------------------
+ * Sends the same command to every instrument, each session acknowledges and retries on its own
+ */
+void MainWindow::sendCommand(const QByteArray &data, const QString &description)
+{
+    for (InstrumentSession *session : qAsConst(sessions))
+        session->commandChannel()->send(data, description);
+}
+
+/*
+ * updateInstrumentStatus()
+ * ----------------------------------
+ * One row per instrument in the Instruments tab, read from the metrics of its session
+ */
+void MainWindow::updateInstrumentStatus()
+{
+    static const char *const lockStateNames[] = {"SEARCHING", "VERIFYING", "LOCKED"};
+    QTableWidget *table = ui->outputInstrumentStatus;
+    for (int row = 0; row < sessions.size(); ++row) {
+        const InstrumentSession *session = sessions.at(row);
+        const PipelineMetrics *metrics = session->metrics();
+        const quint64 packets = metrics->packetsReceived.loadRelaxed();
+        const QStringList values = {
+            QString("%1 (%2)").arg(row + 1).arg(session->endpoint().instrumentAddress.toString()),
+            QString::number(packets - lastInstrumentPackets.at(row)),
+            QString::number(packets),
+            QString::number(metrics->framesProduced.loadRelaxed()),
+            QString::number(metrics->incompleteFrames.loadRelaxed()),
+            QString::number(metrics->framesSaved.loadRelaxed()),
+            QString::number(metrics->lostRecords.loadRelaxed()),
+            QString::number(metrics->reorderedRecords.loadRelaxed()),
+            lockStateNames[qBound(0, metrics->lockState.loadRelaxed(), 2)],
+            QString::number(metrics->sharedBufferDepth.loadRelaxed())
+        };
+        lastInstrumentPackets[row] = packets;
+        for (int column = 0; column < values.size(); ++column) {
+            QTableWidgetItem *item = table->item(row, column);
+            if (!item) {
+                item = new QTableWidgetItem();
+                table->setItem(row, column, item);
+            }
+            item->setText(values.at(column));
+        }
+    }
+}
@@ -9,6 +9,10 @@
 #include <QList>
 #include <QQueue>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QSet>
+#include "acquisitionconfig.h"
 
 /**
  * MainWindow class
@@ -28,7 +32,14 @@ QT_END_NAMESPACE
 
 class DataConsumer;
 class ProcessingData;
-class SharedBuffer;
+class InstrumentSession;
+class PipelineMetrics;
+class MetricsServer;
+class ReconstructionEngine;
+class HeatMapRenderer;
+class SweepCampaign;
+class SharedFrameRing;
+class FrameStreamServer;
 
 class MainWindow : public QMainWindow
 {
@@ -42,11 +53,9 @@ public:
 
 private slots:
 
-    void handleIncomingMessage();                   //processes incoming UDP data on primary socket, instrument messages
-    void handleDatagram();                          //processes incoming UDP data on secondary socket, instrument data
     void onLogButtonClicked();                      //writes current message log to a file
 
-    void updateLocalPort(int newPort);              //updates local port and rebinds primary UDP socket
+    void updateLocalPort(int newPort);              //updates local port and rebinds the message socket of the first instrument
 
     //Slots for sending commands/configuration via UDP
     void onbuttonSendConfigurationclicked();        //prepares and sends configuration commands
@@ -63,23 +72,37 @@ private slots:
     void onbuttonClearFinalDataclicked();           //turn this off
     void onbuttonSaveclicked();                     //called when SAVE button is clicked
 
-    //retrives formatted data from dataConsumerThread for saving/discarding
-    void onProcessedChunkResult(const QVector<QVector<double>> &global2DArray);
+    //retrives formatted data from the dataConsumerThread of each instrument for saving/discarding
+    void onProcessedChunkResult(const int &instrument, const QVector<QVector<double>> &global2DArray);
 
     void onbuttonSyncclicked();                     //called when SYNC button clicked
 
+    void oncheckBoxTracetoggled(bool checked);      //turns pipeline tracing on/off
+    void onbuttonSaveTraceclicked();                //writes recorded spans to Chrome trace JSON file
+    void oncheckBoxMetricstoggled(bool checked);    //starts/stops the localhost metrics endpoint
+    void oncheckBoxImpedancetoggled(bool checked);  //turns magnitude/phase/normalised rows on/off
+    void onbuttonCaptureReferenceclicked();         //averages the next frames of each frequency into its reference
+    void onbuttonLoadReferenceclicked();            //loads references saved by a previous capture
+    void oncheckBoxSubtractReferencetoggled(bool checked);  //subtracts the reference from every frame
+    void onStateStatisticsUpdated(const QVector<QVector<double>> &statistics);  //per-state statistics/SNR readout
+    void onbuttonLoadSensitivityclicked();          //loads sensitivity matrix, precomputes the reconstruction inverse
+    void onImageReady(const QVector<double> &image, const double &frequency, const qint64 &elapsedNs);
+    void onbuttonApplyTrendclicked();               //restarts the trend plot with the tracked states and history depth
+    void onbuttonStartSweepclicked();               //runs the sweep plan, one saved file per step
+    void oncheckBoxSharedMemorytoggled(bool checked);   //publishes frames to the shared-memory ring
+    void oncheckBoxFrameStreamtoggled(bool checked);    //starts/stops the local frame stream server
+    void updateInstrumentStatus();                  //refreshes the combined status table of all instruments
+
 private:
     Ui::MainWindow *ui;                         //pointer to UI elements
-    QUdpSocket *udpSocket;                      //UDP socket for incoming messages
-    QUdpSocket *udpSocketOut;                   //UDP socket for instrument data communicaiton
     quint16 localPort;                          //gplobal variable to store local port number (from UI)
+    AcquisitionConfig networkConfig;            //bind/instrument addresses and ports, [Network] and [Instrument<n>] of EMT_IP.ini
     bool messageReceivedFlag;                   //flaf to track if a message has been received (redundant)
     double storedFrequencyConfiguration;        //frequency configuration value (redundant)
 
     //data processing containers
     QVector<double> frequencyArray;             //frequency values from configuration
     QVector<quint16> phaseOffsetArray;          //phase offset values
-    QVector<quint32> joinedValueArray;          //joined frequency values (hi << 16 | lo)
 
     //stage-one processed data
     QStringList formattedChunks;                //formatted chunks from UDP datagrams
@@ -103,6 +126,7 @@ private:
 
     bool m_stopUpdates = false;                 //redundant
     bool clear2DArray = true;                   //discards formatted data if TRUE
+    bool saveDerivedColumns = false;            //saving session includes ImpedanceStage columns
     int setFrames = 0;                          //number of frames to save
     int framesSaved = 0;                        //number of frames saved so far
 
@@ -110,17 +134,45 @@ private:
 
     //writes data to save file
     void appendGlobal2DArrayToCSV(const QString &filePath);
+    bool startSaving(const QString &filePath, int frames);  //SAVE, also started by sweep steps
+    void sendFrequencyConfiguration();          //sends frequencyArray as the F command
+    void sendCommand(const QByteArray &data, const QString &description);  //same command to every instrument
 
-    SharedBuffer *sharedBuffer;                 //to pass data to worker threads
+    void updateCoilSequence();                  //passes sensing/excitation sequence controls to the sequence tracker
 
-    ProcessingData *processingData;
-    QThread *processingDataThread;
+    QVector<InstrumentSession *> sessions;      //sockets and worker threads of each instrument, index = instrument
+    QVector<quint64> lastInstrumentPackets;     //packet counters at the last status refresh
 
+    //pipeline of the first instrument, drives the displays
+    ProcessingData *processingData;
     DataConsumer *dataConsumer;
-    QThread *dataConsumerThread;
+    PipelineMetrics *pipelineMetrics;           //counters of the first instrument and of the shared stages
+    MetricsServer *metricsServer;               //serves pipelineMetrics over HTTP
+    QThread *metricsServerThread;
+
+    FrameStreamServer *frameStreamServer;       //streams frames to local subscribers
+    QThread *streamServerThread;
+
+    ReconstructionEngine *reconstructionEngine; //images from frames of dataConsumerThread
+    QThread *reconstructionThread;
+
+    HeatMapRenderer *imageRenderer;             //colormaps reconstructed images
+    HeatMapRenderer *matrixRenderer;            //colormaps the sensing/excitation matrix of each frame
+    QThread *renderThread;
+
+    SweepCampaign *sweepCampaign;               //automated frequency sweep, drives send frequency/save
+    SharedFrameRing *sharedFrameRing;           //frames for local reader processes, written on dataConsumerThread
 
     bool fileInitialised = false;               //to allow data to be saved to same file in the same saving session
     QString lastSavedFilePath = "null";         //supports the above
 
+    //several programmed frequencies or instruments: one file per instrument and frequency,
+    //<name>_inst<n>_<frequency>Hz.<suffix>
+    QString splitFilePath(int instrument, qint64 frequency) const;
+    QString referenceFilePath(const QString &filePath, int instrument) const;
+    bool initialiseFrequencyFile(const QString &filePath);
+    QSet<QString> initialisedFrequencyFiles;    //split files with a header in this saving session
+    QMap<QString, int> framesSavedPerFile;      //frames saved so far, per split file
+
 };
 #endif // MAINWINDOW_H
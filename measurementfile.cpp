@@ -0,0 +1,55 @@
+#include "measurementfile.h"
+#include "frameassembler.h"
+#include <QTextStream>
+#include <QStringList>
+#include <QFileInfo>
+#include <QDir>
+#include <QtNumeric>
+
+//header row of measurement files, one column per FrameRow
+static const char measurementFileHeader[] = "State,Excitation Coil,Sensing Coil,Real(I),Imaginary(Q),Frequency,Complete,Status\n";
+//same with the ImpedanceStage rows, used when 'Magnitude/Phase Columns' is checked at SAVE
+static const char derivedMeasurementFileHeader[] = "State,Excitation Coil,Sensing Coil,Real(I),Imaginary(Q),Frequency,Complete,Status,"
+                                                   "Magnitude,Phase,Normalized Real,Normalized Imaginary\n";
+
+const char *MeasurementFile::header(bool derivedColumns)
+{
+    return derivedColumns ? derivedMeasurementFileHeader : measurementFileHeader;
+}
+
+int MeasurementFile::rowCount(bool derivedColumns)
+{
+    return derivedColumns ? DerivedFrameRowCount : FrameRowCount;
+}
+
+void MeasurementFile::writeFrameRows(QTextStream &out, const QVector<QVector<double>> &frame, int rowCount)
+{
+    int numElements = frame[0].size();
+    for (int col = 0; col < numElements; ++col){
+        QStringList rowData;
+        for (int row = 0; row < rowCount; ++row){
+            rowData << QString::number(row < frame.size() ? frame[row][col] : qQNaN());
+        }
+        out << rowData.join(",") << "\n";
+    }
+}
+
+//<name><tag>.<suffix> in the directory of filePath
+static QString taggedFilePath(const QString &filePath, const QString &tag)
+{
+    QFileInfo fileInfo(filePath);
+    QString fileName = fileInfo.completeBaseName() + tag;
+    if (!fileInfo.suffix().isEmpty())
+        fileName += "." + fileInfo.suffix();
+    return fileInfo.absoluteDir().filePath(fileName);
+}
+
+QString MeasurementFile::frequencyFilePath(const QString &filePath, qint64 frequency)
+{
+    return taggedFilePath(filePath, "_" + QString::number(frequency) + "Hz");
+}
+
+QString MeasurementFile::instrumentFilePath(const QString &filePath, int instrument)
+{
+    return taggedFilePath(filePath, "_inst" + QString::number(instrument + 1));
+}
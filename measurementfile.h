@@ -0,0 +1,32 @@
+#ifndef MEASUREMENTFILE_H
+#define MEASUREMENTFILE_H
+
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+class QTextStream;
+
+/**
+ * @brief The MeasurementFile namespace
+ *
+ * Layout of saved measurement files, shared by the GUI and the headless daemon:
+ * a header line, then one line per state with one column per FrameRow
+ * (optionally followed by the ImpedanceStage rows). With several programmed frequencies
+ * each frequency goes to its own file, <name>_<frequency>Hz.<suffix>, with several instruments
+ * each instrument to its own, <name>_inst<n>.<suffix> (then <name>_inst<n>_<frequency>Hz.<suffix>)
+ */
+
+namespace MeasurementFile
+{
+    const char *header(bool derivedColumns);                        //header line, with the ImpedanceStage columns or not
+    int rowCount(bool derivedColumns);                              //frame rows written per state
+
+    //writes one line per state, columns are the first rowCount frame rows (missing rows are written as nan)
+    void writeFrameRows(QTextStream &out, const QVector<QVector<double>> &frame, int rowCount);
+
+    QString frequencyFilePath(const QString &filePath, qint64 frequency);   //e.g. data.csv -> data_1000Hz.csv
+    QString instrumentFilePath(const QString &filePath, int instrument);    //e.g. data.csv -> data_inst2.csv, instrument 0-based
+}
+
+#endif // MEASUREMENTFILE_H
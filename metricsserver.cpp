@@ -0,0 +1,258 @@
+#include "metricsserver.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QVariant>
+
+namespace {
+
+const int maxRequestSize = 8192;                //requests larger than this are dropped
+
+//one value line per instrument, labelled with the instrument number when there are several
+void appendMetric(QByteArray &out, const char *name, const char *type, const char *help, const QVector<QByteArray> &values)
+{
+    out += QByteArray("# HELP ") + name + ' ' + help + '\n';
+    out += QByteArray("# TYPE ") + name + ' ' + type + '\n';
+    for (int i = 0; i < values.size(); ++i) {
+        out += name;
+        if (values.size() > 1)
+            out += "{instrument=\"" + QByteArray::number(i + 1) + "\"}";
+        out += ' ' + values.at(i) + '\n';
+    }
+}
+
+template <typename T>
+QVector<QByteArray> instrumentValues(const QVector<PipelineMetrics *> &metrics, QAtomicInteger<T> PipelineMetrics::*member)
+{
+    QVector<QByteArray> values;
+    values.reserve(metrics.size());
+    for (const PipelineMetrics *instrument : metrics)
+        values.append(QByteArray::number((instrument->*member).loadRelaxed()));
+    return values;
+}
+
+QVector<QByteArray> rateValues(const QVector<double> &rates)
+{
+    QVector<QByteArray> values;
+    values.reserve(rates.size());
+    for (double rate : rates)
+        values.append(QByteArray::number(rate, 'f', 2));
+    return values;
+}
+
+} // namespace
+
+/**
+ * @brief MetricsServer::MetricsServer
+ * Or metricsServerThread, sockets are only created once start() runs on that thread.
+ * One PipelineMetrics per instrument session, stages shared by the sessions count on the first one
+ */
+MetricsServer::MetricsServer(const QVector<PipelineMetrics *> &metrics, QObject *parent)
+    : QObject{parent}
+    , m_metrics(metrics)
+    , m_lastPackets(metrics.size(), 0)
+    , m_lastFrames(metrics.size(), 0)
+    , m_packetRates(metrics.size(), 0.0)
+    , m_frameRates(metrics.size(), 0.0)
+{
+}
+
+/**
+ * @brief MetricsServer::start
+ * Binds to localhost only, the endpoint is never reachable from the instrument network
+ */
+void MetricsServer::start(quint16 port)
+{
+    if (!m_server) {
+        m_server = new QTcpServer(this);
+        connect(m_server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+        m_rateTimer = new QTimer(this);
+        connect(m_rateTimer, &QTimer::timeout, this, &MetricsServer::updateRates);
+    }
+    if (m_server->isListening())
+        m_server->close();
+
+    if (m_server->listen(QHostAddress::LocalHost, port)) {
+        for (int i = 0; i < m_metrics.size(); ++i) {
+            m_lastPackets[i] = m_metrics.at(i)->packetsReceived.loadRelaxed();
+            m_lastFrames[i] = m_metrics.at(i)->framesProduced.loadRelaxed();
+        }
+        m_rateClock.start();
+        m_rateTimer->start(1000);
+        emit statusChanged("Metrics endpoint on http://127.0.0.1:" + QString::number(port) + "/metrics");
+    } else {
+        emit statusChanged("Metrics endpoint failed on port " + QString::number(port) + ": " + m_server->errorString());
+    }
+}
+
+/**
+ * @brief MetricsServer::stop
+ * Stops accepting scrapes, counters keep running in the pipeline
+ */
+void MetricsServer::stop()
+{
+    if (m_server && m_server->isListening()) {
+        m_server->close();
+        m_rateTimer->stop();
+        emit statusChanged("Metrics endpoint stopped");
+    }
+}
+
+/**
+ * @brief MetricsServer::onNewConnection
+ * Waits for the end of the HTTP request header, answers it and closes the connection
+ */
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket](){
+            QByteArray request = socket->property("request").toByteArray() + socket->readAll();
+            if (request.size() > maxRequestSize) {
+                socket->abort();
+                return;
+            }
+            if (!request.contains("\r\n\r\n")) {
+                socket->setProperty("request", request);
+                return;
+            }
+
+            QByteArray response;
+            QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+            if (requestLine.size() >= 2 && requestLine.at(0) == "GET" && requestLine.at(1) == "/metrics") {
+                QByteArray body = buildMetricsText();
+                response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: "
+                           + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+            } else {
+                response = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            }
+            socket->write(response);
+            socket->disconnectFromHost();
+        });
+    }
+}
+
+/**
+ * @brief MetricsServer::updateRates
+ * Packets/s and frames/s of each instrument over the last timer period
+ */
+void MetricsServer::updateRates()
+{
+    double seconds = m_rateClock.restart() / 1000.0;
+    if (seconds <= 0)
+        return;
+
+    for (int i = 0; i < m_metrics.size(); ++i) {
+        quint64 packets = m_metrics.at(i)->packetsReceived.loadRelaxed();
+        quint64 frames = m_metrics.at(i)->framesProduced.loadRelaxed();
+        m_packetRates[i] = (packets - m_lastPackets.at(i)) / seconds;
+        m_frameRates[i] = (frames - m_lastFrames.at(i)) / seconds;
+        m_lastPackets[i] = packets;
+        m_lastFrames[i] = frames;
+    }
+}
+
+/**
+ * @brief MetricsServer::buildMetricsText
+ * Prometheus exposition format, one HELP/TYPE/value block per metric
+ */
+QByteArray MetricsServer::buildMetricsText() const
+{
+    QByteArray out;
+    appendMetric(out, "emt_packets_received_total", "counter", "UDP datagrams received from the instrument.",
+                 instrumentValues(m_metrics, &PipelineMetrics::packetsReceived));
+    appendMetric(out, "emt_packet_rate", "gauge", "UDP datagrams received per second.",
+                 rateValues(m_packetRates));
+    appendMetric(out, "emt_records_decoded_total", "counter", "Records parsed from datagrams.",
+                 instrumentValues(m_metrics, &PipelineMetrics::recordsDecoded));
+    appendMetric(out, "emt_decode_errors_total", "counter", "Hex fields that failed to convert in processDatagrams.",
+                 instrumentValues(m_metrics, &PipelineMetrics::decodeErrors));
+    appendMetric(out, "emt_lost_records_total", "counter", "Records missing from the coil sequence progression.",
+                 instrumentValues(m_metrics, &PipelineMetrics::lostRecords));
+    appendMetric(out, "emt_reordered_records_total", "counter", "Records that arrived after a later sequence step.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderedRecords));
+    appendMetric(out, "emt_arrival_jitter_us", "gauge", "Smoothed datagram inter-arrival jitter in microseconds.",
+                 instrumentValues(m_metrics, &PipelineMetrics::arrivalJitterUs));
+    appendMetric(out, "emt_frames_produced_total", "counter", "Frames emitted by the data consumer.",
+                 instrumentValues(m_metrics, &PipelineMetrics::framesProduced));
+    appendMetric(out, "emt_frame_rate", "gauge", "Frames emitted per second.",
+                 rateValues(m_frameRates));
+    appendMetric(out, "emt_frames_saved_total", "counter", "Frames written to the measurement file.",
+                 instrumentValues(m_metrics, &PipelineMetrics::framesSaved));
+    appendMetric(out, "emt_incomplete_frames_total", "counter", "Frames with lost or reordered records.",
+                 instrumentValues(m_metrics, &PipelineMetrics::incompleteFrames));
+    appendMetric(out, "emt_over_range", "gauge", "1 if any OTR flag was set in the last batch.",
+                 instrumentValues(m_metrics, &PipelineMetrics::overRange));
+    appendMetric(out, "emt_adc_mode", "gauge", "Mode of the ADC level field in the last batch.",
+                 instrumentValues(m_metrics, &PipelineMetrics::adcMode));
+    appendMetric(out, "emt_autosync", "gauge", "Current Auto Sync rotation.",
+                 instrumentValues(m_metrics, &PipelineMetrics::autosync));
+    appendMetric(out, "emt_frame_lock_state", "gauge", "Frame lock state: 0 searching, 1 verifying, 2 locked.",
+                 instrumentValues(m_metrics, &PipelineMetrics::lockState));
+    appendMetric(out, "emt_frame_lock_losses_total", "counter", "Times the frame boundary lock was lost.",
+                 instrumentValues(m_metrics, &PipelineMetrics::lockLosses));
+    appendMetric(out, "emt_actual_frequency_hz", "gauge", "Actual frequency reported by the instrument.",
+                 instrumentValues(m_metrics, &PipelineMetrics::actualFrequency));
+    appendMetric(out, "emt_shared_buffer_depth", "gauge", "Samples queued between processing and consumer threads.",
+                 instrumentValues(m_metrics, &PipelineMetrics::sharedBufferDepth));
+    appendMetric(out, "emt_writer_backlog_frames", "gauge", "Frames waiting to be handled by the writer.",
+                 instrumentValues(m_metrics, &PipelineMetrics::writerBacklog));
+    appendMetric(out, "emt_impedance_stage_ns", "gauge", "Time to compute magnitude/phase/normalised rows of the last frame.",
+                 instrumentValues(m_metrics, &PipelineMetrics::impedanceStageNs));
+    appendMetric(out, "emt_images_reconstructed_total", "counter", "Images produced by the reconstruction engine.",
+                 instrumentValues(m_metrics, &PipelineMetrics::imagesReconstructed));
+    appendMetric(out, "emt_images_dropped_total", "counter", "Frames skipped because the reconstruction engine was busy.",
+                 instrumentValues(m_metrics, &PipelineMetrics::imagesDropped));
+    appendMetric(out, "emt_reconstruction_iterations_total", "counter", "Iterations run by the iterative reconstruction modes.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reconstructionIterations));
+    appendMetric(out, "emt_reconstruction_ns", "gauge", "Time to reconstruct the last image.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reconstructionNs));
+    appendMetric(out, "emt_frequency_resets_total", "counter", "Frequency tables applied to frame assembly.",
+                 instrumentValues(m_metrics, &PipelineMetrics::frequencyResets));
+    appendMetric(out, "emt_sweep_steps_total", "counter", "Frequency sweep steps saved.",
+                 instrumentValues(m_metrics, &PipelineMetrics::sweepSteps));
+    appendMetric(out, "emt_sweep_dead_time_ms", "gauge", "Time from the end of the previous sweep step to saving of the last one.",
+                 instrumentValues(m_metrics, &PipelineMetrics::sweepDeadTimeMs));
+    appendMetric(out, "emt_commands_sent_total", "counter", "Instrument commands sent, first attempts.",
+                 instrumentValues(m_metrics, &PipelineMetrics::commandsSent));
+    appendMetric(out, "emt_command_retries_total", "counter", "Instrument commands sent again after a timeout.",
+                 instrumentValues(m_metrics, &PipelineMetrics::commandRetries));
+    appendMetric(out, "emt_command_failures_total", "counter", "Instrument commands never acknowledged.",
+                 instrumentValues(m_metrics, &PipelineMetrics::commandFailures));
+    appendMetric(out, "emt_frames_published_total", "counter", "Frames written to the shared-memory ring.",
+                 instrumentValues(m_metrics, &PipelineMetrics::framesPublished));
+    appendMetric(out, "emt_stream_clients", "gauge", "Connected frame stream clients.",
+                 instrumentValues(m_metrics, &PipelineMetrics::streamClients));
+    appendMetric(out, "emt_stream_frames_sent_total", "counter", "Frames written to frame stream clients.",
+                 instrumentValues(m_metrics, &PipelineMetrics::streamFramesSent));
+    appendMetric(out, "emt_stream_frames_dropped_total", "counter", "Frames dropped for slow frame stream clients.",
+                 instrumentValues(m_metrics, &PipelineMetrics::streamFramesDropped));
+    appendMetric(out, "emt_stream_clients_dropped_total", "counter", "Frame stream clients disconnected for falling behind.",
+                 instrumentValues(m_metrics, &PipelineMetrics::streamClientsDropped));
+    appendMetric(out, "emt_command_rtt_us", "gauge", "Smoothed instrument command round-trip time.",
+                 instrumentValues(m_metrics, &PipelineMetrics::commandRttUs));
+    appendMetric(out, "emt_processing_cpu", "gauge", "CPU the processing thread is pinned to, -1 if not pinned.",
+                 instrumentValues(m_metrics, &PipelineMetrics::processingCpu));
+    appendMetric(out, "emt_consumer_cpu", "gauge", "CPU the consumer thread is pinned to, -1 if not pinned.",
+                 instrumentValues(m_metrics, &PipelineMetrics::consumerCpu));
+    appendMetric(out, "emt_realtime_threads", "gauge", "Worker threads running with SCHED_FIFO.",
+                 instrumentValues(m_metrics, &PipelineMetrics::realtimeThreads));
+    appendMetric(out, "emt_memory_locked", "gauge", "1 if the process memory is locked into RAM.",
+                 instrumentValues(m_metrics, &PipelineMetrics::memoryLocked));
+    appendMetric(out, "emt_decode_threads", "gauge", "Threads decoding each batch of datagrams.",
+                 instrumentValues(m_metrics, &PipelineMetrics::decodeThreads));
+    appendMetric(out, "emt_decode_ns", "gauge", "Time to decode the text of the last batch of datagrams.",
+                 instrumentValues(m_metrics, &PipelineMetrics::decodeNs));
+    appendMetric(out, "emt_reorder_restored_total", "counter", "Held records released in order once their gap was filled.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderRestored));
+    appendMetric(out, "emt_reorder_flushed_total", "counter", "Held records released after giving up on their gap.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderFlushed));
+    appendMetric(out, "emt_reorder_late_total", "counter", "Records that arrived after their step was released.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderLate));
+    appendMetric(out, "emt_reorder_held", "gauge", "Records waiting in the reorder buffers.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderHeld));
+    appendMetric(out, "emt_reorder_delay_us", "gauge", "Time the last held record waited in the reorder buffer.",
+                 instrumentValues(m_metrics, &PipelineMetrics::reorderDelayUs));
+    return out;
+}
@@ -0,0 +1,53 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QVector>
+#include <QElapsedTimer>
+#include "pipelinemetrics.h"
+
+class QTcpServer;
+class QTimer;
+
+/**
+ * @brief The MetricsServer class
+ *
+ * Minimal HTTP endpoint serving PipelineMetrics in Prometheus text format on GET /metrics.
+ * Listens on localhost only and runs on its own thread (metricsServerThread),
+ * it only reads atomics so scraping never touches the acquisition or GUI threads.
+ * Packet and frame rates are worked out once per second from the counters.
+ * With several instrument sessions every value line carries an instrument="n" label
+ */
+
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(const QVector<PipelineMetrics *> &metrics, QObject *parent = nullptr);
+
+public slots:
+    void start(quint16 port);                   //starts listening on 127.0.0.1:port
+    void stop();                                //closes the listening socket
+
+signals:
+    void statusChanged(const QString &status);  //to log listening state on GUI
+
+private slots:
+    void onNewConnection();                     //accepts a scrape connection
+    void updateRates();                         //recomputes packet/frame rates, once per second
+
+private:
+    QByteArray buildMetricsText() const;        //renders all metrics in Prometheus text format
+
+    QVector<PipelineMetrics *> m_metrics;       //counters shared with the pipeline threads, one per instrument
+    QTcpServer *m_server = nullptr;             //created in start() so it belongs to metricsServerThread
+    QTimer *m_rateTimer = nullptr;              //drives updateRates()
+    QElapsedTimer m_rateClock;                  //time since last rate update
+    QVector<quint64> m_lastPackets;             //packet counters at last rate update
+    QVector<quint64> m_lastFrames;              //frame counters at last rate update
+    QVector<double> m_packetRates;              //packets per second
+    QVector<double> m_frameRates;               //frames per second
+};
+
+#endif // METRICSSERVER_H
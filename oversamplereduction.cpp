@@ -0,0 +1,131 @@
+#include "oversamplereduction.h"
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OVERSAMPLEREDUCTION_SSE2
+#endif
+
+namespace {
+
+//sorts 4 values in place with 5 compare-exchanges, min/max only
+template<typename T, typename Min, typename Max>
+inline void sort4(T &a, T &b, T &c, T &d, Min min, Max max)
+{
+    T t;
+    t = min(a, b); b = max(a, b); a = t;
+    t = min(c, d); d = max(c, d); c = t;
+    t = min(a, c); c = max(a, c); a = t;
+    t = min(b, d); d = max(b, d); b = t;
+    t = min(b, c); c = max(b, c); b = t;
+}
+
+struct PickLastKernel {
+    static double scalar(double, double, double, double d) { return d; }
+#ifdef OVERSAMPLEREDUCTION_SSE2
+    static __m128d vector(__m128d, __m128d, __m128d, __m128d d) { return d; }
+#endif
+};
+
+struct MeanKernel {
+    static double scalar(double a, double b, double c, double d) { return ((a + b) + (c + d)) * 0.25; }
+#ifdef OVERSAMPLEREDUCTION_SSE2
+    static __m128d vector(__m128d a, __m128d b, __m128d c, __m128d d)
+    {
+        return _mm_mul_pd(_mm_add_pd(_mm_add_pd(a, b), _mm_add_pd(c, d)), _mm_set1_pd(0.25));
+    }
+#endif
+};
+
+struct MedianOf4Kernel {
+    static double scalar(double a, double b, double c, double d)
+    {
+        auto min = [](double x, double y) { return std::min(x, y); };
+        auto max = [](double x, double y) { return std::max(x, y); };
+        sort4(a, b, c, d, min, max);
+        return (b + c) * 0.5;
+    }
+#ifdef OVERSAMPLEREDUCTION_SSE2
+    static __m128d vector(__m128d a, __m128d b, __m128d c, __m128d d)
+    {
+        auto min = [](__m128d x, __m128d y) { return _mm_min_pd(x, y); };
+        auto max = [](__m128d x, __m128d y) { return _mm_max_pd(x, y); };
+        sort4(a, b, c, d, min, max);
+        return _mm_mul_pd(_mm_add_pd(b, c), _mm_set1_pd(0.5));
+    }
+#endif
+};
+
+//after sorting the outlier is a or d, whichever is further from the median (b + c)/2,
+//i.e. a if (b + c) - 2a > 2d - (b + c)
+struct TrimmedMeanKernel {
+    static double scalar(double a, double b, double c, double d)
+    {
+        auto min = [](double x, double y) { return std::min(x, y); };
+        auto max = [](double x, double y) { return std::max(x, y); };
+        sort4(a, b, c, d, min, max);
+        const double middle = b + c;
+        const double kept = (middle - 2 * a > 2 * d - middle) ? d : a;
+        return (middle + kept) * (1.0 / 3.0);
+    }
+#ifdef OVERSAMPLEREDUCTION_SSE2
+    static __m128d vector(__m128d a, __m128d b, __m128d c, __m128d d)
+    {
+        auto min = [](__m128d x, __m128d y) { return _mm_min_pd(x, y); };
+        auto max = [](__m128d x, __m128d y) { return _mm_max_pd(x, y); };
+        sort4(a, b, c, d, min, max);
+        const __m128d middle = _mm_add_pd(b, c);
+        const __m128d dropA = _mm_cmpgt_pd(_mm_sub_pd(middle, _mm_add_pd(a, a)), _mm_sub_pd(_mm_add_pd(d, d), middle));
+        const __m128d kept = _mm_or_pd(_mm_and_pd(dropA, d), _mm_andnot_pd(dropA, a));
+        return _mm_mul_pd(_mm_add_pd(middle, kept), _mm_set1_pd(1.0 / 3.0));
+    }
+#endif
+};
+
+template<typename Kernel>
+void reduce(const double *samples, int steps, double *out)
+{
+    int step = 0;
+#ifdef OVERSAMPLEREDUCTION_SSE2
+    //two steps per iteration, transposed so lane 0 holds step and lane 1 step + 1
+    for (; step + 2 <= steps; step += 2) {
+        const double *s = samples + step * 4;
+        const __m128d first01 = _mm_loadu_pd(s);
+        const __m128d first23 = _mm_loadu_pd(s + 2);
+        const __m128d second01 = _mm_loadu_pd(s + 4);
+        const __m128d second23 = _mm_loadu_pd(s + 6);
+        _mm_storeu_pd(out + step, Kernel::vector(_mm_unpacklo_pd(first01, second01), _mm_unpackhi_pd(first01, second01),
+                                                 _mm_unpacklo_pd(first23, second23), _mm_unpackhi_pd(first23, second23)));
+    }
+#endif
+    for (; step < steps; ++step) {
+        const double *s = samples + step * 4;
+        out[step] = Kernel::scalar(s[0], s[1], s[2], s[3]);
+    }
+}
+
+}
+
+namespace OversampleReduction
+{
+
+Function function(Kernel kernel)
+{
+    switch (kernel) {
+    case Mean:
+        return reduce<MeanKernel>;
+    case MedianOf4:
+        return reduce<MedianOf4Kernel>;
+    case TrimmedMean:
+        return reduce<TrimmedMeanKernel>;
+    default:
+        return reduce<PickLastKernel>;
+    }
+}
+
+const char *name(Kernel kernel)
+{
+    static const char *const names[] = {"pick-last", "mean", "median-of-4", "trimmed mean"};
+    return kernel >= 0 && kernel < KernelCount ? names[kernel] : names[PickLast];
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef OVERSAMPLEREDUCTION_H
+#define OVERSAMPLEREDUCTION_H
+
+#include <QtGlobal>
+
+/**
+ * @brief The OversampleReduction namespace
+ *
+ * Kernels reducing the 4 repetitions of each sequence step to one value. Input is the slot layout
+ * of FrameAssembler (4 consecutive samples per step), output one value per step.
+ * A kernel is picked once through function(), the loop over steps has no data-dependent branches
+ * (min/max sorting network and mask blends, SSE2 processes two steps per iteration)
+ */
+
+namespace OversampleReduction
+{
+    enum Kernel {
+        PickLast = 0,           //last repetition, same as keeping every 4th sample
+        Mean,                   //mean of the 4 repetitions
+        MedianOf4,              //mean of the 2 middle repetitions
+        TrimmedMean,            //mean of the 3 repetitions left after dropping the one furthest from the median
+        KernelCount
+    };
+
+    typedef void (*Function)(const double *samples, int steps, double *out);
+
+    Function function(Kernel kernel);           //PickLast for an out of range kernel
+    const char *name(Kernel kernel);
+}
+
+#endif // OVERSAMPLEREDUCTION_H
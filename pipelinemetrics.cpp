@@ -0,0 +1,3 @@
+#include "pipelinemetrics.h"
+
+PipelineMetrics::PipelineMetrics() {}
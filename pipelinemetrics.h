@@ -0,0 +1,71 @@
+#ifndef PIPELINEMETRICS_H
+#define PIPELINEMETRICS_H
+
+#include <QAtomicInteger>
+
+/**
+ * @brief The PipelineMetrics class
+ *
+ * Live counters and gauges of the acquisition pipeline, shared by all threads.
+ * Every value is a single atomic, written by the thread that owns it
+ * (processingDataThread, dataConsumerThread or the saving thread) and only read by the MetricsServer,
+ * so a scrape never takes a pipeline mutex nor waits on an acquisition thread
+ */
+
+class PipelineMetrics
+{
+public:
+    PipelineMetrics();
+
+    //counters, only ever increase
+    QAtomicInteger<quint64> packetsReceived{0};         //UDP datagrams handed to processingDataThread
+    QAtomicInteger<quint64> recordsDecoded{0};          //32-character records parsed from datagrams
+    QAtomicInteger<quint64> decodeErrors{0};            //hex fields that failed toUInt in processDatagrams
+    QAtomicInteger<quint64> framesProduced{0};          //frames emitted by dataConsumerThread
+    QAtomicInteger<quint64> frequencyResets{0};         //frequency tables applied by dataConsumerThread
+    QAtomicInteger<quint64> framesSaved{0};             //frames written to the measurement file
+    QAtomicInteger<qint64> lostRecords{0};              //records missing from the coil progression, late arrivals included
+    QAtomicInteger<qint64> reorderedRecords{0};         //records that arrived after a later step
+    QAtomicInteger<qint64> reorderRestored{0};          //held records released in order once their gap was filled
+    QAtomicInteger<qint64> reorderFlushed{0};           //held records released after giving up on their gap (timeout/depth)
+    QAtomicInteger<qint64> reorderLate{0};              //records that arrived after their step was released
+    QAtomicInteger<quint64> incompleteFrames{0};        //frames emitted with lost/reordered records
+    QAtomicInteger<quint64> imagesReconstructed{0};     //images produced by ReconstructionEngine
+    QAtomicInteger<quint64> imagesDropped{0};           //frames replaced before the reconstruction thread took them
+    QAtomicInteger<quint64> reconstructionIterations{0};    //iterations run by the iterative reconstruction modes
+    QAtomicInteger<quint64> sweepSteps{0};              //frequency sweep steps saved
+    QAtomicInteger<quint64> commandsSent{0};            //instrument commands sent (first attempts)
+    QAtomicInteger<quint64> commandRetries{0};          //instrument commands sent again after a timeout
+    QAtomicInteger<quint64> commandFailures{0};         //instrument commands never acknowledged
+    QAtomicInteger<quint64> framesPublished{0};         //frames written to the shared-memory ring
+    QAtomicInteger<quint64> streamFramesSent{0};        //frames written to frame stream clients
+    QAtomicInteger<quint64> streamFramesDropped{0};     //frames dropped for slow frame stream clients
+    QAtomicInteger<quint64> streamClientsDropped{0};    //frame stream clients disconnected for being too slow
+
+    //gauges, latest value
+    QAtomicInteger<int> overRange{0};                   //1 if any OTR bit set in the last batch
+    QAtomicInteger<int> adcMode{0};                     //ADC level mode of the last batch
+    QAtomicInteger<int> autosync{0};                    //current Auto Sync value
+    QAtomicInteger<qint64> actualFrequency{0};          //first frequency field of the last frame
+    QAtomicInteger<int> sharedBufferDepth{0};           //samples waiting in SharedBuffer queues
+    QAtomicInteger<int> writerBacklog{0};               //frames emitted but not yet handled by the writer
+    QAtomicInteger<int> arrivalJitterUs{0};             //smoothed datagram inter-arrival jitter
+    QAtomicInteger<int> lockState{0};                   //FrameLockEngine state, 0 searching, 1 verifying, 2 locked
+    QAtomicInteger<qint64> lockLosses{0};               //times the frame lock was lost
+    QAtomicInteger<qint64> impedanceStageNs{0};         //time ImpedanceStage took on the last frame
+    QAtomicInteger<qint64> reconstructionNs{0};         //time the mat-vec of the last image took
+    QAtomicInteger<qint64> sweepDeadTimeMs{0};          //end of the previous sweep step to saving of the last one
+    QAtomicInteger<quint64> frequencyResetFrame{0};     //framesProduced when the last frequency table was applied
+    QAtomicInteger<qint64> commandRttUs{0};             //smoothed command round-trip time
+    QAtomicInteger<int> streamClients{0};               //connected frame stream clients
+    QAtomicInteger<int> processingCpu{-1};              //CPU processingDataThread is pinned to, -1 if not pinned
+    QAtomicInteger<int> consumerCpu{-1};                //CPU dataConsumerThread is pinned to, -1 if not pinned
+    QAtomicInteger<int> realtimeThreads{0};             //worker threads granted SCHED_FIFO
+    QAtomicInteger<int> memoryLocked{0};                //1 if the process memory is locked into RAM
+    QAtomicInteger<int> decodeThreads{1};               //threads decoding each batch of datagrams
+    QAtomicInteger<qint64> decodeNs{0};                 //time the text decoding of the last batch took
+    QAtomicInteger<int> reorderHeld{0};                 //records waiting in the reorder buffers
+    QAtomicInteger<qint64> reorderDelayUs{0};           //time the last held record waited
+};
+
+#endif // PIPELINEMETRICS_H
@@ -0,0 +1,159 @@
+#include "pipelinetrace.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <QThread>
+#include <QFile>
+#include <QTextStream>
+
+QAtomicInteger<bool> PipelineTrace::s_enabled{false};
+
+namespace {
+
+const quint32 ringCapacity = 1u << 16;          //events kept per thread, must be a power of two
+const quint32 ringSlack = 1024;                 //newest-but-oldest slots skipped on dump, owner may be overwriting them
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 beginNs;
+    qint64 endNs;
+};
+
+//one ring per thread, written only by its owner thread
+struct ThreadRing
+{
+    QString threadName;
+    int tid = 0;
+    QAtomicInteger<quint32> head{0};            //total number of events written so far
+    TraceEvent events[ringCapacity];
+};
+
+QMutex &registryMutex()
+{
+    static QMutex mutex;
+    return mutex;
+}
+
+//rings are never freed, a thread may finish before the trace is written
+QVector<ThreadRing *> &registry()
+{
+    static QVector<ThreadRing *> rings;
+    return rings;
+}
+
+thread_local ThreadRing *t_ring = nullptr;
+
+//only the first span of each thread takes the registry mutex
+ThreadRing *ringForCurrentThread()
+{
+    if (t_ring)
+        return t_ring;
+
+    ThreadRing *ring = new ThreadRing;
+    QThread *thread = QThread::currentThread();
+    if (thread && !thread->objectName().isEmpty())
+        ring->threadName = thread->objectName();
+    else
+        ring->threadName = QString("thread 0x%1").arg(reinterpret_cast<quintptr>(thread), 0, 16);
+
+    QMutexLocker locker(&registryMutex());
+    ring->tid = registry().size() + 1;
+    registry().append(ring);
+    t_ring = ring;
+    return ring;
+}
+
+const QElapsedTimer &traceClock()
+{
+    static const QElapsedTimer timer = [](){
+        QElapsedTimer t;
+        t.start();
+        return t;
+    }();
+    return timer;
+}
+
+QString escaped(QString text)
+{
+    return text.replace('\\', "\\\\").replace('"', "\\\"");
+}
+
+} // namespace
+
+/**
+ * @brief PipelineTrace::setEnabled
+ * Turns span recording on or off, spans already recorded are kept for writing
+ */
+void PipelineTrace::setEnabled(bool enabled)
+{
+    traceClock();
+    s_enabled.storeRelaxed(enabled);
+}
+
+/**
+ * @brief PipelineTrace::nowNs
+ * Nanoseconds since the trace clock was first used, monotonic and shared by all threads
+ */
+qint64 PipelineTrace::nowNs()
+{
+    return traceClock().nsecsElapsed();
+}
+
+/**
+ * @brief PipelineTrace::record
+ * Stores one finished span in the calling thread's ring, overwriting the oldest one when full.
+ * Lock-free: only the owner thread writes its ring, the head is published with release ordering
+ */
+void PipelineTrace::record(const char *name, qint64 beginNs, qint64 endNs)
+{
+    ThreadRing *ring = ringForCurrentThread();
+    const quint32 index = ring->head.loadRelaxed();
+    ring->events[index & (ringCapacity - 1)] = TraceEvent{name, beginNs, endNs};
+    ring->head.storeRelease(index + 1);
+}
+
+/**
+ * @brief PipelineTrace::writeChromeTrace
+ * Writes every recorded span as a complete ("X") event in Chrome trace JSON format,
+ * along with thread name metadata so each ring shows up as a named track.
+ * Can be called while tracing is still running
+ */
+bool PipelineTrace::writeChromeTrace(const QString &filePath, QString *errorString)
+{
+    QVector<ThreadRing *> rings;
+    {
+        QMutexLocker locker(&registryMutex());
+        rings = registry();
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"EMT_IP\"}}";
+
+    for (const ThreadRing *ring : qAsConst(rings)) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->tid
+            << ",\"args\":{\"name\":\"" << escaped(ring->threadName) << "\"}}";
+
+        const quint32 end = ring->head.loadAcquire();
+        const quint32 count = qMin(end, ringCapacity - ringSlack);
+        for (quint32 i = end - count; i != end; ++i) {
+            const TraceEvent &event = ring->events[i & (ringCapacity - 1)];
+            out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":" << QString::number(event.beginNs / 1000.0, 'f', 3)
+                << ",\"dur\":" << QString::number((event.endNs - event.beginNs) / 1000.0, 'f', 3) << "}";
+        }
+    }
+
+    out << "\n]}\n";
+    file.close();
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef PIPELINETRACE_H
+#define PIPELINETRACE_H
+
+#include <QString>
+#include <QAtomicInteger>
+
+/**
+ * @brief The PipelineTrace class
+ *
+ * Optional tracing of begin/end spans for each stage of the acquisition pipeline
+ * (mainThread, processingDataThread and dataConsumerThread).
+ * Every thread records into its own fixed-size ring of events, so recording never takes a lock,
+ * the rings are only allocated once tracing has been enabled.
+ * Recorded spans can be written on demand as a Chrome trace JSON file (chrome://tracing, Perfetto)
+ */
+
+class PipelineTrace
+{
+public:
+    static void setEnabled(bool enabled);                       //turns recording on/off for all threads
+    static bool isEnabled() { return s_enabled.loadRelaxed(); } //cheap check done by every span
+    static qint64 nowNs();                                      //monotonic timestamp used for all spans
+    static void record(const char *name, qint64 beginNs, qint64 endNs);    //stores one finished span for the calling thread
+    static bool writeChromeTrace(const QString &filePath, QString *errorString = nullptr);  //dumps all rings to a JSON file
+
+private:
+    static QAtomicInteger<bool> s_enabled;                      //global recording flag
+};
+
+/**
+ * @brief The TraceSpan class
+ *
+ * RAII helper, records the time between its construction and destruction as one span.
+ * Does nothing but a flag check when tracing is disabled.
+ * The name must be a string literal (only the pointer is stored)
+ */
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name)
+        : m_name(name)
+        , m_beginNs(PipelineTrace::isEnabled() ? PipelineTrace::nowNs() : -1)
+    {
+    }
+    ~TraceSpan()
+    {
+        if (m_beginNs >= 0)
+            PipelineTrace::record(m_name, m_beginNs, PipelineTrace::nowNs());
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    const char *m_name;                                         //span name, string literal
+    qint64 m_beginNs;                                           //-1 if tracing was off when the span started
+};
+
+#define TRACE_SPAN_CONCAT_INNER(a, b) a##b
+#define TRACE_SPAN_CONCAT(a, b) TRACE_SPAN_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_SPAN_CONCAT(traceSpan_, __LINE__)(name)   //records the enclosing scope as a span
+
+#endif // PIPELINETRACE_H
@@ -1,107 +1,184 @@
 #include "processingdata.h"
-#include <QRegularExpression>
+#include "pipelinetrace.h"
 #include <QtMath>
-#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
 #include <algorithm>
 
-ProcessingData::ProcessingData(SharedBuffer *sharedBuffer, QObject *parent)
+ProcessingData::ProcessingData(SharedBuffer *sharedBuffer, PipelineMetrics *metrics, QObject *parent)
     : QObject{parent}
     , m_sharedBuffer(sharedBuffer)
+    , m_metrics(metrics)
+    , m_sequenceTrackers(FrequencyRouter::defaultFrequencies)
+    , m_reorderBuffers(FrequencyRouter::defaultFrequencies)
+    , m_reorderTimer(new QTimer(this))                              //child, moves to processingDataThread with this object
 {
+    m_reorderTimer->setSingleShot(true);
+    connect(m_reorderTimer, &QTimer::timeout, this, [this](){ flushReorderBuffers(true); });
+    m_reorderClock.start();
+    m_benchmarkPool.setMaxThreadCount(1);
 }
 
-void ProcessingData::processDatagrams(const QList<QByteArray> &datagrams)
+/**
+ * @brief ProcessingData::setCoilSequence
+ * Sequence followed by the trackers and reorder buffers, posted from the main thread when a sequence is sent.
+ * Records held under the old sequence are released first
+ */
+void ProcessingData::setCoilSequence(const CoilSequence &sequence)
 {
+    flushReorderBuffers(false);
+    for (SequenceTracker &tracker : m_sequenceTrackers)
+        tracker.setSequence(sequence);
+    for (ReorderBuffer &buffer : m_reorderBuffers)
+        buffer.setSequence(sequence);
+}
+
+/**
+ * @brief ProcessingData::resetFrequencies
+ * Posted from the main thread when frequencies are sent, trackers are claimed again by the new frequencies.
+ * A table longer than the default gets one tracker per entry, new trackers follow the current sequence
+ */
+void ProcessingData::resetFrequencies(int frequencies)
+{
+    flushReorderBuffers(false);
+    const int count = qMax(int(FrequencyRouter::defaultFrequencies), frequencies);
+    if (count != m_sequenceTrackers.size()) {
+        const CoilSequence sequence = m_sequenceTrackers.first().sequence();
+        const int previous = m_sequenceTrackers.size();
+        //totals of the trackers and buffers dropped by a shorter table are kept, the metrics are counters
+        for (int i = count; i < previous; ++i) {
+            m_retiredLost += m_sequenceTrackers.at(i).lostRecords();
+            m_retiredReordered += m_sequenceTrackers.at(i).reorderedRecords();
+            m_retiredRestored += m_reorderBuffers.at(i).restoredRecords();
+            m_retiredFlushed += m_reorderBuffers.at(i).flushedRecords();
+            m_retiredLate += m_reorderBuffers.at(i).lateRecords();
+        }
+        m_sequenceTrackers.resize(count);
+        m_reorderBuffers.resize(count);
+        for (int i = previous; i < count; ++i) {
+            m_sequenceTrackers[i].setSequence(sequence);
+            m_reorderBuffers[i].setSequence(sequence);
+        }
+        m_trackerRouter.setCapacity(count);
+    }
+    m_trackerRouter.reset();
+    for (SequenceTracker &tracker : m_sequenceTrackers)
+        tracker.reset();
+    for (ReorderBuffer &buffer : m_reorderBuffers)
+        buffer.reset();
+}
+
+/**
+ * @brief ProcessingData::onDatagramArrival
+ * Inter-arrival jitter as in RFC 3550: J += (|D| - J)/16,
+ * with D the deviation of this inter-arrival time from its running mean
+ */
+void ProcessingData::onDatagramArrival(qint64 arrivalNs)
+{
+    if (m_lastArrivalNs >= 0) {
+        const double interArrival = static_cast<double>(arrivalNs - m_lastArrivalNs);
+        if (m_meanInterArrivalNs == 0)
+            m_meanInterArrivalNs = interArrival;
+        else
+            m_meanInterArrivalNs += (interArrival - m_meanInterArrivalNs) / 16.0;
+        m_jitterNs += (qAbs(interArrival - m_meanInterArrivalNs) - m_jitterNs) / 16.0;
+    }
+    m_lastArrivalNs = arrivalNs;
+}
+
+/**
+ * @brief ProcessingData::setDecodeThreads
+ * Threads decoding each batch, this thread included, 1 decodes serially
+ */
+void ProcessingData::setDecodeThreads(int threads)
+{
+    m_decoder.setThreadCount(threads);
+    m_metrics->decodeThreads.storeRelaxed(m_decoder.threadCount());
+}
+
+void ProcessingData::setDecodeTuning(const ThreadTuning::Settings &settings)
+{
+    m_decoder.setThreadTuning(settings);
+}
+
+/**
+ * @brief ProcessingData::processDatagrams
+ * Text decoding is spread over the DatagramDecoder pool, its slabs are then taken in arrival order
+ * for everything that depends on record order (sequence trackers, decimation into the shared queues),
+ * so the output is the same as decoding the whole batch on this thread
+ */
+void ProcessingData::processDatagrams(const QList<QByteArray> &datagrams, const QVector<qint64> &arrivalNs)
+{
+    TRACE_SPAN("processDatagrams");
+
     // Local variables for processing (thread-local, so thread safe)
-    QStringList formattedChunks;
-    QStringList ADCListStr;
-    QStringList OTRListStr;
-    QList<qint32> convertedIntegers;
+    int adcCounts[StatusHistory::nibbleValues] = {};    //ADC nibble histogram of the batch
+    int otrRecords = 0;                                 //records with a non-zero OTR nibble
+    bool invalidStatus = false;                         //an ADC/OTR digit was not hexadecimal
+    int tokenErrors = 0;                                //tokens that failed toUInt
+    QVector<qint32> convertedIntegers;
     QList<qint32> finalFrequency;
 
-    // For each datagram, process in 32-character segments.
-    for (const QByteArray &buffer : datagrams) {
-        QString binaryString = QString(buffer);
-        for (int i = 0; i + 32 <= binaryString.length(); i += 32) {
-            QString chunk = binaryString.mid(i, 32);
-            QString FrequencyRas = chunk.mid(0, 4);
-            QString SCoil = chunk.mid(4, 1);
-            QString ECoil = chunk.mid(5, 1);
-            QString ADC = chunk.mid(6, 1);
-            ADCListStr.append(ADC);
-            QString OTR = chunk.mid(7, 1);
-            OTRListStr.append(OTR);
-            QString IData = chunk.mid(8, 8);
-            QString FrequencyStand = chunk.mid(16, 8);
-            QString QData = chunk.mid(24, 8);
-            QString formattedChunk = QString("%1,%2,%3,%4;%5,%6;")
-                                         .arg(FrequencyRas)
-                                         .arg(SCoil)
-                                         .arg(ECoil)
-                                         .arg(IData)
-                                         .arg(FrequencyStand)
-                                         .arg(QData);
-            formattedChunks.append(formattedChunk);
+    m_metrics->packetsReceived.fetchAndAddRelaxed(datagrams.size());
+    for (qint64 t : arrivalNs)
+        onDatagramArrival(t);
+    m_recordTrackers.clear();
+    m_recordCoils.clear();
+    m_recordStatus.clear();
+
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
+    m_decoder.decode(datagrams);
+    m_metrics->decodeNs.storeRelaxed(decodeTimer.nsecsElapsed());
+
+    //sequencer: slabs in arrival order, each record is routed to the reorder buffer/tracker of its frequency
+    for (int s = 0; s < m_decoder.slabCount(); ++s) {
+        const DatagramDecoder::Slab &slab = m_decoder.slab(s);
+        for (const DatagramDecoder::Record &record : slab.records) {
+            const int tracker = record.frequencyKey < 0 ? -1 : m_trackerRouter.route(record.frequencyKey);
+            const bool known = record.sensing >= 0 && record.excitation >= 0;
+            m_recordTrackers.append(known ? tracker : -1);
+            m_recordCoils.append(known ? quint8(record.sensing << 4 | record.excitation) : quint8(0));
+            m_recordStatus.append(record.status);
         }
+        for (int n = 0; n < StatusHistory::nibbleValues; ++n)
+            adcCounts[n] += slab.adcCounts[n];
+        otrRecords += slab.otrRecords;
+        invalidStatus = invalidStatus || slab.invalidStatus;
+        tokenErrors += slab.tokenErrors;
+        convertedIntegers.append(slab.integers);
     }
+    m_metrics->recordsDecoded.fetchAndAddRelaxed(m_recordStatus.size());
 
-    quint32 sumOTR = 0;
-    for (const QString &otrStr : OTRListStr){
-        bool sumOTRok = false;
-        quint32 value = otrStr.toUInt(&sumOTRok, 16);
-        if(!sumOTRok){
-            return;
-        }
-        sumOTR += value;
+    //a batch with a non-hexadecimal ADC/OTR digit is dropped, its records never reach the trackers
+    if (invalidStatus) {
+        m_metrics->decodeErrors.fetchAndAddRelaxed(1);
+        updateSequenceStats();
+        return;
     }
-    if (sumOTR > 0)
+    m_metrics->overRange.storeRelaxed(otrRecords > 0 ? 1 : 0);
+    if (otrRecords > 0)
         emit booleanOTRUpdated("YES");
     else
         emit booleanOTRUpdated("NO");
 
-    QHash<QString, int> adcCount;
-    for (const QString &adcStr : ADCListStr){
-        bool ADCok = false;
-        quint32 value = adcStr.toUInt(&ADCok, 16);
-        if(!ADCok){
-            return;
-        }
-        adcCount[adcStr] += 1;
-    }
-
-    quint32 modeValue = 0;
-    int maxCount = 0;
-    int modeCandidates = 0;
-    for(auto it = adcCount.constBegin() ; it !=adcCount.constEnd(); ++it){
-        if(it.value()>maxCount){
-            maxCount = it.value();
-            modeValue = it.key().toUInt(nullptr,16);
-            modeCandidates = 1;
-        } else if (it.value() == maxCount){
-            modeCandidates++;
-        }
-    }
+    const int finalMode = StatusHistory::modeOf(adcCounts);
+    m_metrics->adcMode.storeRelaxed(finalMode);
+    emit numberADCUpdated(QString::number(finalMode));
 
-    quint32 finalMode = (maxCount > 1 && modeCandidates == 1) ? modeValue : 0;
-    QString mode = QString::number(finalMode);
-    emit numberADCUpdated(mode);
+    //rolling history, sent to the GUI once per second
+    m_statusHistory.setWindow(m_statusHistorySeconds.loadRelaxed());
+    if (!arrivalNs.isEmpty() && m_statusHistory.addBatch(arrivalNs.last(), adcCounts, m_recordStatus.size(), otrRecords))
+        emit statusHistoryUpdated(m_statusHistory.adcMode(), 100.0 * m_statusHistory.otrRate());
 
-    // Continue processing: reverse the overall string and tokenize.
-    QString finalOutput = formattedChunks.join("");
-    std::reverse(finalOutput.begin(), finalOutput.end());
+    // Reversed overall string: reversed slabs, last slab first (tokens were converted by the decoder)
+    QString finalOutput;
+    for (int s = m_decoder.slabCount() - 1; s >= 0; --s)
+        finalOutput.append(m_decoder.slab(s).text);
     emit rawDataUpdated(finalOutput);
-
-    static const QRegularExpression re("[,;]");
-    QStringList tokens = finalOutput.split(re, Qt::SkipEmptyParts);
-    for (const QString &token : tokens) {
-        bool ok = false;
-        quint32 uValue = token.toUInt(&ok, 16);
-        if (ok)
-            convertedIntegers.append(static_cast<qint32>(uValue));
-        else
-            qDebug() << "Error converting token to int:" << token;
-    }
-    std::reverse(convertedIntegers.begin(), convertedIntegers.end());
+    if (tokenErrors > 0)
+        m_metrics->decodeErrors.fetchAndAddRelaxed(tokenErrors);
 
     // Decimate the converted integers into 6 arrays.
     QList<qint32> decimated[6];
@@ -146,26 +223,183 @@ void ProcessingData::processDatagrams(const QList<QByteArray> &datagrams)
     }
     emit processedDataReady(result);*/
 
+    //one sample per complete record (the sixth array is the shortest), through the reorder buffer of its frequency
+    const qint64 nowNs = m_reorderClock.nsecsElapsed();
+    const int depth = m_reorderDepth.loadRelaxed();
+    m_released.clear();
     {
-        QMutexLocker locker(&m_sharedBuffer->mutex);
-        for (const qint64 &val : qAsConst(finalFrequency)){
-            m_sharedBuffer->bufferFinalFrequency.enqueue(val);
+        TRACE_SPAN("reorderSamples");
+        for (ReorderBuffer &buffer : m_reorderBuffers)
+            buffer.setDepth(depth, nowNs, m_released);
+        //ordering and tracking use the nibbles of each record, a bad token only shifts the decoded integers
+        for (int i = 0; i < sixthArrayDivided.size(); ++i) {
+            const ReorderBuffer::Sample sample = {finalFrequency.at(i), decimated[1].at(i), decimated[2].at(i),
+                                                  fourthArrayDivided.at(i), sixthArrayDivided.at(i),
+                                                  i < m_recordStatus.size() ? m_recordStatus.at(i) : quint8(0),
+                                                  i < m_recordCoils.size() ? m_recordCoils.at(i) : quint8(0),
+                                                  i < m_recordTrackers.size() ? m_recordTrackers.at(i) : -1};
+            if (sample.tracker < 0)
+                m_released.append(sample);
+            else
+                m_reorderBuffers[sample.tracker].push(sample, nowNs, m_released);
         }
-        for (const qint32 &val : qAsConst(decimated[1])){
-            m_sharedBuffer->bufferDecimated1.enqueue(val);
-        }
-        for (const qint32 &val : qAsConst(decimated[2])){
-            m_sharedBuffer->bufferDecimated2.enqueue(val);
-        }
-        for (const double &d : qAsConst(fourthArrayDivided)) {
-            m_sharedBuffer->bufferFourthArrayDivided.enqueue(d);
+        for (ReorderBuffer &buffer : m_reorderBuffers)
+            buffer.flushExpired(nowNs, qint64(m_reorderTimeoutMs.loadRelaxed()) * 1000000, m_released);
+    }
+    enqueueReleased();
+}
+
+/**
+ * @brief ProcessingData::enqueueReleased
+ * Released samples go through their sequence tracker in release order, then to the SharedBuffer queues.
+ * The flush timer is armed while records are held, so a gap is given up even if no more data arrives
+ */
+void ProcessingData::enqueueReleased()
+{
+    m_recordFlags.clear();
+    for (const ReorderBuffer::Sample &sample : qAsConst(m_released)) {
+        if (sample.tracker < 0)
+            m_recordFlags.append(SequenceTracker::SampleUnknownState);
+        else
+            m_recordFlags.append(m_sequenceTrackers[sample.tracker].onRecord(sample.coils >> 4, sample.coils & 0xF));
+    }
+
+    if (!m_released.isEmpty()) {
+        {
+            TRACE_SPAN("enqueueSharedBuffer");
+            QMutexLocker locker(&m_sharedBuffer->mutex);
+            for (int i = 0; i < m_released.size(); ++i) {
+                const ReorderBuffer::Sample &sample = m_released.at(i);
+                m_sharedBuffer->bufferFinalFrequency.enqueue(sample.frequency);
+                m_sharedBuffer->bufferDecimated1.enqueue(sample.sensing);
+                m_sharedBuffer->bufferDecimated2.enqueue(sample.excitation);
+                m_sharedBuffer->bufferFourthArrayDivided.enqueue(sample.real);
+                m_sharedBuffer->bufferSixthArrayDivided.enqueue(sample.imaginary);
+                m_sharedBuffer->bufferSampleFlags.enqueue(m_recordFlags.at(i));     //one flag per sample, same length as the other queues
+                m_sharedBuffer->bufferSampleStatus.enqueue(sample.status);
+            }
+            m_metrics->sharedBufferDepth.storeRelaxed(m_sharedBuffer->bufferFinalFrequency.size());
         }
-        //int idx = 0;
-        for (const double &d : qAsConst(sixthArrayDivided)) {
-            m_sharedBuffer->bufferSixthArrayDivided.enqueue(d);
-            //qDebug() << "queued times: " << ++idx;
+        m_sharedBuffer->dataAvailable.wakeAll();
+    }
+
+    int held = 0;
+    qint64 restored = m_retiredRestored;
+    qint64 flushed = m_retiredFlushed;
+    qint64 late = m_retiredLate;
+    qint64 delayNs = 0;
+    for (const ReorderBuffer &buffer : qAsConst(m_reorderBuffers)) {
+        held += buffer.held();
+        restored += buffer.restoredRecords();
+        flushed += buffer.flushedRecords();
+        late += buffer.lateRecords();
+        delayNs = qMax(delayNs, buffer.lastDelayNs());
+    }
+    m_metrics->reorderHeld.storeRelaxed(held);
+    m_metrics->reorderRestored.storeRelaxed(restored);
+    m_metrics->reorderFlushed.storeRelaxed(flushed);
+    m_metrics->reorderLate.storeRelaxed(late);
+    m_metrics->reorderDelayUs.storeRelaxed(delayNs / 1000);
+    if (held > 0 && !m_reorderTimer->isActive())
+        m_reorderTimer->start(qMax(1, m_reorderTimeoutMs.loadRelaxed()));
+    updateSequenceStats();
+}
+
+/**
+ * @brief ProcessingData::flushReorderBuffers
+ * Timer expiry gives up on the gaps older than the timeout and on records beyond a lowered depth,
+ * a new sequence or frequency table releases everything
+ */
+void ProcessingData::flushReorderBuffers(bool expiredOnly)
+{
+    m_released.clear();
+    const qint64 nowNs = m_reorderClock.nsecsElapsed();
+    const int depth = m_reorderDepth.loadRelaxed();
+    for (ReorderBuffer &buffer : m_reorderBuffers) {
+        if (expiredOnly) {
+            buffer.setDepth(depth, nowNs, m_released);
+            buffer.flushExpired(nowNs, qint64(m_reorderTimeoutMs.loadRelaxed()) * 1000000, m_released);
+        } else {
+            buffer.flush(m_released);
         }
     }
-    m_sharedBuffer->dataAvailable.wakeAll();
+    enqueueReleased();
 }
 
+void ProcessingData::updateSequenceStats()
+{
+    qint64 lostRecords = m_retiredLost;
+    qint64 reorderedRecords = m_retiredReordered;
+    for (const SequenceTracker &tracker : m_sequenceTrackers) {
+        lostRecords += tracker.lostRecords();
+        reorderedRecords += tracker.reorderedRecords();
+    }
+    const double jitterUs = m_jitterNs / 1000.0;
+    m_metrics->lostRecords.storeRelaxed(lostRecords);
+    m_metrics->reorderedRecords.storeRelaxed(reorderedRecords);
+    m_metrics->arrivalJitterUs.storeRelaxed(qRound(jitterUs));
+    emit sequenceStatsUpdated(lostRecords, reorderedRecords, jitterUs);
+}
+
+
+/**
+ * @brief ProcessingData::startDecodeBenchmark
+ * The benchmark runs on its own thread so processingDataThread keeps draining datagrams, it still
+ * competes with live decoding for the cores, so the rates are lower while acquiring
+ */
+bool ProcessingData::startDecodeBenchmark()
+{
+    if (!m_benchmarkRunning.testAndSetAcquire(0, 1))
+        return false;
+    m_benchmarkPool.start([this](){
+        runDecodeBenchmark();
+        m_benchmarkRunning.storeRelease(0);
+    });
+    return true;
+}
+
+/**
+ * @brief ProcessingData::runDecodeBenchmark
+ * Synthetic batches of 256 datagrams x 32 records through a separate decoder with 1, 2, 4, ... threads
+ * up to the core count, records/s and speedup over one thread go to the message log.
+ * Uses only local decoders, the trackers, queues and metrics of this session are not touched
+ */
+void ProcessingData::runDecodeBenchmark()
+{
+    TRACE_SPAN("decodeBenchmark");
+    const int datagramsPerBatch = 256;
+    const int recordsPerDatagram = 32;
+    const int batches = 20;
+    QList<QByteArray> datagrams;
+    quint32 seed = 12345;
+    for (int d = 0; d < datagramsPerBatch; ++d) {
+        QByteArray datagram;
+        for (int r = 0; r < recordsPerDatagram; ++r) {
+            const int step = (d * recordsPerDatagram + r) / SequenceTracker::samplesPerState;
+            datagram += "0100" + QByteArray::number(step % 15 + 1, 16) + QByteArray::number(step % 16, 16) + "00";
+            seed = seed * 1664525u + 1013904223u;
+            datagram += QByteArray::number(seed, 16).rightJustified(8, '0') + "000186A0";
+            seed = seed * 1664525u + 1013904223u;
+            datagram += QByteArray::number(seed, 16).rightJustified(8, '0');
+        }
+        datagrams.append(datagram);
+    }
+
+    const int cores = qMax(1, QThread::idealThreadCount());
+    double serialRate = 0;
+    for (int threads = 1; ; threads = qMin(threads * 2, cores)) {
+        DatagramDecoder decoder(threads);
+        decoder.decode(datagrams);                  //slabs grow once, as in acquisition
+        QElapsedTimer timer;
+        timer.start();
+        for (int batch = 0; batch < batches; ++batch)
+            decoder.decode(datagrams);
+        const double rate = double(batches) * datagramsPerBatch * recordsPerDatagram / (timer.nsecsElapsed() / 1.0e9);
+        if (threads == 1)
+            serialRate = rate;
+        emit statusChanged(QString("Decoding benchmark: %1 thread(s), %2 records/s, %3x")
+                               .arg(threads).arg(rate, 0, 'f', 0).arg(rate / serialRate, 0, 'f', 2));
+        if (threads == cores)
+            break;
+    }
+}
@@ -9,6 +9,17 @@
 #include <QVector>
 #include <QList>
 #include "sharedbuffer.h"
+#include "pipelinemetrics.h"
+#include "sequencetracker.h"
+#include "frequencyrouter.h"
+#include "statushistory.h"
+#include "datagramdecoder.h"
+#include "reorderbuffer.h"
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+#include <QThreadPool>
+
+class QTimer;
 
 /**
  * @brief The ProcessingData class
@@ -23,10 +34,19 @@ class ProcessingData : public QObject
 {
     Q_OBJECT
 public:
-    explicit ProcessingData(SharedBuffer *sharedBuffer, QObject *parent = nullptr);
+    explicit ProcessingData(SharedBuffer *sharedBuffer, PipelineMetrics *metrics, QObject *parent = nullptr);
+
+    void setCoilSequence(const CoilSequence &sequence);             //programmed sequence followed by the trackers, call on this thread
+    void resetFrequencies(int frequencies);                         //new frequency table of this length, call on this thread
+    void setDecodeThreads(int threads);                             //threads decoding each batch, call on this thread
+    void setDecodeTuning(const ThreadTuning::Settings &settings);   //priority of the decoding threads, call on this thread
+    bool startDecodeBenchmark();                                    //thread-safe, runs off processingDataThread, false if already running
+    QAtomicInteger<int> m_statusHistorySeconds{10};                 //window of the rolling ADC-mode/OTR-rate history
+    QAtomicInteger<int> m_reorderDepth{64};                         //records each reorder buffer may hold (about two datagrams), 0 = off
+    QAtomicInteger<int> m_reorderTimeoutMs{5};                      //longest a held record waits for its gap to fill
 
 public slots:
-    void processDatagrams(const QList<QByteArray> &datagrams);      //processes the incoming UDP data
+    void processDatagrams(const QList<QByteArray> &datagrams, const QVector<qint64> &arrivalNs);    //processes the incoming UDP data
 
 signals:
     void processedDataReady(const QString &result);                 //notifies other threads that an UDP packet has been parsed fully
@@ -34,9 +54,43 @@ signals:
     void numberADCUpdated(const QString &modeADC);                  //to update 'ADC level' display on GUI
     void samplesPacketUpdated(const int &samplesPerPacket);         //to update 'Samples/Packet display on GUI
     void rawDataUpdated(const QString &rawDatastr);                 //to update 'Raw Data' display on GUI
+    void sequenceStatsUpdated(const qint64 &lostRecords, const qint64 &reorderedRecords, const double &jitterUs);   //to update Diagnostics displays
+    void statusHistoryUpdated(const int &adcMode, const double &otrRatePercent);    //StatusHistory over the window, once per second
+    void statusChanged(const QString &status);                      //to log benchmark results on GUI
 
 private:
     SharedBuffer *m_sharedBuffer;                                   //pointer to shared container between two threads
+    PipelineMetrics *m_metrics;                                     //pointer to counters read by the metrics endpoint
+    void onDatagramArrival(qint64 arrivalNs);                       //updates the inter-arrival jitter estimate
+    void enqueueReleased();                                         //tracks and queues m_released for dataConsumerThread
+    void flushReorderBuffers(bool expiredOnly);                     //releases held records, all or those past the timeout
+    void updateSequenceStats();                                     //tracker totals to metrics and Diagnostics displays
+    void runDecodeBenchmark();                                      //records/s of the decoder versus thread count, on m_benchmarkPool
+
+    DatagramDecoder m_decoder;                                      //text decoding of each batch, spread over its pool
+    FrequencyRouter m_trackerRouter;                                //frequency field of a record -> its tracker
+    QVector<SequenceTracker> m_sequenceTrackers;                    //one per frequency, detects lost/reordered records from coil progression
+    QVector<ReorderBuffer> m_reorderBuffers;                        //one per frequency, same slots as the trackers
+    QTimer *m_reorderTimer;                                         //gives up on held records when no more data arrives
+    QElapsedTimer m_reorderClock;                                   //hold times of the reorder buffers
+    QVector<int> m_recordTrackers;                                  //per-record tracker slot (-1 if unknown), capacity reused between batches
+    QVector<quint8> m_recordCoils;                                  //per-record S << 4 | E nibbles (ordering/tracking key), same
+    QVector<quint8> m_recordStatus;                                 //per-record ADC << 4 | OTR nibbles, same
+    QVector<ReorderBuffer::Sample> m_released;                      //samples released in order, same
+    QVector<quint8> m_recordFlags;                                  //tracker flags of the released samples, same
+    StatusHistory m_statusHistory;                                  //ADC/OTR aggregates of the last seconds
+    qint64 m_retiredLost = 0;                                       //totals of trackers/buffers dropped by resetFrequencies
+    qint64 m_retiredReordered = 0;
+    qint64 m_retiredRestored = 0;
+    qint64 m_retiredFlushed = 0;
+    qint64 m_retiredLate = 0;
+
+    qint64 m_lastArrivalNs = -1;                                    //receive time of the previous datagram
+    double m_meanInterArrivalNs = 0;                                //smoothed inter-arrival time
+    double m_jitterNs = 0;                                          //smoothed |inter-arrival - mean|, RFC 3550 style 1/16 gain
+
+    QAtomicInteger<int> m_benchmarkRunning{0};
+    QThreadPool m_benchmarkPool;                                    //one thread, last member so it is joined first on destruction
 };
 
 #endif // PROCESSINGDATA_H
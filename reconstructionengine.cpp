@@ -0,0 +1,471 @@
+#include "reconstructionengine.h"
+#include "pipelinetrace.h"
+#include <QFile>
+#include <QtEndian>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <QtNumeric>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RECONSTRUCTIONENGINE_SSE2
+#endif
+
+static const char sensitivityFileMagic[4] = {'E', 'M', 'T', 'S'};
+static const int sensitivityHeaderSize = 12;
+static const int l2CacheBytes = 256 * 1024;                    //conservative per-core L2 size for block sizing
+
+static int pixelsPerBlockFor(int m)
+{
+    return qMax(16, l2CacheBytes / int(m * sizeof(double)));
+}
+
+//out[row] = dot(rows[row], v) for rows [first, last), rows of m values, two products per SSE2 instruction
+static void dotRows(const double *rows, int m, const double *v, double *out, int first, int last)
+{
+    for (int row = first; row < last; ++row) {
+        const double *r = rows + qint64(row) * m;
+        int i = 0;
+        double sum = 0;
+#ifdef RECONSTRUCTIONENGINE_SSE2
+        __m128d accumulator0 = _mm_setzero_pd();
+        __m128d accumulator1 = _mm_setzero_pd();
+        for (; i + 4 <= m; i += 4) {
+            accumulator0 = _mm_add_pd(accumulator0, _mm_mul_pd(_mm_loadu_pd(r + i), _mm_loadu_pd(v + i)));
+            accumulator1 = _mm_add_pd(accumulator1, _mm_mul_pd(_mm_loadu_pd(r + i + 2), _mm_loadu_pd(v + i + 2)));
+        }
+        double lanes[2];
+        _mm_storeu_pd(lanes, _mm_add_pd(accumulator0, accumulator1));
+        sum = lanes[0] + lanes[1];
+#endif
+        for (; i < m; ++i)
+            sum += r[i] * v[i];
+        out[row] = sum;
+    }
+}
+
+//y += a * x over m values
+static void axpy(double a, const double *x, double *y, int m)
+{
+    int i = 0;
+#ifdef RECONSTRUCTIONENGINE_SSE2
+    const __m128d va = _mm_set1_pd(a);
+    for (; i + 2 <= m; i += 2)
+        _mm_storeu_pd(y + i, _mm_add_pd(_mm_loadu_pd(y + i), _mm_mul_pd(va, _mm_loadu_pd(x + i))));
+#endif
+    for (; i < m; ++i)
+        y[i] += a * x[i];
+}
+
+static double dot(const double *x, const double *y, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; ++i)
+        sum += x[i] * y[i];
+    return sum;
+}
+
+ReconstructionEngine::ReconstructionEngine(PipelineMetrics *metrics, QObject *parent)
+    : QObject{parent}
+    , m_metrics(metrics)
+{
+    m_pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+}
+
+/**
+ * @brief ReconstructionEngine::loadSensitivity
+ * Steps:
+ *      map the file and convert J to double
+ *      A = J J^T + lambda I, lambda = regularisation * trace(J J^T) / M (relative to the mean sensitivity)
+ *      Cholesky A = L L^T, solve A Y = J for all pixel columns
+ *      R = Y^T, stored one row per pixel
+ */
+void ReconstructionEngine::loadSensitivity(const QString &filePath, double regularisation)
+{
+    TRACE_SPAN("loadSensitivity");
+    m_ready.storeRelease(false);
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit statusChanged("Could not open sensitivity matrix: " + file.errorString());
+        return;
+    }
+    const qint64 fileSize = file.size();
+    const uchar *data = fileSize >= sensitivityHeaderSize ? file.map(0, fileSize) : nullptr;
+    if (!data || std::memcmp(data, sensitivityFileMagic, 4) != 0) {
+        emit statusChanged("Not a sensitivity matrix file: " + filePath);
+        return;
+    }
+    const quint32 M = qFromLittleEndian<quint32>(data + 4);
+    const quint32 P = qFromLittleEndian<quint32>(data + 8);
+    if (M == 0 || P == 0 || M > 16 * 16 || fileSize != sensitivityHeaderSize + qint64(M) * P * 4) {
+        emit statusChanged(QString("Sensitivity matrix size does not match its header (%1 x %2)").arg(M).arg(P));
+        return;
+    }
+
+    //J, row-major M x P
+    QVector<double> Y(int(M * P));
+    const uchar *values = data + sensitivityHeaderSize;
+    for (int i = 0; i < Y.size(); ++i) {
+        const quint32 bits = qFromLittleEndian<quint32>(values + 4 * i);
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        Y[i] = value;
+    }
+    file.unmap(const_cast<uchar *>(data));
+    file.close();
+
+    //J^T for the iterative modes, before Y is overwritten by the solve
+    const int m = int(M);
+    const int p = int(P);
+    m_sensitivityT.resize(p * m);
+    for (int row = 0; row < m; ++row) {
+        for (int pixel = 0; pixel < p; ++pixel)
+            m_sensitivityT[pixel * m + row] = Y[row * p + pixel];
+    }
+
+    //A = J J^T (symmetric M x M), lower triangle is enough for Cholesky
+    QVector<double> A(m * m, 0.0);
+    for (int i = 0; i < m; ++i) {
+        const double *rowI = Y.constData() + i * p;
+        for (int j = 0; j <= i; ++j) {
+            const double *rowJ = Y.constData() + j * p;
+            double sum = 0;
+            for (int k = 0; k < p; ++k)
+                sum += rowI[k] * rowJ[k];
+            A[i * m + j] = sum;
+        }
+    }
+    double trace = 0;
+    for (int i = 0; i < m; ++i)
+        trace += A[i * m + i];
+    const double lambda = regularisation * trace / m;
+
+    //largest eigenvalue of J J^T by power iteration, sets a Landweber step that always converges
+    QVector<double> eigenvector(m, 1.0);
+    QVector<double> product(m);
+    double largestEigenvalue = trace;
+    for (int iteration = 0; iteration < 50; ++iteration) {
+        for (int i = 0; i < m; ++i) {
+            double sum = 0;
+            for (int j = 0; j < m; ++j)
+                sum += (j <= i ? A[i * m + j] : A[j * m + i]) * eigenvector[j];
+            product[i] = sum;
+        }
+        const double norm = std::sqrt(dot(product.constData(), product.constData(), m));
+        if (norm <= 0)
+            break;
+        largestEigenvalue = norm / std::sqrt(dot(eigenvector.constData(), eigenvector.constData(), m));
+        for (int i = 0; i < m; ++i)
+            eigenvector[i] = product[i] / norm;
+    }
+
+    for (int i = 0; i < m; ++i)
+        A[i * m + i] += lambda;
+
+    //Cholesky, L overwrites the lower triangle of A
+    for (int j = 0; j < m; ++j) {
+        double diagonal = A[j * m + j];
+        for (int k = 0; k < j; ++k)
+            diagonal -= A[j * m + k] * A[j * m + k];
+        if (diagonal <= 0) {
+            emit statusChanged("Sensitivity matrix is singular, increase the regularisation");
+            return;
+        }
+        diagonal = std::sqrt(diagonal);
+        A[j * m + j] = diagonal;
+        for (int i = j + 1; i < m; ++i) {
+            double sum = A[i * m + j];
+            for (int k = 0; k < j; ++k)
+                sum -= A[i * m + k] * A[j * m + k];
+            A[i * m + j] = sum / diagonal;
+        }
+    }
+
+    //solve L Z = J, then L^T Y = Z, row operations run over all pixel columns at once
+    for (int i = 0; i < m; ++i) {
+        double *rowI = Y.data() + i * p;
+        for (int k = 0; k < i; ++k) {
+            const double factor = A[i * m + k];
+            const double *rowK = Y.constData() + k * p;
+            for (int c = 0; c < p; ++c)
+                rowI[c] -= factor * rowK[c];
+        }
+        const double inverseDiagonal = 1.0 / A[i * m + i];
+        for (int c = 0; c < p; ++c)
+            rowI[c] *= inverseDiagonal;
+    }
+    for (int i = m - 1; i >= 0; --i) {
+        double *rowI = Y.data() + i * p;
+        for (int k = i + 1; k < m; ++k) {
+            const double factor = A[k * m + i];
+            const double *rowK = Y.constData() + k * p;
+            for (int c = 0; c < p; ++c)
+                rowI[c] -= factor * rowK[c];
+        }
+        const double inverseDiagonal = 1.0 / A[i * m + i];
+        for (int c = 0; c < p; ++c)
+            rowI[c] *= inverseDiagonal;
+    }
+
+    //R = Y^T
+    m_inverse.resize(p * m);
+    for (int row = 0; row < m; ++row) {
+        for (int pixel = 0; pixel < p; ++pixel)
+            m_inverse[pixel * m + row] = Y[row * p + pixel];
+    }
+    m_measurements = m;
+    m_pixels = p;
+    m_pixelsPerBlock = pixelsPerBlockFor(m);
+    m_measurementBuffer.resize(m);
+    m_lambda = lambda;
+    m_landweberStep = 1.0 / (largestEigenvalue + lambda);
+    m_previousImages.clear();
+    m_sizeWarningShown = false;
+    m_ready.storeRelease(true);
+    emit statusChanged(QString("Sensitivity matrix loaded: %1 measurements x %2 pixels").arg(m).arg(p));
+}
+
+/**
+ * @brief ReconstructionEngine::submitFrame
+ * Keeps the frame (implicitly shared, no copy) and posts one reconstruction if none is pending,
+ * a frame replaced before it was reconstructed counts as dropped
+ */
+void ReconstructionEngine::submitFrame(const QVector<QVector<double>> &frame)
+{
+    if (!m_enabled.loadRelaxed() || !m_ready.loadAcquire())
+        return;
+    {
+        QMutexLocker locker(&m_frameMutex);
+        if (m_frameWaiting)
+            m_metrics->imagesDropped.fetchAndAddRelaxed(1);
+        m_latestFrame = frame;
+        m_frameWaiting = true;
+    }
+    if (!m_scheduled.fetchAndStoreAcquire(true))
+        QMetaObject::invokeMethod(this, [this](){ reconstructLatest(); }, Qt::QueuedConnection);
+}
+
+/**
+ * @brief ReconstructionEngine::reconstructLatest
+ * Missing (NaN) and clipped states count as 0, i.e. no change from the reference.
+ * Pixel blocks are spread over the pool, the first block runs on this thread
+ */
+void ReconstructionEngine::reconstructLatest()
+{
+    TRACE_SPAN("reconstructImage");
+    QVector<QVector<double>> frame;
+    {
+        QMutexLocker locker(&m_frameMutex);
+        frame = m_latestFrame;
+        m_latestFrame.clear();
+        m_frameWaiting = false;
+        m_scheduled.storeRelease(false);
+    }
+    if (frame.isEmpty() || !m_ready.loadAcquire())
+        return;
+
+    const int row = m_measurementRow.loadRelaxed() == RowImaginary ? RowImaginary : RowReal;
+    const QVector<double> &measurements = frame[row];
+    if (measurements.size() != m_measurements) {
+        if (!m_sizeWarningShown) {
+            m_sizeWarningShown = true;
+            emit statusChanged(QString("Frame has %1 states, sensitivity matrix expects %2").arg(measurements.size()).arg(m_measurements));
+        }
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    const bool hasStatus = frame[RowStatus].size() == m_measurements;
+    for (int i = 0; i < m_measurements; ++i) {
+        const bool clipped = hasStatus && isClipped(frame[RowStatus][i]);
+        m_measurementBuffer[i] = qIsNaN(measurements[i]) || clipped ? 0.0 : measurements[i];
+    }
+
+    const double frequency = frame[RowFrequency].isEmpty() ? 0.0 : frame[RowFrequency].first();
+    const double *v = m_measurementBuffer.constData();
+    const int method = m_method.loadRelaxed();
+    QVector<double> image;
+
+    if (method == Linear) {
+        image.resize(m_pixels);
+        double *out = image.data();
+        const double *inverse = m_inverse.constData();
+        const int m = m_measurements;
+        runBlocks(m_pixels, m_pixelsPerBlock, [inverse, m, v, out](int first, int last, int){
+            dotRows(inverse, m, v, out, first, last);
+        });
+    } else {
+        //warm start from the previous image of this frequency
+        QVector<double> &previous = m_previousImages[qint64(frequency)];
+        if (previous.size() != m_pixels)
+            previous.fill(0.0, m_pixels);
+        const int iterations = solveIterative(m_sensitivityT.constData(), m_measurements, m_pixels, m_lambda, m_landweberStep,
+                                              method, v, previous.data(), qMax(1, m_maxIterations.loadRelaxed()),
+                                              qint64(m_timeBudgetUs.loadRelaxed()) * 1000);
+        m_metrics->reconstructionIterations.fetchAndAddRelaxed(iterations);
+        image = previous;
+    }
+
+    const qint64 elapsedNs = timer.nsecsElapsed();
+    m_metrics->reconstructionNs.storeRelaxed(elapsedNs);
+    m_metrics->imagesReconstructed.fetchAndAddRelaxed(1);
+    emit imageReady(image, frequency, elapsedNs);
+}
+
+/**
+ * @brief ReconstructionEngine::runBlocks
+ * Blocks of pixels sized to stay in L2, blocks 1.. go to the pool, block 0 runs on this thread
+ */
+void ReconstructionEngine::runBlocks(int p, int pixelsPerBlock, const std::function<void(int, int, int)> &work)
+{
+    int block = 1;
+    for (int first = pixelsPerBlock; first < p; first += pixelsPerBlock, ++block) {
+        const int last = qMin(first + pixelsPerBlock, p);
+        m_pool.start([&work, first, last, block](){ work(first, last, block); });
+    }
+    work(0, qMin(pixelsPerBlock, p), 0);
+    m_pool.waitForDone();
+}
+
+/**
+ * @brief ReconstructionEngine::forward
+ * measurements = J image, each block sums its pixels into its own partial vector, partials are added after
+ */
+void ReconstructionEngine::forward(const double *sensitivityT, int m, int p, const double *image, double *measurements)
+{
+    const int pixelsPerBlock = pixelsPerBlockFor(m);
+    const int blocks = (p + pixelsPerBlock - 1) / pixelsPerBlock;
+    m_partials.fill(0.0, blocks * m);
+    double *partials = m_partials.data();
+    runBlocks(p, pixelsPerBlock, [sensitivityT, m, image, partials](int first, int last, int block){
+        double *partial = partials + block * m;
+        for (int pixel = first; pixel < last; ++pixel) {
+            if (image[pixel] != 0.0)
+                axpy(image[pixel], sensitivityT + qint64(pixel) * m, partial, m);
+        }
+    });
+    for (int i = 0; i < m; ++i)
+        measurements[i] = 0.0;
+    for (int block = 0; block < blocks; ++block)
+        axpy(1.0, partials + block * m, measurements, m);
+}
+
+/**
+ * @brief ReconstructionEngine::adjoint
+ * image = J^T measurements, one dot product per pixel
+ */
+void ReconstructionEngine::adjoint(const double *sensitivityT, int m, int p, const double *measurements, double *image)
+{
+    runBlocks(p, pixelsPerBlockFor(m), [sensitivityT, m, measurements, image](int first, int last, int){
+        dotRows(sensitivityT, m, measurements, image, first, last);
+    });
+}
+
+/**
+ * @brief ReconstructionEngine::solveIterative
+ * Both modes minimise |J x - v|^2 + lambda |x|^2 starting from image, updated in place.
+ * Each iteration streams J^T twice (one J x, one J^T r). The time budget is checked after every
+ * iteration, so a frame overruns it by at most one iteration
+ */
+int ReconstructionEngine::solveIterative(const double *sensitivityT, int m, int p, double lambda, double step, int method,
+                                         const double *measurements, double *image, int maxIterations, qint64 budgetNs)
+{
+    QElapsedTimer timer;
+    timer.start();
+    m_residual.resize(m);
+    m_projection.resize(m);
+    m_gradient.resize(p);
+    m_direction.resize(p);
+    double *r = m_residual.data();
+    double *q = m_projection.data();
+    double *s = m_gradient.data();
+    double *d = m_direction.data();
+
+    //r = v - J x, s = J^T r - lambda x
+    forward(sensitivityT, m, p, image, q);
+    for (int i = 0; i < m; ++i)
+        r[i] = measurements[i] - q[i];
+    adjoint(sensitivityT, m, p, r, s);
+    axpy(-lambda, image, s, p);
+
+    int iterations = 0;
+    if (method == Landweber) {
+        while (iterations < maxIterations && timer.nsecsElapsed() < budgetNs) {
+            axpy(step, s, image, p);
+            forward(sensitivityT, m, p, image, q);
+            for (int i = 0; i < m; ++i)
+                r[i] = measurements[i] - q[i];
+            adjoint(sensitivityT, m, p, r, s);
+            axpy(-lambda, image, s, p);
+            ++iterations;
+        }
+        return iterations;
+    }
+
+    //CGLS with damping lambda
+    std::copy(s, s + p, d);
+    double gamma = dot(s, s, p);
+    while (iterations < maxIterations && timer.nsecsElapsed() < budgetNs && gamma > 0) {
+        forward(sensitivityT, m, p, d, q);
+        const double delta = dot(q, q, m) + lambda * dot(d, d, p);
+        if (delta <= 0)
+            break;
+        const double alpha = gamma / delta;
+        axpy(alpha, d, image, p);
+        axpy(-alpha, q, r, m);
+        adjoint(sensitivityT, m, p, r, s);
+        axpy(-lambda, image, s, p);
+        const double gammaNext = dot(s, s, p);
+        const double beta = gammaNext / gamma;
+        for (int i = 0; i < p; ++i)
+            d[i] = s[i] + beta * d[i];
+        gamma = gammaNext;
+        ++iterations;
+    }
+    return iterations;
+}
+
+/**
+ * @brief ReconstructionEngine::runBenchmark
+ * Random J with the 16-coil measurement count, 20 Landweber then 20 CGLS iterations per pixel count,
+ * results go to the message log. The Landweber step is 1 / (|J|_F^2 + lambda), the Frobenius norm
+ * bounds the largest eigenvalue of J J^T so no power iteration is timed. Does not touch the loaded matrix
+ */
+void ReconstructionEngine::runBenchmark()
+{
+    TRACE_SPAN("reconstructionBenchmark");
+    const int m = 120;
+    const int iterations = 20;
+    const int pixelCounts[] = {1024, 4096, 16384, 65536};
+    quint32 seed = 12345;
+    for (int p : pixelCounts) {
+        QVector<double> sensitivityT(p * m);
+        for (double &value : sensitivityT) {
+            seed = seed * 1664525u + 1013904223u;
+            value = (seed >> 8) / double(1 << 24) - 0.5;
+        }
+        QVector<double> measurements(m, 1.0);
+        const double lambda = 1e-3 * p;
+        const double step = 1.0 / (dot(sensitivityT.constData(), sensitivityT.constData(), p * m) + lambda);
+
+        const int methods[] = {Landweber, ConjugateGradient};
+        for (int method : methods) {
+            QVector<double> image(p, 0.0);
+            QElapsedTimer timer;
+            timer.start();
+            const int done = solveIterative(sensitivityT.constData(), m, p, lambda, step, method,
+                                            measurements.constData(), image.data(), iterations,
+                                            std::numeric_limits<qint64>::max());
+            const double seconds = timer.nsecsElapsed() / 1.0e9;
+            emit statusChanged(QString("Reconstruction benchmark: %1, %2 pixels x %3 measurements, %4 iterations/s")
+                                   .arg(method == Landweber ? "Landweber" : "CGLS").arg(p).arg(m).arg(done / seconds, 0, 'f', 1));
+        }
+    }
+}
+
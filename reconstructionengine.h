@@ -0,0 +1,97 @@
+#ifndef RECONSTRUCTIONENGINE_H
+#define RECONSTRUCTIONENGINE_H
+
+#include <QObject>
+#include <QVector>
+#include <QMutex>
+#include <QThreadPool>
+#include <QAtomicInteger>
+#include <QHash>
+#include <functional>
+#include "pipelinemetrics.h"
+#include "frameassembler.h"
+
+/**
+ * @brief The ReconstructionEngine class
+ *
+ * Linear image reconstruction on its own thread (reconstructionThread).
+ * The sensitivity matrix J (M measurements x P pixels, M = 120 for 16 coils, 28 for 8 coils) is read
+ * from a memory-mapped file and turned once into the Tikhonov inverse R = J^T (J J^T + lambda I)^-1,
+ * so each frame costs a single P x M mat-vec, image = R * measurements.
+ * Iterative modes (damped Landweber, CGLS) solve min |J x - v|^2 + lambda |x|^2 instead, warm-started
+ * from the previous image of the same frequency and stopped by an iteration count or a time budget.
+ * DataConsumer hands frames over through submitFrame(), only the latest frame is kept, so a slow
+ * reconstruction drops stale frames instead of queueing them.
+ *
+ * Sensitivity file (little endian): char[4] "EMTS", uint32 M, uint32 P, then M*P float32, row-major
+ * (row m holds the sensitivity of measurement m to every pixel)
+ */
+
+class ReconstructionEngine : public QObject
+{
+    Q_OBJECT
+public:
+    enum Method {
+        Linear = 0,                                             //precomputed Tikhonov inverse
+        Landweber,                                              //x += step * (J^T (v - J x) - lambda x)
+        ConjugateGradient                                       //CGLS on the damped normal equations
+    };
+
+    explicit ReconstructionEngine(PipelineMetrics *metrics, QObject *parent = nullptr);
+
+    void submitFrame(const QVector<QVector<double>> &frame);    //thread-safe, called on dataConsumerThread
+    QAtomicInteger<bool> m_enabled{false};                      //reconstructs submitted frames when true
+    QAtomicInteger<int> m_measurementRow{RowReal};              //frame row used as measurements, RowReal or RowImaginary
+    QAtomicInteger<int> m_method{Linear};
+    QAtomicInteger<int> m_maxIterations{10};                    //iterative modes, per frame
+    QAtomicInteger<int> m_timeBudgetUs{20000};                  //iterative modes, per frame
+
+public slots:
+    void loadSensitivity(const QString &filePath, double regularisation);   //maps J and precomputes R
+    void runBenchmark();                                        //iterations/s of Landweber and CGLS versus pixel count
+
+signals:
+    void imageReady(const QVector<double> &image, const double &frequency, const qint64 &elapsedNs);
+    void statusChanged(const QString &status);                  //to log loading/size errors on GUI
+
+private:
+    void reconstructLatest();                                   //runs on reconstructionThread
+
+    //iterative solve with J^T stored one row of m values per pixel, returns iterations done
+    int solveIterative(const double *sensitivityT, int m, int p, double lambda, double step, int method,
+                       const double *measurements, double *image, int maxIterations, qint64 budgetNs);
+    void forward(const double *sensitivityT, int m, int p, const double *image, double *measurements);   //J x
+    void adjoint(const double *sensitivityT, int m, int p, const double *measurements, double *image);   //J^T r
+    void runBlocks(int p, int pixelsPerBlock, const std::function<void(int, int, int)> &work);           //(first, last, block) on the pool
+
+    PipelineMetrics *m_metrics;
+    QThreadPool m_pool;                                         //workers of the mat-vec, blocks of pixels
+
+    //inverse and J^T, one row of M values per pixel so each pixel is a contiguous dot product
+    QVector<double> m_inverse;
+    QVector<double> m_sensitivityT;
+    double m_lambda = 0;                                        //absolute Tikhonov weight
+    double m_landweberStep = 0;                                 //1 / (largest eigenvalue of J J^T + lambda)
+    QHash<qint64, QVector<double>> m_previousImages;            //warm start of each frequency
+
+    //iterative mode scratch, sized on load
+    QVector<double> m_residual;                                 //M
+    QVector<double> m_projection;                               //M
+    QVector<double> m_gradient;                                 //P
+    QVector<double> m_direction;                                //P
+    QVector<double> m_partials;                                 //one M vector per pixel block, for J x
+    int m_measurements = 0;                                     //M
+    int m_pixels = 0;                                           //P
+    int m_pixelsPerBlock = 0;                                   //rows of m_inverse that fit in L2 cache
+    QAtomicInteger<bool> m_ready{false};
+
+    QMutex m_frameMutex;                                        //guards m_latestFrame
+    QVector<QVector<double>> m_latestFrame;
+    bool m_frameWaiting = false;                                //m_latestFrame not reconstructed yet
+    QAtomicInteger<bool> m_scheduled{false};                    //reconstructLatest already posted
+
+    QVector<double> m_measurementBuffer;                        //NaN-free measurements of the current frame
+    bool m_sizeWarningShown = false;
+};
+
+#endif // RECONSTRUCTIONENGINE_H
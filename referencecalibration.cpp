@@ -0,0 +1,226 @@
+#include "referencecalibration.h"
+#include "frameassembler.h"
+#include <QDataStream>
+#include <QFile>
+#include <QSaveFile>
+#include <QtNumeric>
+
+static const quint32 referenceFileMagic = 0x454D5452;      //"EMTR"
+static const quint32 referenceFileVersion = 1;
+
+/**
+ * @brief ReferenceCalibration::start
+ * Arrays are sized here for the frame length of the current sequence, addFrame never allocates
+ */
+void ReferenceCalibration::start(int frames, int states)
+{
+    m_targetFrames = frames;
+    m_frames = 0;
+    m_ready = false;
+    m_meanReal.fill(0.0, states);
+    m_meanImaginary.fill(0.0, states);
+    m_m2Real.fill(0.0, states);
+    m_m2Imaginary.fill(0.0, states);
+    m_samples.fill(0, states);
+}
+
+void ReferenceCalibration::clear()
+{
+    m_targetFrames = 0;
+    m_frames = 0;
+    m_ready = false;
+    m_meanReal.clear();
+    m_meanImaginary.clear();
+    m_m2Real.clear();
+    m_m2Imaginary.clear();
+    m_samples.clear();
+}
+
+/**
+ * @brief ReferenceCalibration::addFrame
+ * Only complete frames of the expected length are accumulated, states missing (NaN) or clipped
+ * in a frame are skipped for that frame only
+ */
+bool ReferenceCalibration::addFrame(const QVector<QVector<double>> &frame)
+{
+    if (!isCapturing())
+        return false;
+    const QVector<double> &realRow = frame[RowReal];
+    const QVector<double> &imaginaryRow = frame[RowImaginary];
+    const int states = m_meanReal.size();
+    if (realRow.size() != states || frame[RowComplete].isEmpty() || frame[RowComplete].first() == 0.0)
+        return false;
+
+    const bool hasStatus = frame[RowStatus].size() == states;
+    for (int i = 0; i < states; ++i) {
+        const double real = realRow[i];
+        const double imaginary = imaginaryRow[i];
+        if (qIsNaN(real) || qIsNaN(imaginary) || (hasStatus && isClipped(frame[RowStatus][i])))
+            continue;
+        const int n = ++m_samples[i];
+        const double deltaReal = real - m_meanReal[i];
+        m_meanReal[i] += deltaReal / n;
+        m_m2Real[i] += deltaReal * (real - m_meanReal[i]);
+        const double deltaImaginary = imaginary - m_meanImaginary[i];
+        m_meanImaginary[i] += deltaImaginary / n;
+        m_m2Imaginary[i] += deltaImaginary * (imaginary - m_meanImaginary[i]);
+    }
+    m_frequency = static_cast<qint64>(frame[RowFrequency].first());
+    ++m_frames;
+
+    if (--m_targetFrames > 0)
+        return false;
+    m_ready = true;
+    return true;
+}
+
+double ReferenceCalibration::varianceReal(int state) const
+{
+    return m_samples.at(state) > 1 ? m_m2Real.at(state) / (m_samples.at(state) - 1) : qQNaN();
+}
+
+double ReferenceCalibration::varianceImaginary(int state) const
+{
+    return m_samples.at(state) > 1 ? m_m2Imaginary.at(state) / (m_samples.at(state) - 1) : qQNaN();
+}
+
+/**
+ * @brief ReferenceCalibration::subtract
+ * Frames of another length (sequence changed since capture) are left untouched.
+ * States never present in the reference (missing or clipped in every frame) have no mean to remove,
+ * they become NaN rather than passing the raw I/Q through as if it were differential
+ */
+void ReferenceCalibration::subtract(QVector<QVector<double>> &frame) const
+{
+    const int states = m_meanReal.size();
+    if (!m_ready || frame[RowReal].size() != states)
+        return;
+    double *real = frame[RowReal].data();
+    double *imaginary = frame[RowImaginary].data();
+    for (int i = 0; i < states; ++i) {
+        if (m_samples[i] == 0) {
+            real[i] = qQNaN();
+            imaginary[i] = qQNaN();
+            continue;
+        }
+        real[i] -= m_meanReal[i];
+        imaginary[i] -= m_meanImaginary[i];
+    }
+}
+
+/**
+ * @brief ReferenceCalibration::writeTo
+ * Block layout (QDataStream, big endian):
+ *      qint64 frequency, qint32 frames, qint32 states,
+ *      then per state: double mean real, mean imaginary, M2 real, M2 imaginary, qint32 samples
+ * M2 (sum of squared deviations) is stored rather than the variance so a loaded reference is exact
+ */
+void ReferenceCalibration::writeTo(QDataStream &stream) const
+{
+    const int states = m_meanReal.size();
+    stream << m_frequency << qint32(m_frames) << qint32(states);
+    for (int i = 0; i < states; ++i) {
+        stream << m_meanReal[i] << m_meanImaginary[i]
+               << m_m2Real[i] << m_m2Imaginary[i]
+               << qint32(m_samples[i]);
+    }
+}
+
+bool ReferenceCalibration::readFrom(QDataStream &stream, QString *errorString)
+{
+    qint64 frequency = 0;
+    qint32 frames = 0;
+    qint32 states = 0;
+    stream >> frequency >> frames >> states;
+    if (stream.status() != QDataStream::Ok || states <= 0 || states > 16 * 16) {
+        if (errorString)
+            *errorString = "corrupt reference block";
+        return false;
+    }
+
+    start(0, states);
+    for (int i = 0; i < states; ++i) {
+        qint32 samples = 0;
+        stream >> m_meanReal[i] >> m_meanImaginary[i] >> m_m2Real[i] >> m_m2Imaginary[i] >> samples;
+        m_samples[i] = samples;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        clear();
+        if (errorString)
+            *errorString = "truncated reference block";
+        return false;
+    }
+    m_frequency = frequency;
+    m_frames = frames;
+    m_ready = true;
+    return true;
+}
+
+/**
+ * @brief ReferenceCalibration::saveFile
+ * File layout: quint32 magic "EMTR", quint32 version, qint32 block count, then one block per ready reference
+ */
+bool ReferenceCalibration::saveFile(const QString &filePath, const QVector<ReferenceCalibration> &references,
+                                    QString *errorString)
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+
+    qint32 count = 0;
+    for (const ReferenceCalibration &reference : references)
+        count += reference.isReady() ? 1 : 0;
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    stream << referenceFileMagic << referenceFileVersion << count;
+    for (const ReferenceCalibration &reference : references) {
+        if (reference.isReady())
+            reference.writeTo(stream);
+    }
+
+    if (!file.commit()) {
+        if (errorString)
+            *errorString = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief ReferenceCalibration::loadFile
+ * Returns the references stored by saveFile, empty on error
+ */
+QVector<ReferenceCalibration> ReferenceCalibration::loadFile(const QString &filePath, QString *errorString)
+{
+    QVector<ReferenceCalibration> references;
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        if (errorString)
+            *errorString = file.errorString();
+        return references;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_15);
+    quint32 magic = 0;
+    quint32 version = 0;
+    qint32 count = 0;
+    stream >> magic >> version >> count;
+    if (magic != referenceFileMagic || version != referenceFileVersion || count < 0) {
+        if (errorString)
+            *errorString = "not a reference file";
+        return references;
+    }
+
+    for (qint32 i = 0; i < count; ++i) {
+        ReferenceCalibration reference;
+        if (!reference.readFrom(stream, errorString))
+            return QVector<ReferenceCalibration>();
+        references.append(reference);
+    }
+    return references;
+}
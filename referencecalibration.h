@@ -0,0 +1,60 @@
+#ifndef REFERENCECALIBRATION_H
+#define REFERENCECALIBRATION_H
+
+#include <QVector>
+#include <QString>
+
+class QDataStream;
+
+/**
+ * @brief The ReferenceCalibration class
+ *
+ * Empty-space reference of one frequency for differential EMT. Accumulates the real/imaginary value
+ * of each state over N complete frames with Welford's running mean and variance, in arrays allocated
+ * once when capture starts, so no CSV averaging pass is needed afterwards.
+ * Once ready, subtract() removes the reference mean from every frame.
+ * References are persisted with writeTo()/readFrom() as a small binary block (see referencecalibration.cpp)
+ */
+
+class ReferenceCalibration
+{
+public:
+    void start(int frames, int states);                     //clears accumulators and captures the next frames
+    void clear();
+    bool addFrame(const QVector<QVector<double>> &frame);   //returns true when the last requested frame was added
+
+    bool isCapturing() const { return m_targetFrames > 0; }
+    bool isReady() const { return m_ready; }
+    int states() const { return m_meanReal.size(); }
+    int framesAccumulated() const { return m_frames; }
+    qint64 frequency() const { return m_frequency; }
+
+    const QVector<double> &meanReal() const { return m_meanReal; }
+    const QVector<double> &meanImaginary() const { return m_meanImaginary; }
+    double varianceReal(int state) const;                   //sample variance over the captured frames
+    double varianceImaginary(int state) const;
+
+    void subtract(QVector<QVector<double>> &frame) const;   //real/imaginary rows minus the reference mean, NaN for states without one
+
+    void writeTo(QDataStream &stream) const;
+    bool readFrom(QDataStream &stream, QString *errorString);
+
+    //reference file holding the ready references of all frequencies
+    static bool saveFile(const QString &filePath, const QVector<ReferenceCalibration> &references, QString *errorString);
+    static QVector<ReferenceCalibration> loadFile(const QString &filePath, QString *errorString);
+
+private:
+    int m_targetFrames = 0;                                 //frames still to capture, 0 when not capturing
+    int m_frames = 0;                                       //frames accumulated
+    bool m_ready = false;
+    qint64 m_frequency = 0;                                 //actual frequency of the captured frames
+
+    //one entry per state, Welford: mean += d/n, m2 += d*(x - mean)
+    QVector<double> m_meanReal;
+    QVector<double> m_meanImaginary;
+    QVector<double> m_m2Real;
+    QVector<double> m_m2Imaginary;
+    QVector<int> m_samples;                                 //frames where the state was present (not NaN)
+};
+
+#endif // REFERENCECALIBRATION_H
@@ -0,0 +1,158 @@
+#include "reorderbuffer.h"
+#include "sequencetracker.h"
+
+ReorderBuffer::ReorderBuffer()
+    : m_sequence(CoilSequence::default16Coils())
+{
+    m_held.reserve(maxDepth + 1);
+}
+
+void ReorderBuffer::setSequence(const CoilSequence &sequence)
+{
+    m_sequence = sequence;
+    reset();
+}
+
+/**
+ * @brief ReorderBuffer::setDepth
+ * A lower depth takes effect at once, the records held beyond it are given up as in push()
+ */
+void ReorderBuffer::setDepth(int records, qint64 nowNs, QVector<Sample> &released)
+{
+    m_depth = qBound(0, records, int(maxDepth));
+    giveUpExcess(nowNs, released);
+}
+
+void ReorderBuffer::reset()
+{
+    m_held.clear();
+    m_synced = false;
+    m_lastPosition = 0;
+    m_runLength = 0;
+}
+
+int ReorderBuffer::distanceFrom(int position) const
+{
+    const int size = m_sequence.size();
+    return (position - m_lastPosition + size) % size;
+}
+
+int ReorderBuffer::nearest() const
+{
+    int best = 0;
+    for (int i = 1; i < m_held.size(); ++i) {
+        if (distanceFrom(m_held.at(i).position) < distanceFrom(m_held.at(best).position))
+            best = i;
+    }
+    return best;
+}
+
+void ReorderBuffer::advance(int position)
+{
+    if (position == m_lastPosition) {
+        ++m_runLength;
+    } else {
+        m_lastPosition = position;
+        m_runLength = 1;
+    }
+}
+
+void ReorderBuffer::release(int index, qint64 nowNs, QVector<Sample> &released)
+{
+    const Entry &entry = m_held.at(index);
+    released.append(entry.sample);
+    advance(entry.position);
+    if (nowNs >= 0)
+        m_lastDelayNs = nowNs - entry.arrivalNs;
+    m_held.remove(index);
+}
+
+/**
+ * @brief ReorderBuffer::drain
+ * The next step is only released once the current one has all its repetitions, late repetitions
+ * of the current step would otherwise find it already passed
+ */
+void ReorderBuffer::drain(qint64 nowNs, QVector<Sample> &released, qint64 &counter)
+{
+    while (!m_held.isEmpty()) {
+        const int index = nearest();
+        const int distance = distanceFrom(m_held.at(index).position);
+        if (distance > 1 || (distance == 1 && m_runLength < SequenceTracker::samplesPerState))
+            return;
+        release(index, nowNs, released);
+        ++counter;
+    }
+}
+
+/**
+ * @brief ReorderBuffer::push
+ * Same ahead/behind rule as SequenceTracker (behind = more than half the sequence ahead),
+ * so the tracker downstream sees the records in order and only counts what was really lost
+ */
+void ReorderBuffer::push(const Sample &sample, qint64 nowNs, QVector<Sample> &released)
+{
+    const int size = m_sequence.size();
+    const int position = size > 0 ? m_sequence.positionOf(sample.coils >> 4, sample.coils & 0xF) : -1;
+    if (m_depth == 0 || position < 0) {
+        released.append(sample);                                //nothing is held at depth 0, setDepth gave it up
+        return;
+    }
+    if (!m_synced) {
+        m_synced = true;
+        m_lastPosition = position;
+        m_runLength = 1;
+        released.append(sample);
+        return;
+    }
+
+    const int distance = distanceFrom(position);
+    if (distance > size / 2) {
+        ++m_late;
+        released.append(sample);
+        return;
+    }
+    if (distance <= 1) {
+        released.append(sample);
+        advance(position);
+        drain(nowNs, released, m_restored);
+        return;
+    }
+
+    m_held.append({sample, position, nowNs});
+    giveUpExcess(nowNs, released);
+}
+
+void ReorderBuffer::giveUpExcess(qint64 nowNs, QVector<Sample> &released)
+{
+    while (m_held.size() > m_depth) {
+        release(nearest(), nowNs, released);                    //the gap before it is given up
+        ++m_flushed;
+        drain(nowNs, released, m_flushed);
+    }
+}
+
+/**
+ * @brief ReorderBuffer::flushExpired
+ * Gaps are given up nearest first until the oldest held record is within the timeout
+ */
+void ReorderBuffer::flushExpired(qint64 nowNs, qint64 timeoutNs, QVector<Sample> &released)
+{
+    while (!m_held.isEmpty()) {
+        qint64 oldestNs = m_held.first().arrivalNs;
+        for (const Entry &entry : qAsConst(m_held))
+            oldestNs = qMin(oldestNs, entry.arrivalNs);
+        if (nowNs - oldestNs < timeoutNs)
+            return;
+        release(nearest(), nowNs, released);
+        ++m_flushed;
+        drain(nowNs, released, m_flushed);
+    }
+}
+
+void ReorderBuffer::flush(QVector<Sample> &released)
+{
+    while (!m_held.isEmpty()) {
+        release(nearest(), -1, released);                       //no delay measured for a forced flush
+        ++m_flushed;
+    }
+}
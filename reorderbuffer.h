@@ -0,0 +1,82 @@
+#ifndef REORDERBUFFER_H
+#define REORDERBUFFER_H
+
+#include <QVector>
+#include "coilsequence.h"
+
+/**
+ * @brief The ReorderBuffer class
+ *
+ * Jitter buffer restoring the order of one frequency's records before they are queued for
+ * dataConsumerThread. Records carry no sequence counter, so a record is keyed on its position
+ * in the programmed CoilSequence:
+ *      same or next step   - in order, released at once, then any held record that follows
+ *                            (held records of the next step wait until the current step has all its repetitions)
+ *      up to half a frame ahead - a step is missing, held until the missing records arrive
+ *      behind              - its step was already released, passed through (late, unrecoverable)
+ * Held records are given up on (released in position order, the gap becomes a loss) once more
+ * than depth records are held or the oldest was held longer than the timeout, so the added latency
+ * is bounded by both. In-order traffic is never delayed. The hold array is allocated once
+ */
+
+class ReorderBuffer
+{
+public:
+    static const int maxDepth = 256;                            //records held at most, whatever the configured depth
+
+    //one decoded sample, as queued to SharedBuffer
+    struct Sample {
+        qint64 frequency;
+        qint32 sensing;
+        qint32 excitation;
+        double real;
+        double imaginary;
+        quint8 status;                                          //ADC << 4 | OTR nibbles
+        quint8 coils;                                           //S << 4 | E nibbles of the record, the ordering key
+        int tracker;                                            //FrequencyRouter slot, -1 if the record has no valid key
+    };
+
+    ReorderBuffer();
+
+    void setSequence(const CoilSequence &sequence);             //programmed sequence, restarts ordering (held records must be flushed first)
+    void setDepth(int records, qint64 nowNs, QVector<Sample> &released);   //0 passes every record through, excess held records are given up
+    void reset();                                               //forgets the position, held records must be flushed first
+
+    void push(const Sample &sample, qint64 nowNs, QVector<Sample> &released);     //appends what can be released now
+    void flushExpired(qint64 nowNs, qint64 timeoutNs, QVector<Sample> &released); //gives up on gaps older than the timeout
+    void flush(QVector<Sample> &released);                      //releases every held record in position order
+
+    int held() const { return m_held.size(); }
+    qint64 restoredRecords() const { return m_restored; }       //held records released in order once their gap was filled
+    qint64 flushedRecords() const { return m_flushed; }         //held records released after giving up on their gap
+    qint64 lateRecords() const { return m_late; }               //records that arrived after their step was released
+    qint64 lastDelayNs() const { return m_lastDelayNs; }        //time the last held record waited
+
+private:
+    struct Entry {
+        Sample sample;
+        int position;                                           //step in the sequence
+        qint64 arrivalNs;
+    };
+
+    int distanceFrom(int position) const;                       //steps ahead of the last released position
+    int nearest() const;                                        //index of the held record closest ahead, first held wins a tie
+    void advance(int position);                                 //a record of this step was released
+    void release(int index, qint64 nowNs, QVector<Sample> &released);  //nowNs -1 leaves lastDelayNs unchanged
+    void drain(qint64 nowNs, QVector<Sample> &released, qint64 &counter);  //releases held records that are now in order
+    void giveUpExcess(qint64 nowNs, QVector<Sample> &released); //until no more than depth records are held
+
+    CoilSequence m_sequence;
+    int m_depth = 64;
+    bool m_synced = false;                                      //false until the first known record
+    int m_lastPosition = 0;                                     //step of the last released record
+    int m_runLength = 0;                                        //records of that step released so far
+    QVector<Entry> m_held;                                      //arrival order
+
+    qint64 m_restored = 0;
+    qint64 m_flushed = 0;
+    qint64 m_late = 0;
+    qint64 m_lastDelayNs = 0;
+};
+
+#endif // REORDERBUFFER_H
@@ -0,0 +1,84 @@
+#include "sequencetracker.h"
+
+SequenceTracker::SequenceTracker()
+    : m_sequence(CoilSequence::default16Coils())
+{
+}
+
+/**
+ * @brief SequenceTracker::setSequence
+ * Called when a new sensing/excitation sequence is sent to the instrument
+ */
+void SequenceTracker::setSequence(const CoilSequence &sequence)
+{
+    m_sequence = sequence;
+    reset();
+}
+
+/**
+ * @brief SequenceTracker::reset
+ * Next known record restarts tracking, loss/reorder totals are kept
+ */
+void SequenceTracker::reset()
+{
+    m_synced = false;
+    m_firstRun = true;
+    m_lastPosition = 0;
+    m_runLength = 0;
+}
+
+/**
+ * @brief SequenceTracker::onRecord
+ * Places one record in the sequence and compares it with the current run:
+ *      same step           - run continues
+ *      step ahead          - lost = skipped steps * samplesPerState + missing tail of the finished run
+ *      step behind         - record arrived late (reorder)
+ * A step is "behind" when it lies more than half the sequence ahead, so up to half a frame
+ * of lost records is told apart from a reorder. The gap a late record left was already counted
+ * as lost and stays counted, both totals only ever increase (they are exported as counters)
+ */
+quint8 SequenceTracker::onRecord(int sensingNibble, int excitationNibble)
+{
+    const int size = m_sequence.size();
+    if (size == 0)
+        return 0;
+
+    const int position = m_sequence.positionOf(sensingNibble, excitationNibble);
+    if (position < 0) {
+        ++m_unknownRecords;
+        return SampleUnknownState;
+    }
+
+    if (!m_synced) {
+        m_synced = true;
+        m_firstRun = true;
+        m_lastPosition = position;
+        m_runLength = 1;
+        return 0;
+    }
+
+    if (position == m_lastPosition) {
+        ++m_runLength;
+        return 0;
+    }
+
+    const int distance = (position - m_lastPosition + size) % size;
+    if (distance > size / 2) {
+        ++m_reorderedRecords;
+        return SampleReordered;
+    }
+
+    qint64 lost = static_cast<qint64>(distance - 1) * samplesPerState;
+    if (!m_firstRun && m_runLength < samplesPerState)
+        lost += samplesPerState - m_runLength;
+
+    m_firstRun = false;
+    m_lastPosition = position;
+    m_runLength = 1;
+
+    if (lost > 0) {
+        m_lostRecords += lost;
+        return SampleGapBefore;
+    }
+    return 0;
+}
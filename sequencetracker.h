@@ -0,0 +1,55 @@
+#ifndef SEQUENCETRACKER_H
+#define SEQUENCETRACKER_H
+
+#include <QtGlobal>
+#include "coilsequence.h"
+
+/**
+ * @brief The SequenceTracker class
+ *
+ * Follows the coil progression of incoming records against the programmed CoilSequence,
+ * each step of the sequence is expected samplesPerState times in a row.
+ * Detects gaps (skipped steps or short runs, i.e. lost records) and reorders (records belonging
+ * to a step that has already passed).
+ * The instrument records carry no sequence counter, so coil progression is the only ordering information.
+ * With several frequencies, one tracker follows each frequency's records.
+ * Runs inline in processDatagrams, all state is held in plain members, nothing is allocated per record
+ */
+
+class SequenceTracker
+{
+public:
+    //per-record flags, carried to dataConsumerThread alongside each sample
+    enum SampleFlag : quint8 {
+        SampleGapBefore = 0x01,                             //records were lost right before this one
+        SampleReordered = 0x02,                             //record arrived after a later step
+        SampleUnknownState = 0x04                           //coil pair is not part of the programmed sequence
+    };
+
+    static const int samplesPerState = 4;                   //each step is reported 4 times in a row
+
+    SequenceTracker();
+
+    void setSequence(const CoilSequence &sequence);         //new programmed sequence, restarts tracking
+    void reset();                                           //forgets the current position, keeps totals
+
+    quint8 onRecord(int sensingNibble, int excitationNibble);   //returns SampleFlag bits for this record
+
+    qint64 lostRecords() const { return m_lostRecords; }        //includes records that later arrived reordered
+    qint64 reorderedRecords() const { return m_reorderedRecords; }
+    qint64 unknownRecords() const { return m_unknownRecords; }
+    const CoilSequence &sequence() const { return m_sequence; }
+
+private:
+    CoilSequence m_sequence;                                //programmed sequence to follow
+    bool m_synced = false;                                  //false until the first known record
+    bool m_firstRun = true;                                 //first run may have started mid-step, not counted as loss
+    int m_lastPosition = 0;                                 //step of the current run
+    int m_runLength = 0;                                    //records seen so far in the current run
+
+    qint64 m_lostRecords = 0;
+    qint64 m_reorderedRecords = 0;
+    qint64 m_unknownRecords = 0;
+};
+
+#endif // SEQUENCETRACKER_H
@@ -25,6 +25,8 @@ public:
     QQueue<qint32> bufferDecimated2;                //stores excitation coil data
     QQueue<double> bufferFourthArrayDivided;        //stores real data
     QQueue<double> bufferSixthArrayDivided;         //stores imaginary data
+    QQueue<quint8> bufferSampleFlags;               //stores SequenceTracker flags of each sample (lost/reordered records)
+    QQueue<quint8> bufferSampleStatus;              //stores ADC << 4 | OTR nibbles of each sample
 
     //for thread-safe communication
     QMutex mutex;                                   //provides exclusive access to data by one thread
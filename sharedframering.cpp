@@ -0,0 +1,155 @@
+#include "sharedframering.h"
+#include "frameassembler.h"
+#include <QMutexLocker>
+#include <QDateTime>
+#include <atomic>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+//sequence and published live in the mapping, they are accessed as std::atomic like the C readers' __atomic builtins
+static_assert(sizeof(std::atomic<quint64>) == sizeof(quint64) && std::atomic<quint64>::is_always_lock_free,
+              "ring counters must be plain lock-free 64-bit words");
+
+static std::atomic<quint64> *atomicWord(uint64_t *word)
+{
+    return reinterpret_cast<std::atomic<quint64> *>(word);
+}
+
+SharedFrameRing::SharedFrameRing(PipelineMetrics *metrics, QObject *parent)
+    : QObject{parent}
+    , m_metrics(metrics)
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+    close();
+}
+
+/**
+ * @brief SharedFrameRing::open
+ * A segment left by a previous run with the same layout is reused and its frame numbers continue,
+ * so readers keep their cursor. Any other content is cleared
+ */
+bool SharedFrameRing::open(const QString &name, int slotCount, QString *error)
+{
+    close();
+    const qint64 size = qint64(sizeof(emt_ring_header)) + qint64(slotCount) * qint64(sizeof(emt_ring_slot));
+    void *address = nullptr;
+
+#ifdef Q_OS_WIN
+    const std::wstring mappingName = (QString("Local\\") + name).toStdWString();
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        DWORD(quint64(size) >> 32), DWORD(size), mappingName.c_str());
+    if (mapping)
+        address = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, SIZE_T(size));
+    if (!address) {
+        if (error)
+            *error = QString("Could not map %1 (error %2)").arg(name).arg(GetLastError());
+        if (mapping)
+            CloseHandle(mapping);
+        return false;
+    }
+#else
+    const QByteArray posixName = "/" + name.toUtf8();
+    const int fd = shm_open(posixName.constData(), O_CREAT | O_RDWR, 0644);
+    struct stat status;
+    const bool sized = fd >= 0 && fstat(fd, &status) == 0
+                       && (status.st_size == size || ftruncate(fd, size) == 0);
+    if (sized)
+        address = mmap(nullptr, size_t(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    const int errorNumber = errno;
+    if (fd >= 0)
+        ::close(fd);                //the mapping keeps the segment
+    if (!sized || address == MAP_FAILED) {
+        if (error)
+            *error = QString("Could not map %1: %2").arg(QString(posixName), QString::fromLocal8Bit(strerror(errorNumber)));
+        return false;
+    }
+#endif
+
+    emt_ring_header *header = static_cast<emt_ring_header *>(address);
+    const bool sameLayout = header->magic == EMT_RING_MAGIC && header->version == EMT_RING_VERSION
+                            && header->slot_count == uint32_t(slotCount) && header->slot_size == sizeof(emt_ring_slot)
+                            && header->max_rows == EMT_RING_MAX_ROWS && header->max_states == EMT_RING_MAX_STATES;
+    if (!sameLayout) {
+        memset(address, 0, size_t(size));
+        header->version = EMT_RING_VERSION;
+        header->slot_count = uint32_t(slotCount);
+        header->slot_size = sizeof(emt_ring_slot);
+        header->max_rows = EMT_RING_MAX_ROWS;
+        header->max_states = EMT_RING_MAX_STATES;
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = EMT_RING_MAGIC;                         //readers wait for the magic
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_header = header;
+    m_size = size;
+#ifdef Q_OS_WIN
+    m_mapping = mapping;
+#endif
+    return true;
+}
+
+void SharedFrameRing::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_header)
+        return;
+#ifdef Q_OS_WIN
+    UnmapViewOfFile(m_header);
+    CloseHandle(m_mapping);
+    m_mapping = nullptr;
+#else
+    munmap(m_header, size_t(m_size));
+#endif
+    m_header = nullptr;
+    m_size = 0;
+}
+
+/**
+ * @brief SharedFrameRing::publish
+ * Seqlock writer: sequence goes odd, slot is written, sequence goes even again, then published
+ * moves on. Frames larger than the slot are cut to EMT_RING_MAX_ROWS x EMT_RING_MAX_STATES
+ */
+void SharedFrameRing::publish(const QVector<QVector<double>> &frame, int instrument)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_header || frame.isEmpty())
+        return;
+
+    std::atomic<quint64> *published = atomicWord(&m_header->published);
+    const quint64 number = published->load(std::memory_order_relaxed);     //one publisher at a time, under m_mutex
+    emt_ring_slot *slot = const_cast<emt_ring_slot *>(emt_ring_slot_at(m_header, number));
+    std::atomic<quint64> *sequence = atomicWord(&slot->sequence);
+
+    const quint64 writing = sequence->load(std::memory_order_relaxed) | 1;  //also odd if a previous writer died mid-slot
+    sequence->store(writing, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const int rows = qMin(frame.size(), int(EMT_RING_MAX_ROWS));
+    const int states = qMin(frame.first().size(), int(EMT_RING_MAX_STATES));
+    slot->frame_number = number;
+    slot->publish_time_ns = QDateTime::currentMSecsSinceEpoch() * 1000000;
+    slot->frequency = frame.size() > RowFrequency && !frame[RowFrequency].isEmpty() ? frame[RowFrequency].first() : 0.0;
+    slot->complete = frame.size() > RowComplete && !frame[RowComplete].isEmpty() && frame[RowComplete].first() != 0.0;
+    slot->instrument = uint32_t(instrument);
+    slot->rows = uint32_t(rows);
+    slot->states = uint32_t(states);
+    for (int row = 0; row < rows; ++row)
+        memcpy(slot->data[row], frame[row].constData(), size_t(qMin(states, frame[row].size())) * sizeof(double));
+
+    sequence->store(writing + 1, std::memory_order_release);
+    published->store(number + 1, std::memory_order_release);
+    m_metrics->framesPublished.fetchAndAddRelaxed(1);
+}
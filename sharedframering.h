@@ -0,0 +1,45 @@
+#ifndef SHAREDFRAMERING_H
+#define SHAREDFRAMERING_H
+
+#include <QObject>
+#include <QVector>
+#include <QString>
+#include <QMutex>
+#include "pipelinemetrics.h"
+#include "emtframering.h"
+
+/**
+ * @brief The SharedFrameRing class
+ *
+ * Publishes every frame of dataConsumerThread to a named shared-memory ring (layout in emtframering.h)
+ * so local processes read frames as they are produced instead of polling the measurement files.
+ * Each slot is written under a seqlock: readers never take a lock nor slow the publisher,
+ * a reader that lags more than the ring length skips the overwritten frames.
+ * Frames of all instrument sessions go to the same ring, tagged with their instrument.
+ * POSIX shared memory (shm_open) on Linux/macOS, a named file mapping on Windows
+ */
+
+class SharedFrameRing : public QObject
+{
+    Q_OBJECT
+public:
+    static const int defaultSlots = 64;                         //frames kept, 1.5 MB
+
+    explicit SharedFrameRing(PipelineMetrics *metrics, QObject *parent = nullptr);
+    ~SharedFrameRing();
+
+    bool open(const QString &name, int slotCount = defaultSlots, QString *error = nullptr);    //creates or reuses the segment
+    void close();                                               //unmaps, the segment stays for its readers
+
+public slots:
+    void publish(const QVector<QVector<double>> &frame, int instrument = 0);   //thread-safe, called on the dataConsumerThread of each session
+
+private:
+    PipelineMetrics *m_metrics;
+    QMutex m_mutex;                                             //open/close and the publishers of several sessions
+    emt_ring_header *m_header = nullptr;                        //start of the mapping, nullptr when closed
+    qint64 m_size = 0;                                          //bytes mapped
+    void *m_mapping = nullptr;                                  //Windows file mapping handle
+};
+
+#endif // SHAREDFRAMERING_H
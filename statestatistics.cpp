@@ -0,0 +1,186 @@
+#include "statestatistics.h"
+#include "frameassembler.h"
+#include <QtNumeric>
+#include <cmath>
+
+/**
+ * @brief StateStatistics::setWindow
+ * Called when 'SNR Packets' changes, the window is refilled from the next frames
+ */
+void StateStatistics::setWindow(int frames)
+{
+    m_window = qMax(1, frames);
+    m_states = 0;
+    reset();
+}
+
+void StateStatistics::reset()
+{
+    m_frameNumber = 0;
+    resizeSeries(m_real, m_states);
+    resizeSeries(m_imaginary, m_states);
+}
+
+void StateStatistics::resizeSeries(Series &series, int states)
+{
+    series.values.fill(qQNaN(), states * m_window);
+    series.shift.fill(0.0, states);
+    series.sum.fill(0.0, states);
+    series.sumSquares.fill(0.0, states);
+    series.count.fill(0, states);
+    series.minQueue.fill(0, states * m_window);
+    series.maxQueue.fill(0, states * m_window);
+    series.minHead.fill(0, states);
+    series.minSize.fill(0, states);
+    series.maxHead.fill(0, states);
+    series.maxSize.fill(0, states);
+}
+
+double StateStatistics::valueAt(const Series &series, int state, qint64 frameNumber) const
+{
+    return series.values[state * m_window + static_cast<int>(frameNumber % m_window)];
+}
+
+/**
+ * @brief StateStatistics::update
+ * Evicts the value of frame (n - K) and adds the value of frame n, both O(1) for the sums,
+ * amortised O(1) for the min/max queues
+ */
+void StateStatistics::update(Series &series, int state, double value)
+{
+    const int base = state * m_window;
+    const qint64 evicted = m_frameNumber - m_window;
+
+    if (evicted >= 0) {
+        const double old = valueAt(series, state, evicted);
+        if (!qIsNaN(old)) {
+            const double x = old - series.shift[state];
+            series.sum[state] -= x;
+            series.sumSquares[state] -= x * x;
+            --series.count[state];
+        }
+        if (series.minSize[state] > 0 && series.minQueue[base + series.minHead[state]] == evicted) {
+            series.minHead[state] = (series.minHead[state] + 1) % m_window;
+            --series.minSize[state];
+        }
+        if (series.maxSize[state] > 0 && series.maxQueue[base + series.maxHead[state]] == evicted) {
+            series.maxHead[state] = (series.maxHead[state] + 1) % m_window;
+            --series.maxSize[state];
+        }
+    }
+
+    series.values[base + static_cast<int>(m_frameNumber % m_window)] = value;
+    if (qIsNaN(value))
+        return;
+
+    if (series.count[state] == 0) {
+        //empty window, restart the sums around this value
+        series.shift[state] = value;
+        series.sum[state] = 0.0;
+        series.sumSquares[state] = 0.0;
+    }
+    const double x = value - series.shift[state];
+    series.sum[state] += x;
+    series.sumSquares[state] += x * x;
+    ++series.count[state];
+
+    //drop queued values that can no longer be the min (or max) while this one is in the window
+    while (series.minSize[state] > 0) {
+        const int back = base + (series.minHead[state] + series.minSize[state] - 1) % m_window;
+        if (valueAt(series, state, series.minQueue[back]) < value)
+            break;
+        --series.minSize[state];
+    }
+    series.minQueue[base + (series.minHead[state] + series.minSize[state]) % m_window] = m_frameNumber;
+    ++series.minSize[state];
+
+    while (series.maxSize[state] > 0) {
+        const int back = base + (series.maxHead[state] + series.maxSize[state] - 1) % m_window;
+        if (valueAt(series, state, series.maxQueue[back]) > value)
+            break;
+        --series.maxSize[state];
+    }
+    series.maxQueue[base + (series.maxHead[state] + series.maxSize[state]) % m_window] = m_frameNumber;
+    ++series.maxSize[state];
+}
+
+/**
+ * @brief StateStatistics::addFrame
+ * Reads the Real/Imaginary rows of the frame in place, a frame of another length
+ * (new sequence) restarts the statistics. Clipped states count as missing
+ */
+void StateStatistics::addFrame(const QVector<QVector<double>> &frame)
+{
+    const QVector<double> &realRow = frame[RowReal];
+    const QVector<double> &imaginaryRow = frame[RowImaginary];
+    const int states = realRow.size();
+    if (states != m_states) {
+        m_states = states;
+        reset();
+    }
+
+    const double *real = realRow.constData();
+    const double *imaginary = imaginaryRow.constData();
+    const bool hasStatus = frame[RowStatus].size() == states;
+    for (int state = 0; state < states; ++state) {
+        const bool clipped = hasStatus && isClipped(frame[RowStatus][state]);
+        update(m_real, state, clipped ? qQNaN() : real[state]);
+        update(m_imaginary, state, clipped ? qQNaN() : imaginary[state]);
+    }
+    ++m_frameNumber;
+}
+
+double StateStatistics::mean(const Series &series, int state) const
+{
+    const int n = series.count[state];
+    return n > 0 ? series.shift[state] + series.sum[state] / n : qQNaN();
+}
+
+double StateStatistics::variance(const Series &series, int state) const
+{
+    const int n = series.count[state];
+    if (n < 2)
+        return qQNaN();
+    const double v = (series.sumSquares[state] - series.sum[state] * series.sum[state] / n) / (n - 1);
+    return qMax(0.0, v);
+}
+
+/**
+ * @brief StateStatistics::snapshot
+ * SNR is +inf for a state with no spread and NaN with fewer than two values
+ */
+void StateStatistics::snapshot(QVector<QVector<double>> &table) const
+{
+    table.resize(StatisticsRowCount);
+    for (QVector<double> &row : table)
+        row.resize(m_states);
+
+    for (int state = 0; state < m_states; ++state) {
+        const auto minOf = [this, state](const Series &series) {
+            return series.minSize[state] > 0
+                       ? valueAt(series, state, series.minQueue[state * m_window + series.minHead[state]]) : qQNaN();
+        };
+        const auto maxOf = [this, state](const Series &series) {
+            return series.maxSize[state] > 0
+                       ? valueAt(series, state, series.maxQueue[state * m_window + series.maxHead[state]]) : qQNaN();
+        };
+
+        const double meanReal = mean(m_real, state);
+        const double meanImaginary = mean(m_imaginary, state);
+        const double varianceReal = variance(m_real, state);
+        const double varianceImaginary = variance(m_imaginary, state);
+
+        table[StatMeanReal][state] = meanReal;
+        table[StatStdReal][state] = std::sqrt(varianceReal);
+        table[StatMinReal][state] = minOf(m_real);
+        table[StatMaxReal][state] = maxOf(m_real);
+        table[StatMeanImaginary][state] = meanImaginary;
+        table[StatStdImaginary][state] = std::sqrt(varianceImaginary);
+        table[StatMinImaginary][state] = minOf(m_imaginary);
+        table[StatMaxImaginary][state] = maxOf(m_imaginary);
+
+        const double signal = std::sqrt(meanReal * meanReal + meanImaginary * meanImaginary);
+        const double noise = std::sqrt(varianceReal + varianceImaginary);
+        table[StatSnrDb][state] = 20.0 * std::log10(signal / noise);
+    }
+}
@@ -0,0 +1,66 @@
+#ifndef STATESTATISTICS_H
+#define STATESTATISTICS_H
+
+#include <QVector>
+
+/**
+ * @brief The StateStatistics class
+ *
+ * Rolling statistics of every state over the last K frames ('SNR Packets'): mean, standard deviation,
+ * min and max of I and Q, and SNR = 20*log10(|mean(I + jQ)| / sqrt(var(I) + var(Q))) in dB.
+ * Each frame costs O(1) per state: running sums are updated with the incoming and the evicted value,
+ * min/max come from monotonic queues. Frame rows are read in place, only the window of values is kept.
+ * NaN values (missing states) are not counted
+ */
+
+class StateStatistics
+{
+public:
+    //rows of the snapshot table, one value per state in each row
+    enum StatisticsRow {
+        StatMeanReal = 0,
+        StatStdReal,
+        StatMinReal,
+        StatMaxReal,
+        StatMeanImaginary,
+        StatStdImaginary,
+        StatMinImaginary,
+        StatMaxImaginary,
+        StatSnrDb,
+        StatisticsRowCount
+    };
+
+    void setWindow(int frames);                             //window length K, clears the statistics
+    void reset();
+    int window() const { return m_window; }
+
+    void addFrame(const QVector<QVector<double>> &frame);
+    void snapshot(QVector<QVector<double>> &table) const;   //fills StatisticsRowCount rows
+
+private:
+    //one running series (I or Q) of all states
+    struct Series {
+        QVector<double> values;                             //ring of K values per state, [state * K + frame % K]
+        QVector<double> shift;                              //first value of each state, sums are of (x - shift) to keep precision
+        QVector<double> sum;
+        QVector<double> sumSquares;
+        QVector<int> count;                                 //non-NaN values of each state in the window
+        QVector<qint64> minQueue;                           //frame numbers, ring of K per state, values increasing
+        QVector<qint64> maxQueue;                           //frame numbers, ring of K per state, values decreasing
+        QVector<int> minHead, minSize, maxHead, maxSize;
+    };
+
+    void resizeSeries(Series &series, int states);
+    void update(Series &series, int state, double value);
+    double valueAt(const Series &series, int state, qint64 frameNumber) const;
+    double mean(const Series &series, int state) const;
+    double variance(const Series &series, int state) const;
+
+    int m_window = 25;
+    int m_states = 0;
+    qint64 m_frameNumber = 0;                               //frames added since reset
+    Series m_real;
+    Series m_imaginary;
+};
+
+#endif // STATESTATISTICS_H
@@ -0,0 +1,86 @@
+#include "statushistory.h"
+
+StatusHistory::StatusHistory()
+    : m_buckets(maxSeconds)
+{
+}
+
+void StatusHistory::setWindow(int seconds)
+{
+    m_window = qBound(1, seconds, maxSeconds);
+}
+
+void StatusHistory::clear()
+{
+    m_buckets.fill(Bucket());
+    m_latestSecond = -1;
+}
+
+bool StatusHistory::inWindow(const Bucket &bucket) const
+{
+    return bucket.second >= 0 && bucket.second > m_latestSecond - m_window;
+}
+
+/**
+ * @brief StatusHistory::addBatch
+ * A bucket left over from a previous pass of the ring is reset before it is reused
+ */
+bool StatusHistory::addBatch(qint64 timeNs, const int *adcCounts, int records, int otrRecords)
+{
+    const qint64 second = timeNs / 1000000000;
+    Bucket &bucket = m_buckets[int(second % maxSeconds)];
+    if (bucket.second != second) {
+        bucket = Bucket();
+        bucket.second = second;
+    }
+    for (int i = 0; i < nibbleValues; ++i)
+        bucket.adcCounts[i] += adcCounts[i];
+    bucket.records += records;
+    bucket.otrRecords += otrRecords;
+
+    const bool newSecond = second > m_latestSecond;
+    m_latestSecond = qMax(m_latestSecond, second);
+    return newSecond;
+}
+
+int StatusHistory::adcMode() const
+{
+    int counts[nibbleValues] = {};
+    for (const Bucket &bucket : m_buckets) {
+        if (!inWindow(bucket))
+            continue;
+        for (int i = 0; i < nibbleValues; ++i)
+            counts[i] += bucket.adcCounts[i];
+    }
+    return modeOf(counts);
+}
+
+double StatusHistory::otrRate() const
+{
+    qint64 records = 0;
+    qint64 otrRecords = 0;
+    for (const Bucket &bucket : m_buckets) {
+        if (inWindow(bucket)) {
+            records += bucket.records;
+            otrRecords += bucket.otrRecords;
+        }
+    }
+    return records > 0 ? double(otrRecords) / records : 0.0;
+}
+
+int StatusHistory::modeOf(const int *counts)
+{
+    int mode = 0;
+    int maxCount = 0;
+    int modeCandidates = 0;
+    for (int i = 0; i < nibbleValues; ++i) {
+        if (counts[i] > maxCount) {
+            maxCount = counts[i];
+            mode = i;
+            modeCandidates = 1;
+        } else if (counts[i] == maxCount && maxCount > 0) {
+            modeCandidates++;
+        }
+    }
+    return (maxCount > 1 && modeCandidates == 1) ? mode : 0;
+}
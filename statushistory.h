@@ -0,0 +1,50 @@
+#ifndef STATUSHISTORY_H
+#define STATUSHISTORY_H
+
+#include <QVector>
+
+/**
+ * @brief The StatusHistory class
+ *
+ * Rolling ADC-mode and over-range history of the decoded records over the last N seconds.
+ * Each batch adds its 16-bucket ADC histogram and OTR count to the bucket of its second,
+ * buckets live in a ring of maxSeconds allocated once, so nothing is allocated per record or batch
+ */
+
+class StatusHistory
+{
+public:
+    static const int maxSeconds = 600;
+    static const int nibbleValues = 16;
+
+    StatusHistory();
+
+    void setWindow(int seconds);                                //clamped to 1-maxSeconds
+    int window() const { return m_window; }
+    void clear();
+
+    //returns true when the batch starts a new second, i.e. once per second
+    bool addBatch(qint64 timeNs, const int *adcCounts, int records, int otrRecords);
+
+    int adcMode() const;                                        //ADC mode over the window, same rule as modeOf()
+    double otrRate() const;                                     //fraction of records over the window with OTR set
+
+    //most frequent nibble, 0 if it is not unique or seen only once (rule of the per-batch 'ADC Level')
+    static int modeOf(const int *counts);
+
+private:
+    struct Bucket {
+        qint64 second = -1;                                     //second since the time origin, -1 if unused
+        int adcCounts[nibbleValues] = {};
+        int records = 0;
+        int otrRecords = 0;
+    };
+
+    bool inWindow(const Bucket &bucket) const;
+
+    QVector<Bucket> m_buckets;                                  //ring indexed by second % maxSeconds
+    qint64 m_latestSecond = -1;
+    int m_window = 10;
+};
+
+#endif // STATUSHISTORY_H
@@ -0,0 +1,164 @@
+#include "sweepcampaign.h"
+#include "frameassembler.h"
+#include "frequencytable.h"
+#include <QStringList>
+#include <QtMath>
+
+//F command programs frequency / 8, reported frequencies are within one step of the programmed one
+static const double frequencyTolerance = 8.0;
+
+SweepCampaign::SweepCampaign(PipelineMetrics *metrics, QObject *parent)
+    : QObject{parent}
+    , m_metrics(metrics)
+{
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(settleTimeoutMs);
+    connect(&m_settleTimer, &QTimer::timeout, this, &SweepCampaign::onSettleTimeout);
+}
+
+/**
+ * @brief SweepCampaign::parsePlan
+ * Empty lines are skipped, any other malformed line rejects the whole plan
+ */
+bool SweepCampaign::parsePlan(const QString &text, QVector<Step> &steps, QString &error)
+{
+    steps.clear();
+    const QStringList lines = text.split('\n', Qt::SkipEmptyParts);
+    for (int l = 0; l < lines.size(); ++l) {
+        const QString line = lines.at(l).trimmed();
+        if (line.isEmpty())
+            continue;
+        const QStringList parts = line.split(';');
+        Step step;
+        bool ok = parts.size() == 2;
+        if (ok)
+            step.frames = parts.at(1).trimmed().toInt(&ok);
+        if (ok) {
+            const QStringList frequencies = parts.at(0).split(',', Qt::SkipEmptyParts);
+            for (const QString &frequency : frequencies) {
+                const double value = frequency.trimmed().toDouble(&ok);
+                if (!ok)
+                    break;
+                step.frequencies.append(value);
+            }
+        }
+        if (!ok || step.frames <= 0 || step.frequencies.isEmpty() || step.frequencies.size() > FrequencyTable::maxEntries) {
+            error = QString("Sweep plan line %1 is not 'frequency,...;frames' with 1-%2 frequencies: %3")
+                    .arg(l + 1).arg(FrequencyTable::maxEntries).arg(line);
+            steps.clear();
+            return false;
+        }
+        steps.append(step);
+    }
+    if (steps.isEmpty()) {
+        error = "Sweep plan is empty";
+        return false;
+    }
+    return true;
+}
+
+void SweepCampaign::start(const QVector<Step> &steps, int settleFrames)
+{
+    m_steps = steps;
+    m_settleFrames = qMax(1, settleFrames);
+    m_deadTimer.start();
+    beginStep(0);
+}
+
+void SweepCampaign::stop()
+{
+    if (m_phase == Idle)
+        return;
+    m_settleTimer.stop();
+    const bool saving = m_phase == Saving;
+    m_phase = Idle;
+    if (saving)
+        emit cancelSaving(m_step);
+    emit statusChanged(QString("Sweep stopped at step %1 of %2").arg(m_step + 1).arg(m_steps.size()));
+    emit finished(false);
+}
+
+void SweepCampaign::beginStep(int step)
+{
+    m_step = step;
+    if (m_step >= m_steps.size()) {
+        m_phase = Idle;
+        emit statusChanged(QString("Sweep finished, %1 steps").arg(m_steps.size()));
+        emit finished(true);
+        return;
+    }
+    m_phase = Settling;
+    m_settledFrames.fill(0, m_steps.at(m_step).frequencies.size());
+    m_frameSeen.fill(false, m_steps.at(m_step).frequencies.size());
+    m_resetsBefore = m_metrics->frequencyResets.loadAcquire();
+    m_settleTimer.start();
+    emit configureStep(m_step, m_steps.at(m_step).frequencies);
+}
+
+bool SweepCampaign::matchesStepFrequency(double frequency, int &index) const
+{
+    const QVector<double> &frequencies = m_steps.at(m_step).frequencies;
+    for (index = 0; index < frequencies.size(); ++index) {
+        if (qAbs(frequency - frequencies.at(index)) <= frequencyTolerance)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief SweepCampaign::onFrame
+ * Frames of the previous configuration are ignored: those emitted before dataConsumerThread applied
+ * the step's frequency table (they may share a frequency with the step), then the first frame of
+ * each step frequency, which may have been started before it. An incomplete frame of a step
+ * frequency restarts its count. Saving starts on the frame that completes the last count,
+ * MainWindow calls this before its writer so that frame is the first one saved
+ */
+void SweepCampaign::onFrame(const QVector<QVector<double>> &frame)
+{
+    ++m_framesSeen;
+    if (m_phase != Settling || frame[RowFrequency].isEmpty())
+        return;
+    if (m_metrics->frequencyResets.loadAcquire() <= m_resetsBefore
+            || m_framesSeen <= m_metrics->frequencyResetFrame.loadRelaxed())
+        return;
+
+    int index;
+    if (!matchesStepFrequency(frame[RowFrequency].first(), index))
+        return;
+    if (!m_frameSeen[index]) {
+        m_frameSeen[index] = true;
+        return;
+    }
+    const bool complete = !frame[RowComplete].isEmpty() && frame[RowComplete].first() != 0.0;
+    m_settledFrames[index] = complete ? m_settledFrames[index] + 1 : 0;
+
+    for (int settled : qAsConst(m_settledFrames)) {
+        if (settled < m_settleFrames)
+            return;
+    }
+
+    m_settleTimer.stop();
+    m_phase = Saving;
+    m_deadTimeMs = m_deadTimer.elapsed();
+    m_metrics->sweepDeadTimeMs.storeRelaxed(m_deadTimeMs);
+    m_savingTimer.start();
+    emit saveStep(m_step, m_steps.at(m_step).frames);
+}
+
+void SweepCampaign::onStepSaved()
+{
+    if (m_phase != Saving)
+        return;
+    m_metrics->sweepSteps.fetchAndAddRelaxed(1);
+    emit stepFinished(m_step, m_deadTimeMs, m_savingTimer.elapsed());
+    m_deadTimer.start();
+    beginStep(m_step + 1);
+}
+
+void SweepCampaign::onSettleTimeout()
+{
+    if (m_phase != Settling)
+        return;
+    emit statusChanged(QString("Sweep step %1: frequencies did not settle within %2 ms").arg(m_step + 1).arg(settleTimeoutMs));
+    stop();
+}
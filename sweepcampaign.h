@@ -0,0 +1,80 @@
+#ifndef SWEEPCAMPAIGN_H
+#define SWEEPCAMPAIGN_H
+
+#include <QObject>
+#include <QVector>
+#include <QElapsedTimer>
+#include <QTimer>
+#include "pipelinemetrics.h"
+
+/**
+ * @brief The SweepCampaign class
+ *
+ * Runs a list of acquisition steps (frequency set + frames to save) without an operator.
+ * For each step it asks MainWindow to send the frequency configuration, watches the frames for the
+ * new frequencies to settle (settleFrames consecutive complete frames of every frequency of the step)
+ * and asks MainWindow to start saving straight away, then moves on when saving is done.
+ * Only frames assembled after dataConsumerThread applied the step's frequency table count, found by
+ * comparing the frames seen here with the frequencyResetFrame snapshot of PipelineMetrics, so
+ * onFrame must see every frame of the instrument whose metrics are given, in order.
+ * Dead time of a step is the time from the end of the previous step (or the start) to the start of
+ * saving. Lives on the main thread, all calls and signals are on it
+ *
+ * Plan text: one step per line, "frequency,frequency,...;frames", e.g. "1000,2000;500"
+ */
+
+class SweepCampaign : public QObject
+{
+    Q_OBJECT
+public:
+    struct Step {
+        QVector<double> frequencies;                            //F command holds up to FrequencyTable::maxEntries
+        int frames = 0;
+    };
+
+    static const int settleTimeoutMs = 10000;                   //a step that does not settle in time stops the campaign
+
+    explicit SweepCampaign(PipelineMetrics *metrics, QObject *parent = nullptr);
+
+    static bool parsePlan(const QString &text, QVector<Step> &steps, QString &error);
+
+    void start(const QVector<Step> &steps, int settleFrames);
+    void stop();
+    bool isRunning() const { return m_phase != Idle; }
+    bool isSaving() const { return m_phase == Saving; }
+    int currentStep() const { return m_step; }
+
+    void onFrame(const QVector<QVector<double>> &frame);        //every frame of processedChunkResult
+    void onStepSaved();                                         //saving of the current step finished
+
+signals:
+    void configureStep(const int &step, const QVector<double> &frequencies);    //send the frequency configuration now
+    void saveStep(const int &step, const int &frames);                          //start saving now
+    void cancelSaving(const int &step);                                         //stop() during saving, end it now
+    void stepFinished(const int &step, const qint64 &deadTimeMs, const qint64 &savingMs);
+    void statusChanged(const QString &status);                  //for the message log
+    void finished(const bool &completed);
+
+private:
+    enum Phase { Idle, Settling, Saving };
+
+    void beginStep(int step);
+    void onSettleTimeout();
+    bool matchesStepFrequency(double frequency, int &index) const;
+
+    PipelineMetrics *m_metrics;
+    QVector<Step> m_steps;
+    int m_step = -1;
+    int m_settleFrames = 2;
+    Phase m_phase = Idle;
+    QVector<int> m_settledFrames;                               //consecutive complete frames per step frequency
+    QVector<bool> m_frameSeen;                                  //the first frame of each frequency may have begun before the reset
+    quint64 m_framesSeen = 0;                                   //frames passed to onFrame, same count as framesProduced
+    quint64 m_resetsBefore = 0;                                 //frequencyResets when the step's frequencies were sent
+    QElapsedTimer m_deadTimer;                                  //since the end of the previous step
+    QElapsedTimer m_savingTimer;
+    qint64 m_deadTimeMs = 0;
+    QTimer m_settleTimer;
+};
+
+#endif // SWEEPCAMPAIGN_H
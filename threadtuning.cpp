@@ -0,0 +1,136 @@
+#include "threadtuning.h"
+#include <QThread>
+#include <QStringList>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#elif defined(Q_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+/**
+ * @brief ThreadTuning::applyToCurrentThread
+ * Affinity and priority are requested separately, one can be granted while the other is refused.
+ * Windows has no SCHED_FIFO levels, any priority above 0 is THREAD_PRIORITY_TIME_CRITICAL
+ * (the top of the process priority class, not the realtime class)
+ */
+QString ThreadTuning::applyToCurrentThread(const Settings &settings, Applied *applied)
+{
+    Applied result;
+    QStringList parts;
+#ifdef Q_OS_WIN
+    if (settings.cpu >= 0) {
+        const bool inRange = settings.cpu < int(sizeof(DWORD_PTR) * 8);
+        if (inRange && SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << settings.cpu) != 0) {
+            result.cpu = settings.cpu;
+            parts << QString("CPU %1").arg(settings.cpu);
+        } else {
+            parts << QString("CPU %1 refused (error %2)").arg(settings.cpu).arg(inRange ? GetLastError() : DWORD(ERROR_INVALID_PARAMETER));
+        }
+    }
+    if (settings.priority > 0) {
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL)) {
+            result.realtime = true;
+            parts << "THREAD_PRIORITY_TIME_CRITICAL";
+        } else {
+            parts << QString("THREAD_PRIORITY_TIME_CRITICAL refused (error %1), default scheduling").arg(GetLastError());
+        }
+    }
+#elif defined(Q_OS_LINUX)
+    if (settings.cpu >= 0) {
+        int error = EINVAL;
+        if (settings.cpu < CPU_SETSIZE) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(settings.cpu, &cpus);
+            error = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        }
+        if (error == 0) {
+            result.cpu = settings.cpu;
+            parts << QString("CPU %1").arg(settings.cpu);
+        } else {
+            parts << QString("CPU %1 refused (%2)").arg(settings.cpu).arg(QString::fromLocal8Bit(strerror(error)));
+        }
+    }
+    if (settings.priority > 0) {
+        sched_param parameters;
+        memset(&parameters, 0, sizeof(parameters));
+        parameters.sched_priority = qBound(sched_get_priority_min(SCHED_FIFO), settings.priority, sched_get_priority_max(SCHED_FIFO));
+        const int error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+        if (error == 0) {
+            result.realtime = true;
+            parts << QString("SCHED_FIFO %1").arg(parameters.sched_priority);
+        } else {
+            parts << QString("SCHED_FIFO refused (%1), default scheduling").arg(QString::fromLocal8Bit(strerror(error)));
+        }
+    }
+#else
+    if (settings.isRequested())
+        parts << "affinity and priority not supported on this platform";
+#endif
+    if (parts.isEmpty())
+        parts << "default scheduling";
+    if (applied)
+        *applied = result;
+    return QThread::currentThread()->objectName() + ": " + parts.join(", ");
+}
+
+/**
+ * @brief ThreadTuning::lockMemory
+ * Future allocations are only locked too (MCL_FUTURE) when the memlock limit is unlimited,
+ * under a finite limit they would fail once it is reached instead of just being pageable.
+ * Windows has no mlockall: the working set minimum is raised to the committed private pages,
+ * which are then locked with VirtualLock region by region, later allocations stay pageable
+ */
+QString ThreadTuning::lockMemory(bool *locked)
+{
+    bool done = false;
+    QString report;
+#ifdef Q_OS_WIN
+    //committed, accessible private regions: heaps, stacks, the frame buffers and queues
+    auto lockable = [](const MEMORY_BASIC_INFORMATION &region) {
+        return region.State == MEM_COMMIT && region.Type == MEM_PRIVATE
+               && !(region.Protect & (PAGE_GUARD | PAGE_NOACCESS));
+    };
+    MEMORY_BASIC_INFORMATION region;
+    SIZE_T total = 0;
+    for (char *address = nullptr; VirtualQuery(address, &region, sizeof(region)) == sizeof(region);
+         address = static_cast<char *>(region.BaseAddress) + region.RegionSize) {
+        if (lockable(region))
+            total += region.RegionSize;
+    }
+    const SIZE_T margin = SIZE_T(64) << 20;                 //room for the pages allocated while locking
+    if (!SetProcessWorkingSetSize(GetCurrentProcess(), total + margin, total + 2 * margin)) {
+        report = QString("Memory not locked: working set of %1 MB refused (error %2)").arg((total + margin) >> 20).arg(GetLastError());
+    } else {
+        SIZE_T lockedBytes = 0;
+        for (char *address = nullptr; VirtualQuery(address, &region, sizeof(region)) == sizeof(region);
+             address = static_cast<char *>(region.BaseAddress) + region.RegionSize) {
+            if (lockable(region) && VirtualLock(region.BaseAddress, region.RegionSize))
+                lockedBytes += region.RegionSize;
+        }
+        done = lockedBytes > 0;
+        report = done ? QString("Memory locked, %1 MB of current pages only (no future locking on Windows)").arg(lockedBytes >> 20)
+                      : QString("Memory not locked: VirtualLock refused (error %1)").arg(GetLastError());
+    }
+#elif defined(Q_OS_LINUX)
+    rlimit limit;
+    const bool unlimited = geteuid() == 0 || (getrlimit(RLIMIT_MEMLOCK, &limit) == 0 && limit.rlim_cur == RLIM_INFINITY);
+    done = mlockall(unlimited ? MCL_CURRENT | MCL_FUTURE : MCL_CURRENT) == 0;
+    if (done)
+        report = unlimited ? "Memory locked, current and future pages" : "Memory locked, current pages only (memlock limit is finite)";
+    else
+        report = QString("Memory not locked: %1").arg(QString::fromLocal8Bit(strerror(errno)));
+#else
+    report = "Memory not locked: not supported on this platform";
+#endif
+    if (locked)
+        *locked = done;
+    return report;
+}
@@ -0,0 +1,36 @@
+#ifndef THREADTUNING_H
+#define THREADTUNING_H
+
+#include <QString>
+
+/**
+ * @brief The ThreadTuning namespace
+ *
+ * CPU affinity, SCHED_FIFO priority and memory locking for the acquisition threads, from the
+ * [Threads] section of EMT_IP.ini, on Linux and Windows (SetThreadAffinityMask,
+ * THREAD_PRIORITY_TIME_CRITICAL, VirtualLock). Everything is best effort: a setting the system
+ * refuses (missing CAP_SYS_NICE/CAP_IPC_LOCK, CPU out of range, working set limits, other platforms)
+ * is reported and the thread keeps running with the default scheduling, acquisition never stops because of it
+ */
+
+namespace ThreadTuning
+{
+    struct Settings {
+        int cpu = -1;                                               //CPU the thread is pinned to, -1 leaves it to the scheduler
+        int priority = 0;                                           //SCHED_FIFO priority 1..99 (time critical on Windows), 0 keeps the default policy
+        bool isRequested() const { return cpu >= 0 || priority > 0; }
+    };
+
+    struct Applied {
+        int cpu = -1;                                               //CPU the thread was pinned to, -1 if not pinned
+        bool realtime = false;                                      //SCHED_FIFO (THREAD_PRIORITY_TIME_CRITICAL) was granted
+    };
+
+    //applies settings to the calling thread, returns a report line such as "processingDataThread: CPU 2, SCHED_FIFO 50"
+    QString applyToCurrentThread(const Settings &settings, Applied *applied = nullptr);
+
+    //locks the pages of the process (frame buffers, queues, shared ring) into RAM, returns a report line
+    QString lockMemory(bool *locked = nullptr);
+}
+
+#endif // THREADTUNING_H
@@ -0,0 +1,134 @@
+#include "trendpyramid.h"
+#include "frameassembler.h"
+#include <QtNumeric>
+#include <algorithm>
+
+/**
+ * @brief TrendPyramid::configure
+ * Levels are added until the top level ring covers historyFrames
+ */
+void TrendPyramid::configure(const QVector<int> &states, qint64 historyFrames)
+{
+    m_states = states;
+    m_columns.fill(-1, states.size());
+    m_levelCount = 1;
+    while (qint64(bucketsPerLevel) << (m_levelCount - 1) < historyFrames && m_levelCount < 40)
+        ++m_levelCount;
+
+    Level empty;
+    empty.minimum.fill(qQNaN(), bucketsPerLevel);
+    empty.maximum.fill(qQNaN(), bucketsPerLevel);
+    empty.partialMinimum = qInf();
+    empty.partialMaximum = -qInf();
+    m_series.fill(QVector<Level>(m_levelCount, empty), states.size() * 2);
+    m_frames = 0;
+}
+
+qint64 TrendPyramid::oldestFrame() const
+{
+    const qint64 bucketFrames = qint64(1) << (m_levelCount - 1);
+    const qint64 completed = m_frames / bucketFrames;
+    return qMax<qint64>(0, completed - bucketsPerLevel + 1) * bucketFrames;
+}
+
+/**
+ * @brief TrendPyramid::push
+ * Every level takes the raw value into its partial bucket, O(levels) per value
+ */
+void TrendPyramid::push(QVector<Level> &levels, double value)
+{
+    for (int k = 0; k < levels.size(); ++k) {
+        Level &level = levels[k];
+        if (!qIsNaN(value)) {
+            level.partialMinimum = qMin(level.partialMinimum, value);
+            level.partialMaximum = qMax(level.partialMaximum, value);
+        }
+        if (++level.partialCount < (1 << k))
+            continue;
+        const int slot = int(level.completed % bucketsPerLevel);
+        const bool empty = level.partialMinimum > level.partialMaximum;
+        level.minimum[slot] = empty ? qQNaN() : level.partialMinimum;
+        level.maximum[slot] = empty ? qQNaN() : level.partialMaximum;
+        ++level.completed;
+        level.partialMinimum = qInf();
+        level.partialMaximum = -qInf();
+        level.partialCount = 0;
+    }
+}
+
+/**
+ * @brief TrendPyramid::addFrame
+ * Columns of the tracked states are looked up again only when the state at the cached column changed
+ */
+void TrendPyramid::addFrame(const QVector<QVector<double>> &frame)
+{
+    const QVector<double> &stateRow = frame[RowState];
+    for (int tracked = 0; tracked < m_states.size(); ++tracked) {
+        int &column = m_columns[tracked];
+        if (column < 0 || column >= stateRow.size() || int(stateRow[column]) != m_states[tracked])
+            column = int(std::find(stateRow.cbegin(), stateRow.cend(), double(m_states[tracked])) - stateRow.cbegin());
+        const bool found = column < stateRow.size();
+        if (!found)
+            column = -1;
+        push(m_series[tracked * 2], found ? frame[RowReal][column] : qQNaN());
+        push(m_series[tracked * 2 + 1], found ? frame[RowImaginary][column] : qQNaN());
+    }
+    ++m_frames;
+}
+
+//min/max of bucket index at this level, false if it is no longer (or not yet) held
+bool TrendPyramid::bucket(const Level &level, qint64 index, double &minimum, double &maximum) const
+{
+    if (index == level.completed) {
+        if (level.partialCount == 0 || level.partialMinimum > level.partialMaximum)
+            return false;
+        minimum = level.partialMinimum;
+        maximum = level.partialMaximum;
+        return true;
+    }
+    if (index > level.completed || index < level.completed - bucketsPerLevel || index < 0)
+        return false;
+    const int slot = int(index % bucketsPerLevel);
+    minimum = level.minimum[slot];
+    maximum = level.maximum[slot];
+    return !qIsNaN(minimum);
+}
+
+/**
+ * @brief TrendPyramid::query
+ * Level k is used if the range spans at most 2 buckets per pixel and its ring still holds firstFrame
+ */
+void TrendPyramid::query(int tracked, int component, qint64 firstFrame, qint64 lastFrame, int pixels,
+                         QVector<double> &minimum, QVector<double> &maximum) const
+{
+    minimum.fill(qQNaN(), pixels);
+    maximum.fill(qQNaN(), pixels);
+    if (pixels <= 0 || lastFrame <= firstFrame || tracked < 0 || tracked >= m_states.size())
+        return;
+
+    const QVector<Level> &levels = m_series[tracked * 2 + component];
+    const qint64 range = lastFrame - firstFrame;
+    int k = 0;
+    while (k + 1 < m_levelCount
+           && ((range >> k) > 2 * qint64(pixels) || (firstFrame >> k) < levels[k].completed - bucketsPerLevel))
+        ++k;
+    const Level &level = levels[k];
+
+    for (int x = 0; x < pixels; ++x) {
+        const qint64 pixelFirst = firstFrame + range * x / pixels;
+        const qint64 pixelLast = qMax(pixelFirst + 1, firstFrame + range * (x + 1) / pixels);
+        double low = qInf();
+        double high = -qInf();
+        for (qint64 b = pixelFirst >> k; b <= (pixelLast - 1) >> k; ++b) {
+            double bucketMinimum, bucketMaximum;
+            if (bucket(level, b, bucketMinimum, bucketMaximum)) {
+                low = qMin(low, bucketMinimum);
+                high = qMax(high, bucketMaximum);
+            }
+        }
+        if (low <= high) {
+            minimum[x] = low;
+            maximum[x] = high;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef TRENDPYRAMID_H
+#define TRENDPYRAMID_H
+
+#include <QVector>
+
+/**
+ * @brief The TrendPyramid class
+ *
+ * Min/max decimation pyramid of I and Q for a few tracked states, for long-run drift plots.
+ * Level k holds one min/max bucket per 2^k frames in a ring of bucketsPerLevel buckets, and there
+ * are just enough levels for the configured history depth, so memory is fixed by
+ * (tracked states x levels x bucketsPerLevel) whatever the run length.
+ * A query picks the finest level still holding the requested range with at most two buckets
+ * per pixel, so drawing costs O(pixel width), not O(history)
+ */
+
+class TrendPyramid
+{
+public:
+    static const int bucketsPerLevel = 2048;
+
+    void configure(const QVector<int> &states, qint64 historyFrames);  //state values (State column) to track, clears history
+    void addFrame(const QVector<QVector<double>> &frame);
+
+    int trackedCount() const { return m_states.size(); }
+    int trackedState(int tracked) const { return m_states.at(tracked); }
+    qint64 frameCount() const { return m_frames; }
+    qint64 oldestFrame() const;                                 //first frame still held by the top level
+
+    //min/max per pixel of frames [firstFrame, lastFrame) for component 0 (I) or 1 (Q), NaN where no data
+    void query(int tracked, int component, qint64 firstFrame, qint64 lastFrame, int pixels,
+               QVector<double> &minimum, QVector<double> &maximum) const;
+
+private:
+    struct Level {
+        QVector<double> minimum;                                //ring of bucketsPerLevel
+        QVector<double> maximum;
+        qint64 completed = 0;                                   //buckets finished since configure
+        double partialMinimum;                                  //bucket being filled
+        double partialMaximum;
+        int partialCount = 0;                                   //frames in the partial bucket
+    };
+
+    void push(QVector<Level> &levels, double value);
+    bool bucket(const Level &level, qint64 index, double &minimum, double &maximum) const;
+
+    QVector<int> m_states;                                      //tracked state values
+    QVector<int> m_columns;                                     //frame column of each tracked state, -1 if not found
+    int m_levelCount = 1;
+    QVector<QVector<Level>> m_series;                           //[tracked * 2 + component][level]
+    qint64 m_frames = 0;
+};
+
+#endif // TRENDPYRAMID_H
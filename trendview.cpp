@@ -0,0 +1,120 @@
+#include "trendview.h"
+#include "frameassembler.h"
+#include <QPainter>
+#include <QWheelEvent>
+#include <QtNumeric>
+
+TrendView::TrendView(QWidget *parent)
+    : QWidget{parent}
+{
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &TrendView::onRefreshTimeout);
+    m_refreshTimer.start(100);                                  //drift plot, 10 fps is plenty
+}
+
+void TrendView::configure(const QVector<int> &states, qint64 historyFrames)
+{
+    m_pyramid.configure(states, historyFrames);
+    m_historyFrames = historyFrames;
+    m_spanFrames = 0;
+    m_frequency = -1;
+    m_dirty = true;
+}
+
+void TrendView::addFrame(const QVector<QVector<double>> &frame)
+{
+    if (m_pyramid.trackedCount() == 0 || frame[RowFrequency].isEmpty())
+        return;
+    const qint64 frequency = static_cast<qint64>(frame[RowFrequency].first());
+    if (m_frequency < 0)
+        m_frequency = frequency;
+    if (frequency != m_frequency)
+        return;
+    m_pyramid.addFrame(frame);
+    m_dirty = true;
+}
+
+void TrendView::onRefreshTimeout()
+{
+    if (m_dirty && isVisible()) {
+        m_dirty = false;
+        update();
+    }
+}
+
+/**
+ * @brief TrendView::wheelEvent
+ * Each notch halves or doubles the span, between 64 frames and the whole history
+ */
+void TrendView::wheelEvent(QWheelEvent *event)
+{
+    const qint64 history = qMax<qint64>(64, qMin(m_historyFrames, m_pyramid.frameCount()));
+    qint64 span = m_spanFrames > 0 ? qMin(m_spanFrames, history) : history;
+    span = event->angleDelta().y() > 0 ? span / 2 : span * 2;
+    m_spanFrames = span >= history ? 0 : qMax<qint64>(64, span);
+    event->accept();
+    update();
+}
+
+/**
+ * @brief TrendView::paintEvent
+ * One vertical min-max line per pixel column and series, I in the state colour and Q lighter,
+ * all series share the vertical scale of the visible data
+ */
+void TrendView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+
+    const int pixels = width();
+    const qint64 lastFrame = m_pyramid.frameCount();
+    const qint64 oldest = m_pyramid.oldestFrame();
+    const qint64 firstFrame = m_spanFrames > 0 ? qMax(oldest, lastFrame - m_spanFrames) : oldest;
+    if (pixels <= 0 || lastFrame <= firstFrame)
+        return;
+
+    const int seriesCount = m_pyramid.trackedCount() * 2;
+    QVector<QVector<double>> minimum(seriesCount);
+    QVector<QVector<double>> maximum(seriesCount);
+    double low = qInf();
+    double high = -qInf();
+    for (int series = 0; series < seriesCount; ++series) {
+        m_pyramid.query(series / 2, series % 2, firstFrame, lastFrame, pixels, minimum[series], maximum[series]);
+        for (int x = 0; x < pixels; ++x) {
+            if (!qIsNaN(minimum[series][x])) {
+                low = qMin(low, minimum[series][x]);
+                high = qMax(high, maximum[series][x]);
+            }
+        }
+    }
+    if (low > high)
+        return;
+    if (high - low < 1e-12) {
+        low -= 0.5;
+        high += 0.5;
+    }
+
+    const double scale = (height() - 1) / (high - low);
+    QVector<QLine> lines;
+    lines.reserve(pixels);
+    for (int series = 0; series < seriesCount; ++series) {
+        lines.clear();
+        for (int x = 0; x < pixels; ++x) {
+            if (qIsNaN(minimum[series][x]))
+                continue;
+            lines.append(QLine(x, qRound((high - maximum[series][x]) * scale),
+                               x, qRound((high - minimum[series][x]) * scale)));
+        }
+        const QColor colour = QColor::fromHsv((series / 2) * 67 % 360, series % 2 ? 110 : 255, 255);
+        painter.setPen(colour);
+        painter.drawLines(lines);
+        painter.drawText(8, 16 + 14 * series, QString("State %1 %2").arg(m_pyramid.trackedState(series / 2)).arg(series % 2 ? "Q" : "I"));
+    }
+
+    painter.setPen(Qt::white);
+    painter.drawText(rect().adjusted(0, 4, -8, 0), Qt::AlignRight | Qt::AlignTop,
+                     QString("frames %1 - %2   max %3").arg(firstFrame).arg(lastFrame).arg(high, 0, 'g', 6));
+    painter.drawText(rect().adjusted(0, 0, -8, -4), Qt::AlignRight | Qt::AlignBottom,
+                     QString("min %1").arg(low, 0, 'g', 6));
+}
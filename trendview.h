@@ -0,0 +1,40 @@
+#ifndef TRENDVIEW_H
+#define TRENDVIEW_H
+
+#include <QWidget>
+#include <QTimer>
+#include "trendpyramid.h"
+
+/**
+ * @brief The TrendView class
+ *
+ * Long-run I/Q drift plot of the tracked states. Frames of one frequency go into a TrendPyramid,
+ * each repaint queries one min/max pair per pixel column, so a view of hours of frames costs
+ * the same as a view of a few seconds. Shows the newest frames, the mouse wheel zooms the span
+ */
+
+class TrendView : public QWidget
+{
+    Q_OBJECT
+public:
+    explicit TrendView(QWidget *parent = nullptr);
+
+    void configure(const QVector<int> &states, qint64 historyFrames);  //clears the history
+    void addFrame(const QVector<QVector<double>> &frame);               //frames of other frequencies than the first one seen are ignored
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void wheelEvent(QWheelEvent *event) override;
+
+private:
+    void onRefreshTimeout();                                    //repaints if frames were added
+
+    TrendPyramid m_pyramid;
+    qint64 m_historyFrames = 0;
+    qint64 m_spanFrames = 0;                                    //frames across the plot width, 0 = whole history
+    qint64 m_frequency = -1;                                    //frequency being tracked, -1 until the first frame
+    bool m_dirty = false;
+    QTimer m_refreshTimer;
+};
+
+#endif // TRENDVIEW_H